@@ -0,0 +1,1622 @@
+// ============================================================================
+//! \file Arduino.hpp
+//! \brief Arduino API of the emulator, included by the Arduino sketches
+//! \author Lecrapouille
+//! \copyright MIT License
+//!
+//! This header only declares the Arduino functions and objects. They are
+//! implemented by the emulator library (src/ArduinoEmulator/Arduino.cpp) on
+//! the emulator bound to the calling thread, so a sketch is compiled without
+//! parsing the emulator internals (ArduinoEmulator.hpp, SFML, threads ...).
+// ============================================================================
+
+#pragma once
+
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+
+//! \brief Symbols shared by the emulator and a sketch library built with
+//! -fvisibility=hidden (see SketchLoader): the library uses the ones of the
+//! emulator executable.
+#define ARDUINO_EMULATOR_EXPORT __attribute__((visibility("default")))
+
+// Arduino definitions
+constexpr int HIGH = 1; ///< Digital HIGH state (1)
+constexpr int LOW = 0;  ///< Digital LOW state (0)
+
+// Pin modes
+constexpr int INPUT = 0;  ///< Pin configured as input
+constexpr int OUTPUT = 1; ///< Pin configured as output
+constexpr int INPUT_PULLUP =
+    2; ///< Pin configured as input with pull-up resistor
+constexpr int INPUT_PULLDOWN =
+    3; ///< Pin configured as input with pull-down resistor
+constexpr int OUTPUT_OPEN_DRAIN =
+    4; ///< Pin configured as output with open-drain configuration
+
+// Interrupt modes
+constexpr int CHANGE = 1;  ///< Interrupt on any change
+constexpr int RISING = 2;  ///< Interrupt on rising edge
+constexpr int FALLING = 3; ///< Interrupt on falling edge
+
+// Analog reference types
+constexpr int DEFAULT = 0;  ///< Default analog reference
+constexpr int INTERNAL = 1; ///< Internal analog reference
+constexpr int EXTERNAL = 2; ///< External analog reference
+
+// Serial print formats
+constexpr int DEC = 10; ///< Decimal format (base 10)
+constexpr int HEX = 16; ///< Hexadecimal format (base 16)
+constexpr int OCT = 8;  ///< Octal format (base 8)
+constexpr int BIN = 2;  ///< Binary format (base 2)
+
+// SPI bit orders and data modes (clock polarity and phase)
+constexpr uint8_t LSBFIRST = 0;     ///< Least significant bit first
+constexpr uint8_t MSBFIRST = 1;     ///< Most significant bit first
+constexpr uint8_t SPI_MODE0 = 0x00; ///< CPOL = 0, CPHA = 0
+constexpr uint8_t SPI_MODE1 = 0x04; ///< CPOL = 0, CPHA = 1
+constexpr uint8_t SPI_MODE2 = 0x08; ///< CPOL = 1, CPHA = 0
+constexpr uint8_t SPI_MODE3 = 0x0C; ///< CPOL = 1, CPHA = 1
+
+// Type definitions
+using boolean = bool;
+using byte = uint8_t;
+
+// Analog pin definitions (Arduino Uno style, or Mega 2560 when compiled with
+// -DARDUINO_AVR_MEGA2560 as the Arduino IDE does). They shall match the
+// pin_mapping of the board file.
+// Using constexpr to avoid macro conflicts with JSON nlohmann library
+#if defined(ARDUINO_AVR_MEGA2560)
+constexpr int A0 = 54;  ///< Analog pin 0
+constexpr int A1 = 55;  ///< Analog pin 1
+constexpr int A2 = 56;  ///< Analog pin 2
+constexpr int A3 = 57;  ///< Analog pin 3
+constexpr int A4 = 58;  ///< Analog pin 4
+constexpr int A5 = 59;  ///< Analog pin 5
+constexpr int A6 = 60;  ///< Analog pin 6
+constexpr int A7 = 61;  ///< Analog pin 7
+constexpr int A8 = 62;  ///< Analog pin 8
+constexpr int A9 = 63;  ///< Analog pin 9
+constexpr int A10 = 64; ///< Analog pin 10
+constexpr int A11 = 65; ///< Analog pin 11
+constexpr int A12 = 66; ///< Analog pin 12
+constexpr int A13 = 67; ///< Analog pin 13
+constexpr int A14 = 68; ///< Analog pin 14
+constexpr int A15 = 69; ///< Analog pin 15
+#else
+constexpr int A0 = 14; ///< Analog pin 0
+constexpr int A1 = 15; ///< Analog pin 1
+constexpr int A2 = 16; ///< Analog pin 2
+constexpr int A3 = 17; ///< Analog pin 3
+constexpr int A4 = 18; ///< Analog pin 4
+constexpr int A5 = 19; ///< Analog pin 5
+#endif
+constexpr int LED_BUILTIN = 13; ///< Built-in LED on Arduino Uno (pin 13)
+
+// ============================================================================
+// AVR peripherals (ATmega328P)
+// ============================================================================
+
+#ifndef F_CPU
+//! \brief Clock frequency of the emulated AVR in Hz (multiple of 1 MHz).
+#    define F_CPU 16000000UL
+#endif
+
+//! \brief Bit mask of a register bit.
+#define _BV(bit) (1 << (bit))
+
+//! \brief CPU cycles per microsecond.
+constexpr uint64_t AVR_TICKS_PER_US = F_CPU / 1000000UL;
+static_assert((F_CPU % 1000000UL) == 0, "F_CPU shall be a multiple of 1 MHz");
+
+// Timer/Counter 0 bits
+constexpr int WGM00 = 0;  ///< TCCR0A: waveform generation mode bit 0
+constexpr int WGM01 = 1;  ///< TCCR0A: waveform generation mode bit 1
+constexpr int COM0B0 = 4; ///< TCCR0A: compare match output B mode bit 0
+constexpr int COM0B1 = 5; ///< TCCR0A: compare match output B mode bit 1
+constexpr int COM0A0 = 6; ///< TCCR0A: compare match output A mode bit 0
+constexpr int COM0A1 = 7; ///< TCCR0A: compare match output A mode bit 1
+constexpr int CS00 = 0;   ///< TCCR0B: clock select bit 0
+constexpr int CS01 = 1;   ///< TCCR0B: clock select bit 1
+constexpr int CS02 = 2;   ///< TCCR0B: clock select bit 2
+constexpr int WGM02 = 3;  ///< TCCR0B: waveform generation mode bit 2
+constexpr int TOIE0 = 0;  ///< TIMSK0: overflow interrupt enable
+constexpr int OCIE0A = 1; ///< TIMSK0: compare match A interrupt enable
+constexpr int OCIE0B = 2; ///< TIMSK0: compare match B interrupt enable
+constexpr int TOV0 = 0;   ///< TIFR0: overflow flag
+constexpr int OCF0A = 1;  ///< TIFR0: compare match A flag
+constexpr int OCF0B = 2;  ///< TIFR0: compare match B flag
+
+// Timer/Counter 1 bits
+constexpr int WGM10 = 0;  ///< TCCR1A: waveform generation mode bit 0
+constexpr int WGM11 = 1;  ///< TCCR1A: waveform generation mode bit 1
+constexpr int COM1B0 = 4; ///< TCCR1A: compare match output B mode bit 0
+constexpr int COM1B1 = 5; ///< TCCR1A: compare match output B mode bit 1
+constexpr int COM1A0 = 6; ///< TCCR1A: compare match output A mode bit 0
+constexpr int COM1A1 = 7; ///< TCCR1A: compare match output A mode bit 1
+constexpr int CS10 = 0;   ///< TCCR1B: clock select bit 0
+constexpr int CS11 = 1;   ///< TCCR1B: clock select bit 1
+constexpr int CS12 = 2;   ///< TCCR1B: clock select bit 2
+constexpr int WGM12 = 3;  ///< TCCR1B: waveform generation mode bit 2
+constexpr int WGM13 = 4;  ///< TCCR1B: waveform generation mode bit 3
+constexpr int ICES1 = 6;  ///< TCCR1B: input capture edge select
+constexpr int ICNC1 = 7;  ///< TCCR1B: input capture noise canceler
+constexpr int TOIE1 = 0;  ///< TIMSK1: overflow interrupt enable
+constexpr int OCIE1A = 1; ///< TIMSK1: compare match A interrupt enable
+constexpr int OCIE1B = 2; ///< TIMSK1: compare match B interrupt enable
+constexpr int ICIE1 = 5;  ///< TIMSK1: input capture interrupt enable
+constexpr int TOV1 = 0;   ///< TIFR1: overflow flag
+constexpr int OCF1A = 1;  ///< TIFR1: compare match A flag
+constexpr int OCF1B = 2;  ///< TIFR1: compare match B flag
+constexpr int ICF1 = 5;   ///< TIFR1: input capture flag
+
+// Timer/Counter 2 bits
+constexpr int WGM20 = 0;  ///< TCCR2A: waveform generation mode bit 0
+constexpr int WGM21 = 1;  ///< TCCR2A: waveform generation mode bit 1
+constexpr int COM2B0 = 4; ///< TCCR2A: compare match output B mode bit 0
+constexpr int COM2B1 = 5; ///< TCCR2A: compare match output B mode bit 1
+constexpr int COM2A0 = 6; ///< TCCR2A: compare match output A mode bit 0
+constexpr int COM2A1 = 7; ///< TCCR2A: compare match output A mode bit 1
+constexpr int CS20 = 0;   ///< TCCR2B: clock select bit 0
+constexpr int CS21 = 1;   ///< TCCR2B: clock select bit 1
+constexpr int CS22 = 2;   ///< TCCR2B: clock select bit 2
+constexpr int WGM22 = 3;  ///< TCCR2B: waveform generation mode bit 2
+constexpr int TOIE2 = 0;  ///< TIMSK2: overflow interrupt enable
+constexpr int OCIE2A = 1; ///< TIMSK2: compare match A interrupt enable
+constexpr int OCIE2B = 2; ///< TIMSK2: compare match B interrupt enable
+constexpr int TOV2 = 0;   ///< TIFR2: overflow flag
+constexpr int OCF2A = 1;  ///< TIFR2: compare match A flag
+constexpr int OCF2B = 2;  ///< TIFR2: compare match B flag
+
+// Interrupt vector numbers (used by the ISR() macro)
+constexpr int INT0_vect_num = 1;          ///< External interrupt 0 (pin 2)
+constexpr int INT1_vect_num = 2;          ///< External interrupt 1 (pin 3)
+constexpr int TIMER2_COMPA_vect_num = 7;  ///< Timer2 compare match A
+constexpr int TIMER2_COMPB_vect_num = 8;  ///< Timer2 compare match B
+constexpr int TIMER2_OVF_vect_num = 9;    ///< Timer2 overflow
+constexpr int TIMER1_CAPT_vect_num = 10;  ///< Timer1 input capture
+constexpr int TIMER1_COMPA_vect_num = 11; ///< Timer1 compare match A
+constexpr int TIMER1_COMPB_vect_num = 12; ///< Timer1 compare match B
+constexpr int TIMER1_OVF_vect_num = 13;   ///< Timer1 overflow
+constexpr int TIMER0_COMPA_vect_num = 14; ///< Timer0 compare match A
+constexpr int TIMER0_COMPB_vect_num = 15; ///< Timer0 compare match B
+constexpr int TIMER0_OVF_vect_num = 16;   ///< Timer0 overflow
+
+//! \brief Number of interrupt vectors of the ATmega328P.
+constexpr size_t AVR_VECTOR_COUNT = 26;
+
+//! \brief Interrupt service routine.
+using IsrHandler = void (*)();
+
+//! \brief ISRs of the sketch indexed by vector number (see the ISR() macro).
+extern ARDUINO_EMULATOR_EXPORT std::array<IsrHandler, AVR_VECTOR_COUNT>
+    isr_vectors;
+
+// ============================================================================
+//! \brief Install an ISR in isr_vectors during the static initialization.
+//! Used by the ISR() macro.
+// ============================================================================
+struct IsrRegistration
+{
+    IsrRegistration(int p_vector, IsrHandler p_handler)
+    {
+        isr_vectors[static_cast<size_t>(p_vector)] = p_handler;
+    }
+};
+
+// ============================================================================
+//! \brief Peripheral whose registers react to reads and writes.
+// ============================================================================
+class AvrPeripheral
+{
+public:
+
+    virtual ~AvrPeripheral() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a register.
+    //! \param p_id Register identifier (peripheral specific).
+    // ------------------------------------------------------------------------
+    virtual uint16_t readRegister(int p_id) = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a register.
+    //! \param p_id Register identifier (peripheral specific).
+    //! \param p_value New value.
+    // ------------------------------------------------------------------------
+    virtual void writeRegister(int p_id, uint16_t p_value) = 0;
+};
+
+// ============================================================================
+//! \class AvrRegister
+//! \brief I/O register of a peripheral, usable like the AVR registers:
+//! TCCR1B |= _BV(CS12); if (TIFR1 & _BV(OCF1A)) ...
+//!
+//! \tparam T uint8_t or uint16_t.
+// ============================================================================
+template <typename T>
+class AvrRegister
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_peripheral Peripheral owning the register.
+    //! \param p_id Register identifier in the peripheral.
+    // ------------------------------------------------------------------------
+    AvrRegister(AvrPeripheral& p_peripheral, int p_id)
+        : m_peripheral(p_peripheral), m_id(p_id)
+    {
+    }
+
+    operator T() const
+    {
+        return static_cast<T>(m_peripheral.readRegister(m_id));
+    }
+
+    AvrRegister& operator=(int p_value)
+    {
+        m_peripheral.writeRegister(
+            m_id, static_cast<uint16_t>(static_cast<T>(p_value)));
+        return *this;
+    }
+
+    AvrRegister& operator=(AvrRegister const& p_other)
+    {
+        return *this = static_cast<int>(static_cast<T>(p_other));
+    }
+
+    AvrRegister& operator|=(int p_value)
+    {
+        return *this = static_cast<T>(*this) | p_value;
+    }
+
+    AvrRegister& operator&=(int p_value)
+    {
+        return *this = static_cast<T>(*this) & p_value;
+    }
+
+    AvrRegister& operator^=(int p_value)
+    {
+        return *this = static_cast<T>(*this) ^ p_value;
+    }
+
+private:
+
+    AvrPeripheral& m_peripheral; ///< Owner of the register
+    int m_id;                    ///< Register identifier
+};
+
+// ============================================================================
+//! \brief Registers of an AVR Timer/Counter, as accessed by the sketch
+//! (TCCRnA, TCNTn ...). Implemented by AvrTimer.
+//!
+//! \tparam T uint8_t for the 8-bit timers, uint16_t for the 16-bit timer.
+// ============================================================================
+template <typename T>
+struct AvrTimerRegisters
+{
+    //! \brief Register identifiers.
+    enum Register
+    {
+        TCCRA,
+        TCCRB,
+        TCCRC,
+        TCNT,
+        OCRA,
+        OCRB,
+        ICR,
+        TIMSK,
+        TIFR,
+        REGISTER_COUNT
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_timer Peripheral reacting to the register accesses.
+    // ------------------------------------------------------------------------
+    explicit AvrTimerRegisters(AvrPeripheral& p_timer)
+        : tccra(p_timer, TCCRA),
+          tccrb(p_timer, TCCRB),
+          tccrc(p_timer, TCCRC),
+          tcnt(p_timer, TCNT),
+          ocra(p_timer, OCRA),
+          ocrb(p_timer, OCRB),
+          icr(p_timer, ICR),
+          timsk(p_timer, TIMSK),
+          tifr(p_timer, TIFR)
+    {
+    }
+
+    AvrRegister<uint8_t> tccra; ///< Control register A
+    AvrRegister<uint8_t> tccrb; ///< Control register B
+    AvrRegister<uint8_t> tccrc; ///< Control register C
+    AvrRegister<T> tcnt;        ///< Counter value
+    AvrRegister<T> ocra;        ///< Output compare A
+    AvrRegister<T> ocrb;        ///< Output compare B
+    AvrRegister<uint16_t> icr;  ///< Input capture
+    AvrRegister<uint8_t> timsk; ///< Interrupt mask
+    AvrRegister<uint8_t> tifr;  ///< Interrupt flags
+};
+
+// ----------------------------------------------------------------------------
+//! \brief Registers of the Timer/Counter 0 of the emulator bound to the
+//! calling thread.
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint8_t>& avrTimer0();
+
+// ----------------------------------------------------------------------------
+//! \brief Registers of the Timer/Counter 1 of the emulator bound to the
+//! calling thread.
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint16_t>& avrTimer1();
+
+// ----------------------------------------------------------------------------
+//! \brief Registers of the Timer/Counter 2 of the emulator bound to the
+//! calling thread.
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint8_t>& avrTimer2();
+
+// ============================================================================
+//! \defgroup GlobalFunctions Global Arduino Functions
+//! \brief Arduino-compatible global functions
+//!
+//! These functions provide Arduino-style global interface to the emulator.
+//! \{
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+//! \brief Configure a pin's mode
+//! \param p_pin Pin number
+//! \param p_mode Pin mode (INPUT, OUTPUT, or INPUT_PULLUP)
+// ----------------------------------------------------------------------------
+void pinMode(int p_pin, int p_mode);
+
+// ----------------------------------------------------------------------------
+//! \brief Write a digital value to a pin
+//! \param p_pin Pin number
+//! \param p_value Value to write (HIGH or LOW)
+// ----------------------------------------------------------------------------
+void digitalWrite(int p_pin, int p_value);
+
+// ----------------------------------------------------------------------------
+//! \brief Read a digital value from a pin
+//! \param p_pin Pin number
+//! \return Current pin value (HIGH or LOW)
+// ----------------------------------------------------------------------------
+int digitalRead(int p_pin);
+
+// ----------------------------------------------------------------------------
+//! \brief Write an analog (PWM) value to a pin
+//! \param p_pin Pin number
+//! \param p_value PWM value (0-255)
+// ----------------------------------------------------------------------------
+void analogWrite(int p_pin, int p_value);
+
+// ----------------------------------------------------------------------------
+//! \brief Read an analog value from a pin
+//! \param p_pin Pin number
+//! \return Analog value (0-1023)
+// ----------------------------------------------------------------------------
+int analogRead(int p_pin);
+
+// ----------------------------------------------------------------------------
+//! \brief Get elapsed time in milliseconds
+//! \return Milliseconds since program start
+// ----------------------------------------------------------------------------
+long millis();
+
+// ----------------------------------------------------------------------------
+//! \brief Get elapsed time in microseconds
+//! \return Microseconds since program start
+// ----------------------------------------------------------------------------
+long micros();
+
+// ----------------------------------------------------------------------------
+//! \brief Delay execution for specified milliseconds
+//! \param p_ms Milliseconds to delay
+// ----------------------------------------------------------------------------
+void delay(long p_ms);
+
+// ----------------------------------------------------------------------------
+//! \brief Delay execution for specified microseconds
+//! \param p_us Microseconds to delay
+// ----------------------------------------------------------------------------
+void delayMicroseconds(int p_us);
+
+// ----------------------------------------------------------------------------
+//! \brief Measure the duration of a pulse on a pin
+//! \param p_pin Pin number
+//! \param p_state State to measure (HIGH or LOW)
+//! \param p_timeout Timeout in microseconds (default: 1000000)
+//! \return Duration of the pulse in microseconds
+//!
+//! In simulation mode, returns a mock value based on pin state.
+// ----------------------------------------------------------------------------
+long pulseIn(int p_pin, int p_state, long p_timeout = 1000000);
+
+// ----------------------------------------------------------------------------
+//! \brief Set the analog read resolution
+//! \param p_resolution Resolution in bits
+// ----------------------------------------------------------------------------
+void analogReadResolution(int p_resolution);
+
+// ----------------------------------------------------------------------------
+//! \brief Set the analog write resolution
+//! \param p_resolution Resolution in bits
+// ----------------------------------------------------------------------------
+void analogWriteResolution(int p_resolution);
+
+// ----------------------------------------------------------------------------
+//! \brief Set the analog reference voltage
+//! \param p_reference Reference type (DEFAULT, INTERNAL, or EXTERNAL)
+// ----------------------------------------------------------------------------
+void analogReference(int p_reference);
+
+// ----------------------------------------------------------------------------
+//! \brief Enable the interrupts (set the global interrupt flag).
+// ----------------------------------------------------------------------------
+void interrupts();
+
+// ----------------------------------------------------------------------------
+//! \brief Disable the interrupts (clear the global interrupt flag). Raised
+//! interrupts stay pending until interrupts() is called.
+// ----------------------------------------------------------------------------
+void noInterrupts();
+
+// ----------------------------------------------------------------------------
+//! \brief avr-libc name of interrupts().
+// ----------------------------------------------------------------------------
+inline void sei()
+{
+    interrupts();
+}
+
+// ----------------------------------------------------------------------------
+//! \brief avr-libc name of noInterrupts().
+// ----------------------------------------------------------------------------
+inline void cli()
+{
+    noInterrupts();
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Attach an interrupt to a pin
+//! \param p_pin Pin number
+//! \param p_function Interrupt callback function
+//! \param p_mode Interrupt mode (CHANGE, RISING, or FALLING)
+// ----------------------------------------------------------------------------
+void attachInterrupt(int p_pin, void (*p_function)(), int p_mode);
+
+// ----------------------------------------------------------------------------
+//! \brief Detach an interrupt from a pin
+//! \param p_pin Pin number
+// ----------------------------------------------------------------------------
+void detachInterrupt(int p_pin);
+
+// ----------------------------------------------------------------------------
+//! \brief Generate a tone on a pin
+//! \param p_pin Pin number
+//! \param p_frequency Frequency in Hz
+//!
+//! Generates a square wave tone using SFML audio output.
+//! Also sets the pin to HIGH state.
+// ----------------------------------------------------------------------------
+void tone(int p_pin, int p_frequency);
+
+// ----------------------------------------------------------------------------
+//! \brief Generate a tone on a pin for a duration
+//! \param p_pin Pin number
+//! \param p_frequency Frequency in Hz
+//! \param p_duration Duration in milliseconds
+//!
+//! Generates a square wave tone for the specified duration using SFML.
+//! Sets the pin HIGH during playback, then LOW after.
+// ----------------------------------------------------------------------------
+void tone(int p_pin, int p_frequency, long p_duration);
+
+// ----------------------------------------------------------------------------
+//! \brief Stop generating a tone on a pin
+//! \param p_pin Pin number
+//!
+//! Stops the currently playing tone and sets the pin to LOW.
+// ----------------------------------------------------------------------------
+void noTone(int p_pin);
+
+// Math functions
+
+// ----------------------------------------------------------------------------
+//! \brief Constrain a value within a range
+//! \param p_value Value to constrain
+//! \param p_min Minimum value
+//! \param p_max Maximum value
+//! \return Constrained value
+// ----------------------------------------------------------------------------
+inline int constrain(int p_value, int p_min, int p_max)
+{
+    if (p_value < p_min)
+        return p_min;
+    if (p_value > p_max)
+        return p_max;
+    return p_value;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Map a value from one range to another
+//! \param p_val Value to map
+//! \param p_min Input range minimum
+//! \param p_max Input range maximum
+//! \param p_new_min Output range minimum
+//! \param p_new_max Output range maximum
+//! \return Mapped value
+// ----------------------------------------------------------------------------
+inline long
+map(long p_val, long p_min, long p_max, long p_new_min, long p_new_max)
+{
+    return (p_val - p_min) * (p_new_max - p_new_min) / (p_max - p_min) +
+           p_new_min;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Return the maximum of two values
+//! \param p_val1 First value
+//! \param p_val2 Second value
+//! \return Maximum value
+// ----------------------------------------------------------------------------
+inline int max(int p_val1, int p_val2)
+{
+    return (p_val1 > p_val2) ? p_val1 : p_val2;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Return the minimum of two values
+//! \param p_val1 First value
+//! \param p_val2 Second value
+//! \return Minimum value
+// ----------------------------------------------------------------------------
+inline int min(int p_val1, int p_val2)
+{
+    return (p_val1 < p_val2) ? p_val1 : p_val2;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Calculate the square of a number
+//! \param p_value Input value
+//! \return Square of the value
+// ----------------------------------------------------------------------------
+inline int sq(int p_value)
+{
+    return p_value * p_value;
+}
+
+// Character functions
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is alphabetic
+//! \param p_c Character to check
+//! \return true if alphabetic, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isAlpha(char p_c)
+{
+    return std::isalpha(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is alphanumeric
+//! \param p_c Character to check
+//! \return true if alphanumeric, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isAlphaNumeric(char p_c)
+{
+    return std::isalnum(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is ASCII
+//! \param p_c Character to check
+//! \return true if 7-bit ASCII, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isAscii(char p_c)
+{
+    return (static_cast<unsigned char>(p_c) <= 127);
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is a control character
+//! \param p_c Character to check
+//! \return true if control character, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isControl(char p_c)
+{
+    return std::iscntrl(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is a digit
+//! \param p_c Character to check
+//! \return true if digit (0-9), false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isDigit(char p_c)
+{
+    return std::isdigit(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is a printable character (excluding space)
+//! \param p_c Character to check
+//! \return true if printable and not space, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isGraph(char p_c)
+{
+    return std::isgraph(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is a hexadecimal digit
+//! \param p_c Character to check
+//! \return true if hex digit (0-9, A-F, a-f), false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isHexadecimalDigit(char p_c)
+{
+    return std::isxdigit(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is lowercase
+//! \param p_c Character to check
+//! \return true if lowercase, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isLowerCase(char p_c)
+{
+    return std::islower(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is printable (including space)
+//! \param p_c Character to check
+//! \return true if printable, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isPrintable(char p_c)
+{
+    return std::isprint(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is punctuation
+//! \param p_c Character to check
+//! \return true if punctuation, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isPunct(char p_c)
+{
+    return std::ispunct(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is whitespace
+//! \param p_c Character to check
+//! \return true if whitespace, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isSpace(char p_c)
+{
+    return std::isspace(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is uppercase
+//! \param p_c Character to check
+//! \return true if uppercase, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isUpperCase(char p_c)
+{
+    return std::isupper(static_cast<unsigned char>(p_c)) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Check if character is whitespace (same as isSpace)
+//! \param p_c Character to check
+//! \return true if whitespace, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean isWhitespace(char p_c)
+{
+    return isSpace(p_c);
+}
+
+// Random functions (Note: conflicts with stdlib random() avoided by using long
+// return type)
+
+// ----------------------------------------------------------------------------
+//! \brief Generate a random number within a range.
+//! \param p_max Maximum value (exclusive).
+//! \return Random number between 0 and p_max-1.
+// ----------------------------------------------------------------------------
+long random(long p_max);
+
+// ----------------------------------------------------------------------------
+//! \brief Generate a random number within a range.
+//! \param p_min Minimum value (inclusive).
+//! \param p_max Maximum value (exclusive).
+//! \return Random number between p_min and p_max-1.
+// ----------------------------------------------------------------------------
+long random(long p_min, long p_max);
+
+// ----------------------------------------------------------------------------
+//! \brief Seed the random number generator
+//! \param p_seed Seed value
+// ----------------------------------------------------------------------------
+void randomSeed(unsigned long p_seed);
+
+// Bit manipulation functions
+
+// ----------------------------------------------------------------------------
+//! \brief Get the value of a specific bit
+//! \param p_value Value to read from
+//! \param p_bit_number Bit number (0 = LSB)
+//! \return true if bit is set, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean bit(int p_value, int p_bit_number)
+{
+    return ((p_value >> p_bit_number) & 1) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Clear a specific bit
+//! \param p_value Reference to value to modify
+//! \param p_bit Bit number to clear
+// ----------------------------------------------------------------------------
+inline void bitClear(int& p_value, int p_bit)
+{
+    p_value &= ~(1 << p_bit);
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Read the value of a specific bit
+//! \param p_value Value to read from
+//! \param p_bit_number Bit number (0 = LSB)
+//! \return true if bit is set, false otherwise
+// ----------------------------------------------------------------------------
+inline boolean bitRead(int p_value, int p_bit_number)
+{
+    return ((p_value >> p_bit_number) & 1) != 0;
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Set a specific bit
+//! \param p_value Reference to value to modify
+//! \param p_bit Bit number to set
+// ----------------------------------------------------------------------------
+inline void bitSet(int& p_value, int p_bit)
+{
+    p_value |= (1 << p_bit);
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Write a value to a specific bit
+//! \param p_value Reference to value to modify
+//! \param p_bit Bit number
+//! \param p_bit_value Value to write (0 or 1)
+// ----------------------------------------------------------------------------
+inline void bitWrite(int& p_value, int p_bit, int p_bit_value)
+{
+    if (p_bit_value)
+        p_value |= (1 << p_bit);
+    else
+        p_value &= ~(1 << p_bit);
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Get the high byte of an int
+//! \param p_value Value to extract from
+//! \return High byte (bits 8-15)
+// ----------------------------------------------------------------------------
+inline byte highByte(int p_value)
+{
+    return static_cast<byte>((p_value >> 8) & 0xFF);
+}
+
+// ----------------------------------------------------------------------------
+//! \brief Get the low byte of an int
+//! \param p_value Value to extract from
+//! \return Low byte (bits 0-7)
+// ----------------------------------------------------------------------------
+inline byte lowByte(int p_value)
+{
+    return static_cast<byte>(p_value & 0xFF);
+}
+
+// ----------------------------------------------------------------------------/!
+// \}  //
+// ----------------------------------------------------------------------------
+// // end of GlobalFunctions
+
+// ============================================================================
+//! \class Print
+//! \brief Arduino-compatible base class of the byte outputs (Serial ...).
+//!
+//! A derived class only has to implement write(uint8_t). It should also
+//! override the bulk write(const uint8_t*, size_t) when its device can take
+//! a whole buffer at once: every print() function formats into a buffer on
+//! the stack and writes it with a single bulk write.
+// ============================================================================
+class Print
+{
+public:
+
+    virtual ~Print() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a single byte
+    //! \param p_byte Byte to write (raw value, not ASCII)
+    //! \return Number of bytes written (0 or 1)
+    // ------------------------------------------------------------------------
+    virtual size_t write(uint8_t p_byte) = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a buffer (calls write(uint8_t) for each byte by default)
+    //! \param p_buffer Bytes to write
+    //! \param p_size Number of bytes
+    //! \return Number of bytes written
+    // ------------------------------------------------------------------------
+    virtual size_t write(const uint8_t* p_buffer, size_t p_size);
+
+    // ------------------------------------------------------------------------
+    //! \brief Write characters
+    //! \param p_buffer Characters to write (not null-terminated)
+    //! \param p_size Number of characters
+    //! \return Number of bytes written
+    // ------------------------------------------------------------------------
+    size_t write(const char* p_buffer, size_t p_size)
+    {
+        return write(reinterpret_cast<const uint8_t*>(p_buffer), p_size);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a null-terminated string
+    //! \param p_str String to write (nullptr writes nothing)
+    //! \return Number of bytes written
+    // ------------------------------------------------------------------------
+    size_t write(const char* p_str);
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes which can be written without blocking
+    //! \return 0 when the output does not know
+    // ------------------------------------------------------------------------
+    virtual int availableForWrite()
+    {
+        return 0;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait for the written bytes to be sent
+    // ------------------------------------------------------------------------
+    virtual void flush() {}
+
+    // ------------------------------------------------------------------------
+    //! \brief Print a string without newline
+    //! \param p_str Null-terminated string to print
+    // ------------------------------------------------------------------------
+    size_t print(const char* p_str);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print a character without newline
+    //! \param p_c Character to print
+    // ------------------------------------------------------------------------
+    size_t print(char p_c);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print an integer without newline
+    //! \param p_val Integer to print
+    //! \param p_base Base (DEC, HEX, OCT, BIN). Negative numbers are only
+    //! signed in DEC, other bases print their two's complement.
+    // ------------------------------------------------------------------------
+    size_t print(int p_val, int p_base = DEC);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print a long without newline
+    //! \param p_val Long to print
+    //! \param p_base Base (DEC, HEX, OCT, BIN)
+    // ------------------------------------------------------------------------
+    size_t print(long p_val, int p_base = DEC);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print an unsigned integer without newline
+    //! \param p_val Unsigned integer to print
+    //! \param p_base Base (DEC, HEX, OCT, BIN)
+    // ------------------------------------------------------------------------
+    size_t print(unsigned int p_val, int p_base = DEC);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print an unsigned long without newline
+    //! \param p_val Unsigned long to print
+    //! \param p_base Base (DEC, HEX, OCT, BIN)
+    // ------------------------------------------------------------------------
+    size_t print(unsigned long p_val, int p_base = DEC);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print a double without newline
+    //! \param p_val Double to print
+    //! \param p_digits Number of decimals (2 as on Arduino)
+    // ------------------------------------------------------------------------
+    size_t print(double p_val, int p_digits = 2);
+
+    // ------------------------------------------------------------------------
+    //! \brief Print just a newline
+    // ------------------------------------------------------------------------
+    size_t println();
+
+    // ------------------------------------------------------------------------
+    //! \brief Print a value followed by a newline (same arguments as the
+    //! print() functions)
+    // ------------------------------------------------------------------------
+    size_t println(const char* p_str);
+    size_t println(char p_c);
+    size_t println(int p_val, int p_base = DEC);
+    size_t println(long p_val, int p_base = DEC);
+    size_t println(unsigned int p_val, int p_base = DEC);
+    size_t println(unsigned long p_val, int p_base = DEC);
+    size_t println(double p_val, int p_digits = 2);
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Print an integer (see print(long, int)).
+    // ------------------------------------------------------------------------
+    template <typename T>
+    size_t printNumber(T p_val, int p_base);
+};
+
+// ============================================================================
+//! \class Stream
+//! \brief Arduino-compatible base class of the byte inputs (Serial ...).
+//!
+//! A derived class has to implement available(), read() and peek(). The
+//! readBytes() functions are implemented byte per byte and should be
+//! overridden by the devices able to extract a whole buffer at once.
+//!
+//! Functions waiting for data give up after the timeout (1 second by
+//! default). The wait uses delay(): it follows the emulator clock, serves
+//! the interrupts and lets the sketch be stopped meanwhile. The streams of
+//! the board (Serial, Wire) keep their timeout in the emulated peripheral,
+//! so that each emulated board has its own.
+// ============================================================================
+class Stream: public Print
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes available for reading
+    // ------------------------------------------------------------------------
+    virtual int available() = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract a byte
+    //! \return The byte, or -1 if none is available
+    // ------------------------------------------------------------------------
+    virtual int read() = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the next byte without extracting it
+    //! \return The byte, or -1 if none is available
+    // ------------------------------------------------------------------------
+    virtual int peek() = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief Read bytes until the buffer is full or the timeout expires
+    //! \param p_buffer Destination buffer
+    //! \param p_length Size of the buffer
+    //! \return Number of bytes read (0 means no valid data)
+    // ------------------------------------------------------------------------
+    virtual size_t readBytes(char* p_buffer, size_t p_length);
+
+    size_t readBytes(uint8_t* p_buffer, size_t p_length)
+    {
+        return readBytes(reinterpret_cast<char*>(p_buffer), p_length);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Read bytes until the terminator, the buffer is full or the
+    //! timeout expires. The terminator is extracted but not stored.
+    //! \param p_terminator Character ending the read
+    //! \param p_buffer Destination buffer
+    //! \param p_length Size of the buffer
+    //! \return Number of bytes stored in the buffer
+    // ------------------------------------------------------------------------
+    virtual size_t
+    readBytesUntil(char p_terminator, char* p_buffer, size_t p_length);
+
+    size_t
+    readBytesUntil(char p_terminator, uint8_t* p_buffer, size_t p_length)
+    {
+        return readBytesUntil(
+            p_terminator, reinterpret_cast<char*>(p_buffer), p_length);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the maximum time to wait for data
+    //! \param p_timeout Timeout in milliseconds
+    // ------------------------------------------------------------------------
+    virtual void setTimeout(unsigned long p_timeout)
+    {
+        m_timeout = p_timeout;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the maximum time to wait for data in milliseconds
+    // ------------------------------------------------------------------------
+    virtual unsigned long getTimeout() const
+    {
+        return m_timeout;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Skip the characters which cannot start a number and read an
+    //! integer ("-12abc" gives -12).
+    //! \return The integer, or 0 on timeout
+    // ------------------------------------------------------------------------
+    long parseInt();
+
+    // ------------------------------------------------------------------------
+    //! \brief Skip the characters which cannot start a number and read a
+    //! floating point number ("x-1.25;" gives -1.25).
+    //! \return The number, or 0 on timeout
+    // ------------------------------------------------------------------------
+    float parseFloat();
+
+protected:
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait until a byte is available or the timeout expires
+    //! \return false on timeout
+    // ------------------------------------------------------------------------
+    bool waitAvailable();
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract a byte, waiting at most the timeout
+    //! \return The byte, or -1 on timeout
+    // ------------------------------------------------------------------------
+    int timedRead();
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the next byte without extracting it, waiting at most the
+    //! timeout
+    //! \return The byte, or -1 on timeout
+    // ------------------------------------------------------------------------
+    int timedPeek();
+
+    // ------------------------------------------------------------------------
+    //! \brief Discard the bytes until the first digit or minus sign (or
+    //! decimal point)
+    //! \param p_decimal Stop on a decimal point too
+    //! \return The first character of the number (not extracted), or -1 on
+    //! timeout
+    // ------------------------------------------------------------------------
+    int peekNextDigit(bool p_decimal);
+
+protected:
+
+    //! \brief Maximum time to wait for data in milliseconds
+    unsigned long m_timeout = 1000;
+};
+
+// ============================================================================
+//! \class SerialClass
+//! \brief Arduino-compatible Serial communication class
+//!
+//! Provides the standard Arduino Serial interface for communication.
+//! These are global objects accessed as 'Serial' (and 'Serial1' to 'Serial3'
+//! on boards having several UARTs) in Arduino code. Buffers are written and
+//! read in bulk on the serial rings of the emulator.
+// ============================================================================
+class SerialClass: public Stream
+{
+public:
+
+    using Print::write;
+    using Stream::readBytes;
+    using Stream::readBytesUntil;
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor
+    //! \param p_port UART number (0 for Serial, 1 for Serial1 ...)
+    // ------------------------------------------------------------------------
+    explicit SerialClass(uint8_t p_port) : m_port(p_port) {}
+
+    // ------------------------------------------------------------------------
+    //! \brief Initialize serial communication
+    //! \param p_baud_rate Baud rate (only enforced when the emulator models
+    //! the UART timing)
+    // ------------------------------------------------------------------------
+    void begin(int p_baud_rate);
+
+    // ------------------------------------------------------------------------
+    //! \brief Disable serial communication
+    // ------------------------------------------------------------------------
+    void end();
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a single byte to serial output
+    //! \param p_byte Byte to write (raw value, not ASCII)
+    // ------------------------------------------------------------------------
+    size_t write(uint8_t p_byte) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a buffer to serial output in one go
+    //! \param p_buffer Bytes to write
+    //! \param p_size Number of bytes
+    // ------------------------------------------------------------------------
+    size_t write(const uint8_t* p_buffer, size_t p_size) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes which can be written without waiting
+    // ------------------------------------------------------------------------
+    int availableForWrite() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait for the written bytes to be transmitted
+    // ------------------------------------------------------------------------
+    void flush() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if Serial is ready (for compatibility with Leonardo, etc.)
+    //! \return Always true in the emulator
+    // ------------------------------------------------------------------------
+    explicit operator bool() const
+    {
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if data is available
+    //! \return Number of bytes available
+    // ------------------------------------------------------------------------
+    int available() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a byte from serial
+    //! \return Byte read, or -1 if none available
+    // ------------------------------------------------------------------------
+    int read() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the next received byte without extracting it
+    //! \return Byte, or -1 if none available
+    // ------------------------------------------------------------------------
+    int peek() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract the received bytes in bulk until the buffer is full or
+    //! the timeout expires
+    // ------------------------------------------------------------------------
+    size_t readBytes(char* p_buffer, size_t p_length) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract the received bytes in bulk until the terminator
+    //! (extracted, not stored), the buffer is full or the timeout expires
+    // ------------------------------------------------------------------------
+    size_t readBytesUntil(char p_terminator,
+                          char* p_buffer,
+                          size_t p_length) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the maximum time to wait for data on this UART of the
+    //! board
+    //! \param p_timeout Timeout in milliseconds
+    // ------------------------------------------------------------------------
+    void setTimeout(unsigned long p_timeout) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the maximum time to wait for data on this UART of the
+    //! board in milliseconds
+    // ------------------------------------------------------------------------
+    unsigned long getTimeout() const override;
+
+private:
+
+    //! \brief UART number
+    uint8_t m_port;
+};
+
+/// Global Serial objects (Arduino-compatible). Serial1 to Serial3 only work
+/// on boards declaring several UARTs (e.g. Mega).
+extern ARDUINO_EMULATOR_EXPORT SerialClass Serial;
+extern ARDUINO_EMULATOR_EXPORT SerialClass Serial1;
+extern ARDUINO_EMULATOR_EXPORT SerialClass Serial2;
+extern ARDUINO_EMULATOR_EXPORT SerialClass Serial3;
+
+// ============================================================================
+//! \class SPISettings
+//! \brief Settings of an SPI transaction (see SPIClass::beginTransaction)
+// ============================================================================
+class SPISettings
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Default settings: 4 MHz, MSB first, mode 0
+    // ------------------------------------------------------------------------
+    SPISettings() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor
+    //! \param p_clock Maximum SCK frequency of the device in Hz
+    //! \param p_bit_order MSBFIRST or LSBFIRST
+    //! \param p_data_mode SPI_MODE0 to SPI_MODE3
+    // ------------------------------------------------------------------------
+    SPISettings(uint32_t p_clock, uint8_t p_bit_order, uint8_t p_data_mode)
+        : clock(p_clock), bit_order(p_bit_order), data_mode(p_data_mode)
+    {
+    }
+
+    uint32_t clock = 4000000u;     ///< SCK frequency in Hz
+    uint8_t bit_order = MSBFIRST;  ///< Bit order of the words
+    uint8_t data_mode = SPI_MODE0; ///< Clock polarity and phase
+};
+
+// ============================================================================
+//! \class SPIClass
+//! \brief Arduino-compatible SPI communication class
+//!
+//! Provides the standard Arduino SPI interface for SPI bus communication.
+//! This is a global object accessed as 'SPI' in Arduino code. Bytes are
+//! exchanged with the device whose chip-select pin the sketch drives LOW
+//! with digitalWrite(). With the virtual clock, transfers last their
+//! duration at the bus clock. The settings of the transaction are kept by
+//! the bus of the board, so the sketches of several boards do not share
+//! them.
+// ============================================================================
+class SPIClass
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Initialize SPI bus
+    // ------------------------------------------------------------------------
+    void begin() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Disable SPI bus
+    // ------------------------------------------------------------------------
+    void end() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Apply the settings of a device before selecting it
+    //! \param p_settings Clock, bit order and data mode
+    // ------------------------------------------------------------------------
+    void beginTransaction(SPISettings const& p_settings) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief End the transaction started by beginTransaction()
+    // ------------------------------------------------------------------------
+    void endTransaction() const {}
+
+    // ------------------------------------------------------------------------
+    //! \brief Transfer a byte over SPI
+    //! \param p_data Byte to send
+    //! \return Byte received
+    // ------------------------------------------------------------------------
+    uint8_t transfer(uint8_t p_data) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Transfer a 16-bit word over SPI, in the bit order of the
+    //! transaction
+    //! \param p_data Word to send
+    //! \return Word received
+    // ------------------------------------------------------------------------
+    uint16_t transfer16(uint16_t p_data) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Transfer a buffer over SPI in a single transfer
+    //! \param p_buffer [in] Bytes to send, [out] bytes received
+    //! \param p_count Number of bytes
+    // ------------------------------------------------------------------------
+    void transfer(void* p_buffer, size_t p_count) const;
+};
+
+/// Global SPI object (Arduino-compatible)
+extern ARDUINO_EMULATOR_EXPORT SPIClass SPI;
+
+// ============================================================================
+//! \class TwoWire
+//! \brief Arduino-compatible Wire (I2C master) class
+//!
+//! This is a global object accessed as 'Wire' in Arduino code. Bytes written
+//! between beginTransmission() and endTransmission() are buffered and sent
+//! to the device model in a single transaction; requestFrom() receives the
+//! bytes in a single transaction too. With the virtual clock, transactions
+//! last their duration at the bus clock.
+// ============================================================================
+class TwoWire: public Stream
+{
+public:
+
+    using Print::write;
+
+    // ------------------------------------------------------------------------
+    //! \brief Join the I2C bus as master
+    // ------------------------------------------------------------------------
+    void begin();
+
+    // ------------------------------------------------------------------------
+    //! \brief Leave the I2C bus
+    // ------------------------------------------------------------------------
+    void end();
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the SCL frequency
+    //! \param p_hz Frequency in Hz (100000 by default, 400000 in fast mode)
+    // ------------------------------------------------------------------------
+    void setClock(uint32_t p_hz);
+
+    // ------------------------------------------------------------------------
+    //! \brief Start a write transaction to a device
+    //! \param p_address 7-bit address of the device
+    // ------------------------------------------------------------------------
+    void beginTransmission(uint8_t p_address);
+    void beginTransmission(int p_address)
+    {
+        beginTransmission(uint8_t(p_address));
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Send the buffered bytes to the device
+    //! \param p_send_stop Release the bus (always done in the emulator)
+    //! \return 0 on success, 2 if the address is not acknowledged, 3 if the
+    //! data is not acknowledged
+    // ------------------------------------------------------------------------
+    uint8_t endTransmission(bool p_send_stop = true);
+
+    // ------------------------------------------------------------------------
+    //! \brief Read bytes from a device
+    //! \param p_address 7-bit address of the device
+    //! \param p_quantity Number of bytes (at most 32)
+    //! \param p_send_stop Release the bus (always done in the emulator)
+    //! \return Number of bytes received (0 if no device answers)
+    // ------------------------------------------------------------------------
+    uint8_t requestFrom(uint8_t p_address,
+                        uint8_t p_quantity,
+                        bool p_send_stop = true);
+    uint8_t requestFrom(int p_address, int p_quantity, int p_send_stop = 1)
+    {
+        return requestFrom(uint8_t(p_address),
+                           uint8_t(p_quantity),
+                           p_send_stop != 0);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Buffer a byte of the write transaction
+    //! \return 1, or 0 when the 32-byte buffer is full
+    // ------------------------------------------------------------------------
+    size_t write(uint8_t p_byte) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Buffer bytes of the write transaction in one go
+    //! \return Number of bytes fitting in the 32-byte buffer
+    // ------------------------------------------------------------------------
+    size_t write(const uint8_t* p_buffer, size_t p_size) override;
+
+    // Integer literals (i.e. Wire.write(0)) as in the Arduino Wire library
+    size_t write(int p_byte)
+    {
+        return write(uint8_t(p_byte));
+    }
+    size_t write(unsigned int p_byte)
+    {
+        return write(uint8_t(p_byte));
+    }
+    size_t write(long p_byte)
+    {
+        return write(uint8_t(p_byte));
+    }
+    size_t write(unsigned long p_byte)
+    {
+        return write(uint8_t(p_byte));
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of received bytes not yet read
+    // ------------------------------------------------------------------------
+    int available() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a received byte
+    //! \return Byte, or -1 if none available
+    // ------------------------------------------------------------------------
+    int read() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the next received byte without extracting it
+    //! \return Byte, or -1 if none available
+    // ------------------------------------------------------------------------
+    int peek() override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract the received bytes in bulk (no timeout: they are all
+    //! received by requestFrom())
+    // ------------------------------------------------------------------------
+    size_t readBytes(char* p_buffer, size_t p_length) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the maximum time to wait for data on the I2C bus of the
+    //! board
+    //! \param p_timeout Timeout in milliseconds
+    // ------------------------------------------------------------------------
+    void setTimeout(unsigned long p_timeout) override;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the maximum time to wait for data on the I2C bus of the
+    //! board in milliseconds
+    // ------------------------------------------------------------------------
+    unsigned long getTimeout() const override;
+};
+
+/// Global Wire object (Arduino-compatible)
+extern ARDUINO_EMULATOR_EXPORT TwoWire Wire;
+
+// ============================================================================
+//! \class EEPROMClass
+//! \brief Arduino-compatible EEPROM class
+//!
+//! This is a global object accessed as 'EEPROM' in Arduino code (the
+//! EEPROM.h library of the Arduino core). The content is kept across the
+//! emulator runs when stored in a file (--eeprom). get() and put() copy
+//! the bytes of a variable; put(), as update(), only writes the changed
+//! cells. Addresses beyond length() read 0xFF and are not written.
+// ============================================================================
+class EEPROMClass
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Reference to a cell, returned by EEPROM[address]
+    // ------------------------------------------------------------------------
+    class Ref
+    {
+    public:
+
+        explicit Ref(int p_address) : m_address(p_address) {}
+
+        //! \brief Read the cell
+        operator uint8_t() const;
+        //! \brief Write the cell (as EEPROM.write)
+        Ref& operator=(uint8_t p_value);
+
+    private:
+
+        //! \brief Cell address
+        int m_address;
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a cell
+    //! \param p_address Cell address
+    //! \return Cell value
+    // ------------------------------------------------------------------------
+    uint8_t read(int p_address) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a cell, even if it already holds the value
+    //! \param p_address Cell address
+    //! \param p_value Value to write
+    // ------------------------------------------------------------------------
+    void write(int p_address, uint8_t p_value);
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a cell only if its value changes (saves its endurance)
+    //! \param p_address Cell address
+    //! \param p_value Value to write
+    // ------------------------------------------------------------------------
+    void update(int p_address, uint8_t p_value);
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a variable stored from an address
+    //! \param p_address Address of the first byte
+    //! \param p_value Variable receiving the bytes
+    //! \return p_value
+    // ------------------------------------------------------------------------
+    template <typename T>
+    T& get(int p_address, T& p_value) const
+    {
+        readBlock(p_address, &p_value, sizeof(T));
+        return p_value;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Store a variable from an address (only the changed bytes are
+    //! written)
+    //! \param p_address Address of the first byte
+    //! \param p_value Variable to store
+    //! \return p_value
+    // ------------------------------------------------------------------------
+    template <typename T>
+    T const& put(int p_address, T const& p_value)
+    {
+        updateBlock(p_address, &p_value, sizeof(T));
+        return p_value;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Access a cell as an array element
+    // ------------------------------------------------------------------------
+    Ref operator[](int p_address) const
+    {
+        return Ref(p_address);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Size of the EEPROM in bytes
+    // ------------------------------------------------------------------------
+    uint16_t length() const;
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Read bytes from an address (for get())
+    // ------------------------------------------------------------------------
+    void readBlock(int p_address, void* p_buffer, size_t p_size) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Write the changed bytes from an address (for put())
+    // ------------------------------------------------------------------------
+    void updateBlock(int p_address, void const* p_data, size_t p_size);
+};
+
+/// Global EEPROM object (Arduino-compatible)
+extern ARDUINO_EMULATOR_EXPORT EEPROMClass EEPROM;
+
+// ----------------------------------------------------------------------------
+//! \brief Arduino setup function (to be defined by user)
+//!
+//! This function is called once when the program starts.
+//! Define this function in your Arduino sketch.
+// ----------------------------------------------------------------------------
+ARDUINO_EMULATOR_EXPORT void setup();
+
+// ----------------------------------------------------------------------------
+//! \brief Arduino loop function (to be defined by user)
+//!
+//! This function is called repeatedly after setup().
+//! Define this function in your Arduino sketch.
+// ----------------------------------------------------------------------------
+ARDUINO_EMULATOR_EXPORT void loop();
+
+// ============================================================================
+// AVR registers of the timers. Like the Arduino API functions, they access
+// the emulator bound to the calling thread.
+// ============================================================================
+#define TCCR0A (avrTimer0().tccra)
+#define TCCR0B (avrTimer0().tccrb)
+#define TCNT0 (avrTimer0().tcnt)
+#define OCR0A (avrTimer0().ocra)
+#define OCR0B (avrTimer0().ocrb)
+#define TIMSK0 (avrTimer0().timsk)
+#define TIFR0 (avrTimer0().tifr)
+#define TCCR1A (avrTimer1().tccra)
+#define TCCR1B (avrTimer1().tccrb)
+#define TCCR1C (avrTimer1().tccrc)
+#define TCNT1 (avrTimer1().tcnt)
+#define OCR1A (avrTimer1().ocra)
+#define OCR1B (avrTimer1().ocrb)
+#define ICR1 (avrTimer1().icr)
+#define TIMSK1 (avrTimer1().timsk)
+#define TIFR1 (avrTimer1().tifr)
+#define TCCR2A (avrTimer2().tccra)
+#define TCCR2B (avrTimer2().tccrb)
+#define TCNT2 (avrTimer2().tcnt)
+#define OCR2A (avrTimer2().ocra)
+#define OCR2B (avrTimer2().ocrb)
+#define TIMSK2 (avrTimer2().timsk)
+#define TIFR2 (avrTimer2().tifr)
+
+// ----------------------------------------------------------------------------
+//! \brief Define an interrupt service routine, as avr-libc does:
+//! ISR(TIMER1_COMPA_vect) { ... }
+//!
+//! The routine is installed in isr_vectors before main() is called. Extra
+//! attributes (ISR_BLOCK, ISR_NOBLOCK ...) are accepted and ignored.
+// ----------------------------------------------------------------------------
+#define ISR(vector, ...)                                                       \
+    static void vector##_isr();                                                \
+    static IsrRegistration const vector##_registration(vector##_num,          \
+                                                       &vector##_isr);         \
+    static void vector##_isr()
@@ -5,73 +5,46 @@
 //! \author Lecrapouille
 //! \copyright MIT License
 //!
-//! This header-only library provides full Arduino hardware emulation
-//! environment that allows you to test Arduino code on a PC.
+//! Internals of the emulator, for the applications driving it. The Arduino
+//! sketches only need the Arduino API declared in Arduino.hpp and compiled
+//! into the emulator library.
 // ============================================================================
 
 #pragma once
 
+#include "ArduinoEmulator/Arduino.hpp"
+#include "ArduinoEmulator/EEPROMEmulator.hpp"
+#include "ArduinoEmulator/I2CBus.hpp"
+#include "ArduinoEmulator/RingBuffer.hpp"
+#include "ArduinoEmulator/SPIBus.hpp"
+#include "ArduinoEmulator/SPIFlash.hpp"
+#include "ArduinoEmulator/VcdRecorder.hpp"
+
 #include <SFML/Audio.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cctype>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <condition_variable>
+#include <cstring>
 #include <ctime>
+#include <exception>
 #include <functional>
-#include <map>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <random>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-// Arduino definitions
-constexpr int HIGH = 1; ///< Digital HIGH state (1)
-constexpr int LOW = 0;  ///< Digital LOW state (0)
-
-// Pin modes
-constexpr int INPUT = 0;  ///< Pin configured as input
-constexpr int OUTPUT = 1; ///< Pin configured as output
-constexpr int INPUT_PULLUP =
-    2; ///< Pin configured as input with pull-up resistor
-constexpr int INPUT_PULLDOWN =
-    3; ///< Pin configured as input with pull-down resistor
-constexpr int OUTPUT_OPEN_DRAIN =
-    4; ///< Pin configured as output with open-drain configuration
-
-// Interrupt modes
-constexpr int CHANGE = 1;  ///< Interrupt on any change
-constexpr int RISING = 2;  ///< Interrupt on rising edge
-constexpr int FALLING = 3; ///< Interrupt on falling edge
-
-// Analog reference types
-constexpr int DEFAULT = 0;  ///< Default analog reference
-constexpr int INTERNAL = 1; ///< Internal analog reference
-constexpr int EXTERNAL = 2; ///< External analog reference
-
-// Serial print formats
-constexpr int DEC = 10; ///< Decimal format (base 10)
-constexpr int HEX = 16; ///< Hexadecimal format (base 16)
-constexpr int OCT = 8;  ///< Octal format (base 8)
-constexpr int BIN = 2;  ///< Binary format (base 2)
-
-// Type definitions
-using boolean = bool;
-using byte = uint8_t;
-
-// Analog pin definitions (Arduino Uno style)
-// Using constexpr to avoid macro conflicts with JSON nlohmann library
-constexpr int A0 = 14;          ///< Analog pin 0
-constexpr int A1 = 15;          ///< Analog pin 1
-constexpr int A2 = 16;          ///< Analog pin 2
-constexpr int A3 = 17;          ///< Analog pin 3
-constexpr int A4 = 18;          ///< Analog pin 4
-constexpr int A5 = 19;          ///< Analog pin 5
-constexpr int LED_BUILTIN = 13; ///< Built-in LED on Arduino Uno (pin 13)
-
 // ============================================================================
 //! \class Pin
 //! \brief Simulates an Arduino digital/analog pin
@@ -157,106 +130,166 @@ public:
     int analog_value = 0;
     //! \brief True if pinMode() has been called for this pin
     bool configured = false;
-    //! \brief Interrupt callback
-    std::function<void()> interrupt_callback = nullptr;
     //! \brief Interrupt mode (CHANGE, RISING, FALLING)
     int interrupt_mode = 0;
     //! \brief Last value for interrupt detection
     int last_value = LOW;
+    //! \brief Emulator change sequence number of the last modification of
+    //! value, mode, PWM or configured (see ArduinoEmulator::getPinChangeSeq).
+    //! Atomic: the web server reads it while the sketch stamps the pin.
+    std::atomic<uint64_t> change_seq{ 0 };
+};
+
+// ============================================================================
+//! \brief Transmission timing of the SerialEmulator.
+// ============================================================================
+enum class UartTiming
+{
+    //! \brief Written bytes are sent instantly, whatever the baud rate.
+    Instant,
+    //! \brief Bytes leave the TX FIFO at the baud rate. Serial.write() waits
+    //! for room in the FIFO, as the Arduino core does.
+    Blocking,
+    //! \brief Bytes leave the TX FIFO at the baud rate. Serial.write()
+    //! returns the number of bytes fitting in the FIFO.
+    ShortWrite
 };
 
+// ----------------------------------------------------------------------------
+//! \brief Get the UART timing from its command line name.
+//! \param p_name Empty (Instant), "block" (Blocking) or "short" (ShortWrite).
+//! \param p_timing Parsed timing (unchanged on error).
+//! \return false if the name is unknown.
+// ----------------------------------------------------------------------------
+inline bool parseUartTiming(std::string const& p_name, UartTiming& p_timing)
+{
+    if (p_name.empty())
+        p_timing = UartTiming::Instant;
+    else if (p_name == "block")
+        p_timing = UartTiming::Blocking;
+    else if (p_name == "short")
+        p_timing = UartTiming::ShortWrite;
+    else
+        return false;
+    return true;
+}
+
 // ============================================================================
-//! \class SPIEmulator
-//! \brief Simulates the Arduino SPI (Serial Peripheral Interface) bus.
+//! \class SerialEmulator
+//! \brief Simulates the Arduino Serial (UART) communication.
+//!
+//! This class emulates serial communication with separate input (RX) and
+//! output (TX) buffers. Each buffer is a lock-free single-producer/
+//! single-consumer ring: the sketch thread writes TX and reads RX while the
+//! web interface reads TX and writes RX, so the sketch never contends with
+//! the HTTP threads. Supports standard Arduino Serial methods: begin, print,
+//! println, read, available.
 //!
-//! This class emulates SPI communication, storing transferred bytes in a
-//! buffer. Useful for testing SPI-based devices like sensors, displays, and SD
-//! cards.
+//! With a UartTiming other than Instant, the transmission throughput of the
+//! hardware is modeled: written bytes enter a 64-byte TX FIFO which drains
+//! at baud / 10 bytes per second of emulator time (8N1 frames: start bit,
+//! 8 data bits, stop bit). Bytes accepted in the FIFO are given to the web
+//! interface right away.
 // ============================================================================
-class SPIEmulator
+class SerialEmulator
 {
 public:
 
+    //! \brief Default capacity of the input buffer in bytes.
+    static constexpr size_t RX_CAPACITY = 4096;
+    //! \brief Default capacity of the output buffer in bytes.
+    static constexpr size_t TX_CAPACITY = 65536;
+    //! \brief Size of the hardware TX FIFO (SERIAL_TX_BUFFER_SIZE).
+    static constexpr size_t TX_FIFO_SIZE = 64;
+
+    //! \brief Traffic counters of the port.
+    struct Stats
+    {
+        //! \brief Bytes sent by the sketch.
+        uint64_t tx_bytes = 0;
+        //! \brief Bytes received by the sketch.
+        uint64_t rx_bytes = 0;
+        //! \brief Output bytes lost on buffer overflow.
+        uint64_t dropped = 0;
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_clock Emulator time in microseconds, used to drain the TX
+    //! FIFO.
+    // ------------------------------------------------------------------------
+    explicit SerialEmulator(std::function<uint64_t()> const& p_clock)
+        : m_clock(p_clock)
+    {
+    }
+
     // ------------------------------------------------------------------------
-    //! \brief Initialize the SPI bus.
+    //! \brief Initialize the serial communication
+    //! \param p_baud_rate Baud rate (only used by the UartTiming model)
     //!
-    //! Enables the SPI and clears the internal buffer.
+    //! Enables serial communication and clears both input and output buffers.
     // ------------------------------------------------------------------------
-    void begin()
+    void begin(int p_baud_rate)
     {
+        m_baud_rate = (p_baud_rate > 0) ? uint64_t(p_baud_rate) : 9600u;
+        m_tx_end_ns = 0;
         m_enabled = true;
-        m_buffer.clear();
+        m_input_buffer.clear();
+        {
+            // Emptying the ring is a consumer operation: exclude getOutput()
+            std::lock_guard<std::mutex> lock(m_output_mutex);
+            m_output_buffer.clear();
+        }
+        m_output_buffer.open();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Disable the SPI bus.
+    //! \brief Disable the serial communication
+    //!
+    //! Also releases the sketch if it is blocked on a full output buffer.
     // ------------------------------------------------------------------------
     void end()
     {
         m_enabled = false;
+        m_tx_end_ns = 0;
+        m_output_buffer.close();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Transfer a byte over SPI.
-    //! \param p_data Byte to send.
-    //! \return Received byte (in simulation, returns the last byte sent).
-    //!
-    //! Simple simulation: stores the byte in a buffer and returns the last
-    //! byte.
+    //! \brief Select the transmission timing model.
+    //! \param p_timing Instant (default) or baud rate accurate.
     // ------------------------------------------------------------------------
-    uint8_t transfer(uint8_t p_data)
+    void setTiming(UartTiming p_timing)
     {
-        if (!m_enabled)
-            return 0;
-        m_buffer.push_back(p_data);
-        return m_buffer.empty() ? 0 : m_buffer.back();
+        m_timing = p_timing;
+        m_tx_end_ns = 0;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get the SPI transfer buffer.
-    //! \return Vector containing all transferred bytes.
+    //! \brief Set the maximum time the sketch waits for received data
+    //! (Stream::setTimeout).
+    //! \param p_ms Timeout in milliseconds (1 s by default).
     // ------------------------------------------------------------------------
-    std::vector<uint8_t> getBuffer() const
+    void setTimeout(unsigned long p_ms)
     {
-        return m_buffer;
+        m_timeout_ms = p_ms;
     }
 
-private:
-
-    //! \brief Buffer storing transferred bytes
-    std::vector<uint8_t> m_buffer;
-    //! \brief SPI enabled state
-    bool m_enabled = false;
-};
-
-// ============================================================================
-//! \class SerialEmulator
-//! \brief Simulates the Arduino Serial (UART) communication.
-//!
-//! This class emulates serial communication with separate input and output
-//! buffers. Thread-safe implementation using mutexes for concurrent access.
-//! Supports standard Arduino Serial methods: begin, print, println, read,
-//! available.
-// ============================================================================
-class SerialEmulator
-{
-public:
+    // ------------------------------------------------------------------------
+    //! \brief Get the maximum time the sketch waits for received data in
+    //! milliseconds.
+    // ------------------------------------------------------------------------
+    unsigned long timeout() const
+    {
+        return m_timeout_ms;
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Initialize the serial communication
-    //! \param p_baud_rate Baud rate (stored for compatibility, not used in
-    //! simulation)
-    //!
-    //! Enables serial communication and clears both input and output buffers.
+    //! \brief Get the transmission timing model.
     // ------------------------------------------------------------------------
-    void begin(int /*p_baud_rate */)
+    UartTiming getTiming() const
     {
-        m_enabled = true;
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        while (!m_input_buffer.empty())
-            m_input_buffer.pop();
-        while (!m_output_buffer.empty())
-            m_output_buffer.pop();
+        return m_timing;
     }
 
     // ------------------------------------------------------------------------
@@ -267,13 +300,7 @@ public:
     // ------------------------------------------------------------------------
     void print(const char* p_str)
     {
-        if (!m_enabled)
-            return;
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        for (int i = 0; p_str[i] != '\0'; i++)
-        {
-            m_output_buffer.push(p_str[i]);
-        }
+        write(p_str, std::strlen(p_str));
     }
 
     // ------------------------------------------------------------------------
@@ -285,8 +312,7 @@ public:
     void println(const char* p_str)
     {
         print(p_str);
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        m_output_buffer.push('\n');
+        println();
     }
 
     // ------------------------------------------------------------------------
@@ -294,48 +320,117 @@ public:
     // ------------------------------------------------------------------------
     void println()
     {
-        if (!m_enabled)
-            return;
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        m_output_buffer.push('\n');
+        write(uint8_t('\n'));
     }
 
     // ------------------------------------------------------------------------
     //! \brief Write a single byte to serial output
     //! \param p_byte Byte to write
+    //! \return Number of bytes accepted
     //!
     //! Writes the raw byte value (not as ASCII digits like print()).
     // ------------------------------------------------------------------------
-    void write(uint8_t p_byte)
+    size_t write(uint8_t p_byte)
+    {
+        return write(&p_byte, 1u);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write bytes to serial output in a single ring operation
+    //! \param p_data Bytes to write (not null-terminated)
+    //! \param p_size Number of bytes
+    //! \return Number of bytes accepted (the others are dropped and counted,
+    //! see setOverflowPolicy()). With the UART timing, number of bytes
+    //! fitting in the TX FIFO.
+    // ------------------------------------------------------------------------
+    size_t write(const void* p_data, size_t p_size)
     {
         if (!m_enabled)
-            return;
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        m_output_buffer.push(static_cast<char>(p_byte));
+            return 0;
+        if (m_timing == UartTiming::Instant)
+        {
+            size_t written = m_output_buffer.write(p_data, p_size);
+            m_tx_bytes.fetch_add(written, std::memory_order_relaxed);
+            notifyOutput();
+            return written;
+        }
+
+        // Bytes lost by the web interface have still been sent on the line
+        p_size = std::min(p_size, availableForWrite());
+        if (p_size == 0)
+            return 0;
+        m_tx_end_ns.store(std::max(m_tx_end_ns.load(), nowNs()) +
+                          p_size * byteNs());
+        m_output_buffer.write(p_data, p_size);
+        m_tx_bytes.fetch_add(p_size, std::memory_order_relaxed);
+        notifyOutput();
+        return p_size;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes which can be written without waiting
+    //! \return Free room of the TX FIFO, or of the output buffer when the
+    //! timing is Instant.
+    // ------------------------------------------------------------------------
+    size_t availableForWrite() const
+    {
+        if (m_timing == UartTiming::Instant)
+            return m_output_buffer.space();
+        return TX_FIFO_SIZE - txLevel(nowNs());
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Time until the TX FIFO has room for some bytes
+    //! \param p_room Number of free bytes wanted (TX_FIFO_SIZE to wait for
+    //! the end of the transmission).
+    //! \return Microseconds of emulator time to wait (0 if the room is
+    //! already there or if the timing is Instant).
+    // ------------------------------------------------------------------------
+    uint64_t txWaitTime(size_t p_room) const
+    {
+        if ((m_timing == UartTiming::Instant) || !m_enabled)
+            return 0;
+
+        // The FIFO has p_room free bytes once its last TX_FIFO_SIZE - p_room
+        // bytes remain to be sent.
+        uint64_t now = nowNs();
+        uint64_t left = (TX_FIFO_SIZE - std::min(p_room, TX_FIFO_SIZE)) *
+                        byteNs();
+        uint64_t tx_end = m_tx_end_ns.load();
+        if (tx_end <= now + left)
+            return 0;
+        return (tx_end - now - left + 999u) / 1000u;
     }
 
     // ------------------------------------------------------------------------
     //! \brief Check if data is available to read
     //! \return Number of bytes available in the input buffer
     // ------------------------------------------------------------------------
-    int available()
+    int available() const
     {
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
         return int(m_input_buffer.size());
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Read a byte from the input buffer
-    //! \return The byte read, or -1 if buffer is empty
+    //! \brief Extract bytes from the input buffer
+    //! \param p_data Destination buffer
+    //! \param p_size Maximum number of bytes to extract
+    //! \return Number of bytes extracted (0 if the buffer is empty)
     // ------------------------------------------------------------------------
-    char read()
+    size_t read(void* p_data, size_t p_size)
     {
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        if (m_input_buffer.empty())
-            return -1;
-        char c = m_input_buffer.front();
-        m_input_buffer.pop();
-        return c;
+        return m_input_buffer.read(p_data, p_size);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Copy bytes of the input buffer without extracting them
+    //! \param p_data Destination buffer
+    //! \param p_size Maximum number of bytes to copy
+    //! \return Number of bytes copied (0 if the buffer is empty)
+    // ------------------------------------------------------------------------
+    size_t peek(void* p_data, size_t p_size) const
+    {
+        return m_input_buffer.peek(p_data, p_size);
     }
 
     // ------------------------------------------------------------------------
@@ -343,15 +438,15 @@ public:
     //! \param p_input String to add to the input buffer
     //!
     //! This method is used by the web interface to simulate incoming serial
-    //! data.
+    //! data. Concurrent HTTP requests are serialized so that the ring only
+    //! sees a single producer.
     // ------------------------------------------------------------------------
     void addInput(const std::string& p_input)
     {
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        for (char c : p_input)
-        {
-            m_input_buffer.push(c);
-        }
+        std::lock_guard<std::mutex> lock(m_input_mutex);
+        m_rx_bytes.fetch_add(
+            m_input_buffer.write(p_input.data(), p_input.size()),
+            std::memory_order_relaxed);
     }
 
     // ------------------------------------------------------------------------
@@ -359,20 +454,101 @@ public:
     //! \return String containing all output data
     //!
     //! This method is used by the web interface to retrieve serial output.
-    //! The output buffer is cleared after reading.
+    //! The whole pending output is drained in a single slice. Concurrent HTTP
+    //! requests are serialized so that the ring only sees a single consumer.
     // ------------------------------------------------------------------------
     std::string getOutput()
     {
-        std::lock_guard<std::mutex> lock(m_buffer_mutex);
-        std::string result;
-        while (!m_output_buffer.empty())
-        {
-            result += m_output_buffer.front();
-            m_output_buffer.pop();
-        }
+        std::lock_guard<std::mutex> lock(m_output_mutex);
+        std::string result(m_output_buffer.size(), '\0');
+        result.resize(m_output_buffer.read(result.data(), result.size()));
         return result;
     }
 
+    // ------------------------------------------------------------------------
+    //! \brief Give the pending output to a sink without copying it
+    //! \param p_sink Called as size_t(uint8_t const* data, size_t size) on
+    //! contiguous slices of the output buffer, returns the number of bytes
+    //! it has consumed (see RingBuffer::drain()).
+    //! \return Number of bytes consumed.
+    //!
+    //! Used by host bridges (e.g. a pseudo-terminal) instead of getOutput().
+    // ------------------------------------------------------------------------
+    template <typename Sink>
+    size_t drainOutput(Sink&& p_sink)
+    {
+        std::lock_guard<std::mutex> lock(m_output_mutex);
+        return m_output_buffer.drain(std::forward<Sink>(p_sink));
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Let a source write input data straight into the input buffer
+    //! \param p_source Called as size_t(uint8_t* data, size_t size) on
+    //! contiguous free slices of the input buffer, returns the number of
+    //! bytes it has stored (see RingBuffer::fill()).
+    //! \return Number of bytes received.
+    //!
+    //! Used by host bridges (e.g. a pseudo-terminal) instead of addInput().
+    // ------------------------------------------------------------------------
+    template <typename Source>
+    size_t fillInput(Source&& p_source)
+    {
+        std::lock_guard<std::mutex> lock(m_input_mutex);
+        size_t count = m_input_buffer.fill(std::forward<Source>(p_source));
+        m_rx_bytes.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of output bytes waiting to be read.
+    // ------------------------------------------------------------------------
+    size_t pendingOutput() const
+    {
+        return m_output_buffer.size();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Select what happens when the output buffer is full. Only
+    //! available from C++ (no command line option): blocking needs a reader
+    //! (web client, PTY bridge or getOutput() from another thread), else the
+    //! sketch sleeps until end() or the watchdog.
+    //! \param p_policy Drop (and count) the extra bytes (default), or make
+    //! the sketch sleep until the buffer is drained.
+    // ------------------------------------------------------------------------
+    void setOverflowPolicy(OverflowPolicy p_policy)
+    {
+        m_output_buffer.setOverflowPolicy(p_policy);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the number of output bytes lost on buffer overflow.
+    // ------------------------------------------------------------------------
+    uint64_t getDroppedBytes() const
+    {
+        return m_output_buffer.dropped();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the traffic counters since the emulator start.
+    // ------------------------------------------------------------------------
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.tx_bytes = m_tx_bytes.load(std::memory_order_relaxed);
+        stats.rx_bytes = m_rx_bytes.load(std::memory_order_relaxed);
+        stats.dropped = m_output_buffer.dropped();
+        return stats;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the function called each time new output data is written.
+    //! \param p_callback Called from the sketch thread, must be fast.
+    // ------------------------------------------------------------------------
+    void setOutputCallback(std::function<void()> const& p_callback)
+    {
+        m_output_callback = p_callback;
+    }
+
     // ------------------------------------------------------------------------
     //! \brief Check if Serial is ready
     //! \return Always true in the emulator (Serial is always ready)
@@ -387,10 +563,72 @@ public:
 
 private:
 
-    std::queue<char> m_input_buffer;  ///< Buffer for incoming serial data
-    std::queue<char> m_output_buffer; ///< Buffer for outgoing serial data
-    std::mutex m_buffer_mutex;        ///< Mutex for thread-safe buffer access
-    bool m_enabled = false;           ///< Serial enabled state
+    // ------------------------------------------------------------------------
+    //! \brief Notify the observer that output data is pending.
+    // ------------------------------------------------------------------------
+    void notifyOutput() const
+    {
+        if (m_output_callback)
+            m_output_callback();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Emulator time in nanoseconds.
+    // ------------------------------------------------------------------------
+    uint64_t nowNs() const
+    {
+        return m_clock() * 1000u;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Duration of a 10-bit frame in nanoseconds.
+    // ------------------------------------------------------------------------
+    uint64_t byteNs() const
+    {
+        return 10000000000u / m_baud_rate;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes of the TX FIFO not yet fully sent.
+    //! \param p_now_ns Emulator time in nanoseconds.
+    // ------------------------------------------------------------------------
+    size_t txLevel(uint64_t p_now_ns) const
+    {
+        uint64_t tx_end = m_tx_end_ns.load();
+        if (tx_end <= p_now_ns)
+            return 0;
+        uint64_t byte_ns = byteNs();
+        return size_t((tx_end - p_now_ns + byte_ns - 1u) / byte_ns);
+    }
+
+private:
+
+    RingBuffer m_input_buffer{ RX_CAPACITY };  ///< Incoming serial data
+    RingBuffer m_output_buffer{ TX_CAPACITY }; ///< Outgoing serial data
+    std::mutex m_input_mutex;  ///< Serializes web producers of input data
+    std::mutex m_output_mutex; ///< Serializes web consumers of output data
+    std::atomic<bool> m_enabled{ false }; ///< Serial enabled state
+    std::function<void()> m_output_callback; ///< New output observer
+    std::function<uint64_t()> m_clock; ///< Emulator time in microseconds
+    UartTiming m_timing = UartTiming::Instant; ///< Transmission model
+    uint64_t m_baud_rate = 9600; ///< Baud rate given to begin()
+    unsigned long m_timeout_ms = 1000; ///< Timeout of the stream reads
+    std::atomic<uint64_t> m_tx_end_ns{ 0 }; ///< Time the TX FIFO is empty
+    std::atomic<uint64_t> m_tx_bytes{ 0 }; ///< Bytes sent by the sketch
+    std::atomic<uint64_t> m_rx_bytes{ 0 }; ///< Bytes received by the sketch
+};
+
+// ============================================================================
+//! \brief Time base used by the TimerEmulator.
+// ============================================================================
+enum class ClockMode
+{
+    //! \brief millis()/micros() follow the host wall clock, delay() sleeps.
+    RealTime,
+    //! \brief Simulated time only advances through delay() and the loop
+    //! scheduler. The host sleeps the simulated duration divided by the speed
+    //! factor (or not at all in max speed).
+    Virtual
 };
 
 // ============================================================================
@@ -400,11 +638,53 @@ private:
 //! This class provides time tracking and callback scheduling functionality,
 //! emulating Arduino's millis(), micros(), and delay() functions.
 //! Also supports periodic callbacks similar to timer interrupts.
+//!
+//! Two time bases are available (see ClockMode): the real time of the host,
+//! or a virtual clock allowing to fast-forward hours of firmware time in
+//! seconds.
+//!
+//! Callbacks are kept in a min-heap ordered by due time (microsecond
+//! resolution). With the real time clock, they are fired by a dispatcher
+//! thread sleeping until the next due time (see waitCallbacks()). With the
+//! virtual clock, advance() stops the simulated time at each due time and
+//! fires the callback from the thread advancing the time, so callbacks happen
+//! at exact and reproducible simulated times.
 // ============================================================================
 class TimerEmulator
 {
 public:
 
+    //! \brief Identifier of a registered callback.
+    using TimerId = uint64_t;
+
+    // ------------------------------------------------------------------------
+    //! \brief Select the time base.
+    //! \param p_mode Real time or virtual clock.
+    //! \param p_speed Speed factor of the virtual clock (1 = real time pace,
+    //! 10 = ten times faster, 0 = as fast as possible). Ignored in real time.
+    // ------------------------------------------------------------------------
+    void setClockMode(ClockMode p_mode, double p_speed = 1.0)
+    {
+        m_clock_mode = p_mode;
+        m_speed = (p_speed < 0.0) ? 0.0 : p_speed;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the current time base.
+    // ------------------------------------------------------------------------
+    ClockMode clockMode() const
+    {
+        return m_clock_mode;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the speed factor of the virtual clock (0 = max speed).
+    // ------------------------------------------------------------------------
+    double speed() const
+    {
+        return m_speed;
+    }
+
     // ------------------------------------------------------------------------
     //! \brief Start the timer
     //!
@@ -412,8 +692,19 @@ public:
     // ------------------------------------------------------------------------
     void start()
     {
+        std::scoped_lock lock(m_mutex);
+
         m_start_time = std::chrono::steady_clock::now();
+        m_virtual_us = 0;
         m_running = true;
+
+        // The time restarts from 0: reschedule the callbacks from now
+        m_deadlines = Deadlines();
+        for (auto const& it : m_timers)
+        {
+            m_deadlines.push(Deadline{ it.second.delay_us, it.first });
+        }
+        wakeUpLocked();
     }
 
     // ------------------------------------------------------------------------
@@ -422,6 +713,7 @@ public:
     void stop()
     {
         m_running = false;
+        wakeUp();
     }
 
     // ------------------------------------------------------------------------
@@ -432,12 +724,7 @@ public:
     // ------------------------------------------------------------------------
     long millis() const
     {
-        if (!m_running)
-            return 0;
-        auto now = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - m_start_time);
-        return duration.count();
+        return static_cast<long>(elapsedMicros() / 1000u);
     }
 
     // ------------------------------------------------------------------------
@@ -448,12 +735,7 @@ public:
     // ------------------------------------------------------------------------
     long micros() const
     {
-        if (!m_running)
-            return 0;
-        auto now = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-            now - m_start_time);
-        return duration.count();
+        return static_cast<long>(elapsedMicros());
     }
 
     // ------------------------------------------------------------------------
@@ -462,1499 +744,2491 @@ public:
     //!
     //! Emulates Arduino's delay() function.
     // ------------------------------------------------------------------------
-    void delay(long p_ms) const
+    void delay(long p_ms)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(p_ms));
+        delayMicroseconds(p_ms * 1000);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Add a periodic callback
-    //! \param p_callback Function to call periodically
-    //! \param p_interval_ms Interval in milliseconds
+    //! \brief Delay execution for specified microseconds
+    //! \param p_us Microseconds to delay
     //!
-    //! Registers a callback function to be called at regular intervals.
-    //! Similar to timer interrupts on real Arduino.
+    //! Emulates Arduino's delayMicroseconds() function. With the virtual
+    //! clock, the simulated time is advanced right away.
     // ------------------------------------------------------------------------
-    void addCallback(std::function<void()> const& p_callback, int p_interval_ms)
+    void delayMicroseconds(long p_us)
     {
-        m_callbacks.push_back(p_callback);
-        m_intervals.push_back(p_interval_ms);
-        m_last_trigger.push_back(std::chrono::steady_clock::now());
+        if (p_us <= 0)
+            return;
+
+        if (m_clock_mode == ClockMode::Virtual)
+        {
+            advance(static_cast<uint64_t>(p_us));
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(p_us));
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Update and trigger callbacks
+    //! \brief Advance the virtual clock.
+    //! \param p_us Simulated microseconds to add.
+    //! \param p_pace If true, the calling thread sleeps the simulated duration
+    //! scaled by the speed factor, so 1x keeps the pace of real time while max
+    //! speed does not sleep at all. Pass false when the duration has already
+    //! been spent on the host (i.e. measured execution time).
     //!
-    //! Checks all registered callbacks and executes those whose interval has
-    //! elapsed. Should be called regularly from the simulation loop.
+    //! Does nothing with the real time clock.
     // ------------------------------------------------------------------------
-    void updateCallbacks()
+    void advance(uint64_t p_us, bool p_pace = true)
     {
-        if (!m_running)
+        if (m_clock_mode != ClockMode::Virtual)
             return;
-        auto now = std::chrono::steady_clock::now();
 
-        for (size_t i = 0; i < m_callbacks.size(); i++)
+        // Stop at each callback due before the end of the advance
+        const uint64_t target = m_virtual_us.load() + p_us;
+        std::function<void()> callback;
+        uint64_t due;
+        while (popDueCallback(target, false, due, callback))
         {
-            auto elapsed =
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                    now - m_last_trigger[i]);
-            if (elapsed.count() >= m_intervals[i])
+            // A callback calling delay() may have moved the time further
+            if (due > m_virtual_us.load())
             {
-                m_callbacks[i]();
-                m_last_trigger[i] = now;
+                step(due - m_virtual_us.load(), p_pace);
+            }
+            callback();
+            if (m_safe_point)
+            {
+                m_safe_point();
             }
         }
-    }
-
-private:
-
-    std::chrono::steady_clock::time_point m_start_time; ///< Timer start time
-    bool m_running = false;                             ///< Timer running state
-    std::vector<std::function<void()>>
-        m_callbacks;              ///< Registered callback functions
-    std::vector<int> m_intervals; ///< Callback intervals in milliseconds
-    std::vector<std::chrono::steady_clock::time_point>
-        m_last_trigger; ///< Last trigger time for each callback
-};
 
-// ============================================================================
-//! \class ToneGenerator
-//! \brief Generates audio tones using SFML
-//!
-//! This class uses SFML's audio module to generate real audio tones at
-//! specified frequencies. The tone generation uses a square wave, similar
-//! to Arduino's tone() function.
-// ============================================================================
-class ToneGenerator: public sf::SoundStream
-{
-public:
+        if (target > m_virtual_us.load())
+        {
+            step(target - m_virtual_us.load(), p_pace);
+        }
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Constructor
+    //! \brief Set the function called by advance() after each callback, so
+    //! that the interrupts raised by a callback are serviced at the simulated
+    //! time of the callback.
     // ------------------------------------------------------------------------
-    ToneGenerator()
+    void setSafePoint(std::function<void()> const& p_safe_point)
     {
-        initialize(1, 44100); // Mono, 44.1kHz
+        m_safe_point = p_safe_point;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Destructor
+    //! \brief Add a periodic callback
+    //! \param p_callback Function to call periodically
+    //! \param p_interval_ms Interval in milliseconds
+    //! \return Identifier to give to cancel().
+    //!
+    //! Registers a callback function to be called at regular intervals.
+    //! Similar to timer interrupts on real Arduino.
     // ------------------------------------------------------------------------
-    ~ToneGenerator()
+    TimerId addCallback(std::function<void()> const& p_callback,
+                        int p_interval_ms)
     {
-        stop();
+        uint64_t period_us = static_cast<uint64_t>(p_interval_ms) * 1000u;
+        return schedule(p_callback, period_us, period_us);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Start playing a tone at the specified frequency
-    //! \param p_frequency Frequency in Hz
-    //! \param p_pin Pin number playing the tone
+    //! \brief Register a callback with a microsecond resolution.
+    //! \param p_callback Function to call.
+    //! \param p_delay_us Time before the first call.
+    //! \param p_period_us Time between two calls (0 for a single call).
+    //! \return Identifier to give to cancel().
     // ------------------------------------------------------------------------
-    void playTone(int p_frequency, int p_pin = -1)
+    TimerId schedule(std::function<void()> const& p_callback,
+                     uint64_t p_delay_us,
+                     uint64_t p_period_us = 0)
     {
-        if (p_frequency <= 0)
-            return;
+        std::scoped_lock lock(m_mutex);
 
-        m_frequency.store(p_frequency);
-        m_current_pin.store(p_pin);
-        m_phase = 0;
-        m_is_playing = true;
-        play();
+        TimerId id = m_next_id++;
+        m_timers[id] = Timer{ p_callback, p_delay_us, p_period_us };
+        m_deadlines.push(Deadline{ elapsedMicros() + p_delay_us, id });
+        wakeUpLocked();
+        return id;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Start playing a tone for a specific duration
-    //! \param p_frequency Frequency in Hz
-    //! \param p_duration Duration in milliseconds
-    //! \param p_pin Pin number playing the tone
+    //! \brief Register a callback called once at the given time.
+    //! \param p_callback Function to call.
+    //! \param p_due_us Time of the call in microseconds since start().
+    //! \return Identifier to give to cancel().
     // ------------------------------------------------------------------------
-    void playTone(int p_frequency, long p_duration, int p_pin = -1)
+    TimerId scheduleAt(std::function<void()> const& p_callback,
+                       uint64_t p_due_us)
     {
-        playTone(p_frequency, p_pin);
-        std::this_thread::sleep_for(std::chrono::milliseconds(p_duration));
-        stopTone();
+        std::scoped_lock lock(m_mutex);
+
+        TimerId id = m_next_id++;
+        m_timers[id] = Timer{ p_callback, p_due_us, 0u };
+        m_deadlines.push(Deadline{ p_due_us, id });
+        wakeUpLocked();
+        return id;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Stop playing the current tone
+    //! \brief Unregister a callback.
+    //! \param p_id Identifier returned by schedule() or addCallback().
+    //! \return false if the callback was unknown or already finished.
     // ------------------------------------------------------------------------
-    void stopTone()
+    bool cancel(TimerId p_id)
     {
-        stop();
-        m_frequency.store(0);
-        m_current_pin.store(-1);
-        m_phase = 0;
-        m_is_playing = false;
+        std::scoped_lock lock(m_mutex);
+
+        // The deadline stays in the heap and is skipped when due
+        return m_timers.erase(p_id) > 0u;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get current frequency
-    //! \return Current tone frequency in Hz
+    //! \brief Unregister all the callbacks.
     // ------------------------------------------------------------------------
-    int getFrequency() const
+    void clearCallbacks()
     {
-        return m_frequency.load();
+        std::scoped_lock lock(m_mutex);
+        m_timers.clear();
+        m_deadlines = Deadlines();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get current pin playing tone
-    //! \return Pin number or -1 if none
+    //! \brief Fire the callbacks due with the real time clock.
+    //!
+    //! Callbacks are fired from the calling thread (the dispatcher thread).
+    //! With the virtual clock, callbacks are fired by advance() instead.
     // ------------------------------------------------------------------------
-    int getCurrentPin() const
+    void updateCallbacks()
     {
-        return m_current_pin.load();
+        if (!m_running || (m_clock_mode == ClockMode::Virtual))
+            return;
+
+        std::function<void()> callback;
+        uint64_t due;
+        while (popDueCallback(elapsedMicros(), true, due, callback))
+        {
+            callback();
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Check if a tone is currently playing
-    //! \return true if playing, false otherwise
+    //! \brief Sleep until the next callback is due with the real time clock,
+    //! or until a callback is added or wakeUp() is called.
     // ------------------------------------------------------------------------
-    bool isPlaying() const
+    void waitCallbacks()
     {
-        return m_is_playing.load();
-    }
+        std::unique_lock lock(m_mutex);
 
-private:
+        if (m_running && (m_clock_mode == ClockMode::RealTime) &&
+            !m_deadlines.empty())
+        {
+            auto deadline = m_start_time + std::chrono::microseconds(
+                                               m_deadlines.top().due_us);
+            m_cond.wait_until(lock, deadline, [this]() { return m_wakeup; });
+        }
+        else
+        {
+            m_cond.wait(lock, [this]() { return m_wakeup; });
+        }
+        m_wakeup = false;
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Get the next chunk of audio data (SFML callback)
-    //! \param p_data Pointer to audio sample buffer
-    //! \param p_sample_count Number of samples to generate
-    //! \return true to continue playing, false to stop
+    //! \brief Interrupt waitCallbacks().
     // ------------------------------------------------------------------------
-    bool onGetData(Chunk& p_data) override
+    void wakeUp()
     {
-        const unsigned int sample_count = 4410; // 0.1 second buffer
-        static std::vector<sf::Int16> samples(sample_count);
+        std::scoped_lock lock(m_mutex);
+        wakeUpLocked();
+    }
 
-        int freq = m_frequency.load();
-        if (freq <= 0)
+private:
+
+    //! \brief Registered callback.
+    struct Timer
+    {
+        //! \brief Function to call.
+        std::function<void()> callback;
+        //! \brief Time before the first call in microseconds.
+        uint64_t delay_us;
+        //! \brief Time between two calls in microseconds (0 = single call).
+        uint64_t period_us;
+    };
+
+    //! \brief Next call of a callback.
+    struct Deadline
+    {
+        //! \brief Due time in microseconds since start().
+        uint64_t due_us;
+        //! \brief Callback to call.
+        TimerId id;
+
+        bool operator>(Deadline const& p_other) const
         {
-            // Silence
-            std::fill(samples.begin(), samples.end(), 0);
+            return due_us > p_other.due_us;
         }
-        else
-        {
-            // Generate square wave
-            const double sample_rate = 44100.0;
-            const double amplitude = 8000.0;
-            const double two_pi = 2.0 * 3.14159265358979323846;
+    };
 
-            for (unsigned int i = 0; i < sample_count; ++i)
-            {
-                double time = static_cast<double>(m_phase) / sample_rate;
-                double sine_value = std::sin(two_pi * freq * time);
+    //! \brief Min-heap of the deadlines.
+    using Deadlines =
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>>;
 
-                // Square wave: sign of sine wave
-                samples[i] = static_cast<sf::Int16>((sine_value > 0 ? 1 : -1) *
-                                                    amplitude);
+    // ------------------------------------------------------------------------
+    //! \brief Extract the earliest callback due before the given time and
+    //! schedule its next call.
+    //! \param p_now Time in microseconds.
+    //! \param p_skip_missed Do not fire the periods already elapsed (the host
+    //! was late) but resume from p_now.
+    //! \param p_due [out] Due time of the callback.
+    //! \param p_callback [out] Callback to call (outside the lock, so it can
+    //! schedule or cancel callbacks).
+    //! \return false if no callback is due.
+    // ------------------------------------------------------------------------
+    bool popDueCallback(uint64_t p_now,
+                        bool p_skip_missed,
+                        uint64_t& p_due,
+                        std::function<void()>& p_callback)
+    {
+        std::scoped_lock lock(m_mutex);
 
-                m_phase++;
-                if (m_phase >= static_cast<unsigned long>(sample_rate))
-                    m_phase -= static_cast<unsigned long>(sample_rate);
+        while (!m_deadlines.empty() && (m_deadlines.top().due_us <= p_now))
+        {
+            Deadline deadline = m_deadlines.top();
+            m_deadlines.pop();
+
+            auto it = m_timers.find(deadline.id);
+            if (it == m_timers.end())
+                continue; // Cancelled
+
+            p_due = deadline.due_us;
+            p_callback = it->second.callback;
+            if (it->second.period_us == 0u)
+            {
+                m_timers.erase(it);
+            }
+            else
+            {
+                uint64_t next = deadline.due_us + it->second.period_us;
+                if (p_skip_missed && (next <= p_now))
+                {
+                    next = p_now + it->second.period_us;
+                }
+                m_deadlines.push(Deadline{ next, deadline.id });
             }
+            return true;
         }
+        return false;
+    }
 
-        p_data.samples = samples.data();
-        p_data.sampleCount = sample_count;
-        return true; // Continue playing
+    // ------------------------------------------------------------------------
+    //! \brief Move the virtual clock forward, sleeping according to the speed
+    //! factor.
+    // ------------------------------------------------------------------------
+    void step(uint64_t p_us, bool p_pace)
+    {
+        m_virtual_us += p_us;
+        if (p_pace && (m_speed > 0.0))
+        {
+            std::this_thread::sleep_for(
+                std::chrono::duration<double, std::micro>(
+                    static_cast<double>(p_us) / m_speed));
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Seek to a position in the stream (SFML callback)
-    //! \param p_time_offset Time offset to seek to
+    //! \brief Wake up the dispatcher thread (mutex held).
     // ------------------------------------------------------------------------
-    void onSeek(sf::Time p_time_offset) override
+    void wakeUpLocked()
     {
-        m_phase = static_cast<unsigned long>(
-            static_cast<double>(p_time_offset.asSeconds()) * 44100.0);
+        m_wakeup = true;
+        m_cond.notify_all();
     }
 
 private:
 
-    //! \brief Current tone frequency in Hz
-    std::atomic<int> m_frequency{ 0 };
-    //! \brief Current pin playing tone
-    std::atomic<int> m_current_pin{ -1 };
-    //! \brief Current tone playing state
-    std::atomic<bool> m_is_playing{ false };
-    //! \brief Current phase in the waveform
-    unsigned long m_phase{ 0 };
+    // ------------------------------------------------------------------------
+    //! \brief Microseconds elapsed since start() in the current time base.
+    // ------------------------------------------------------------------------
+    uint64_t elapsedMicros() const
+    {
+        if (!m_running)
+            return 0;
+
+        if (m_clock_mode == ClockMode::Virtual)
+            return m_virtual_us.load();
+
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_start_time);
+        return static_cast<uint64_t>(duration.count());
+    }
+
+private:
+
+    std::chrono::steady_clock::time_point m_start_time; ///< Timer start time
+    std::atomic<bool> m_running{ false };               ///< Timer running state
+    ClockMode m_clock_mode = ClockMode::RealTime;       ///< Time base
+    double m_speed = 1.0; ///< Virtual clock speed factor (0 = max speed)
+    std::atomic<uint64_t> m_virtual_us{ 0 }; ///< Virtual time in microseconds
+    std::mutex m_mutex;       ///< Protects the callbacks and the wake-up flag
+    std::condition_variable m_cond; ///< Wakes up the dispatcher thread
+    bool m_wakeup = false;    ///< Dispatcher thread shall re-evaluate its sleep
+    std::unordered_map<TimerId, Timer> m_timers; ///< Registered callbacks
+    Deadlines m_deadlines;    ///< Next call of each callback
+    TimerId m_next_id = 1;    ///< Identifier of the next callback
+    std::function<void()> m_safe_point; ///< Called after virtual callbacks
+};
+
+// ============================================================================
+//! \brief Thrown at a cancellation point of the sketch thread to unwind
+//! setup() or loop() when the sketch is cancelled. Not derived from
+//! std::exception so that sketches catching std::exception do not swallow
+//! it.
+//!
+//! Only the functions a sketch polls or waits with (delays, time, input
+//! reads) are cancellation points. The ones writing outputs are not: they
+//! are commonly called from destructors and noexcept functions, where an
+//! exception would terminate the process.
+// ============================================================================
+struct ARDUINO_EMULATOR_EXPORT SketchCancelled
+{
+};
+
+//! \brief Cancellation state of a sketch thread.
+enum class SketchState : int
+{
+    //! \brief Executing setup() or loop().
+    Running,
+    //! \brief Shall unwind at its next cancellation point.
+    Cancelled,
+    //! \brief Not unwound in time: detached and replaced by a new sketch
+    //! thread, it parks at its next Arduino API call.
+    Abandoned,
+    //! \brief Abandoned and sleeping forever.
+    Parked
 };
 
-/// Global tone generator instance
-inline ToneGenerator tone_generator;
+//! \brief State of the sketch executed by the calling thread, set by
+//! InterruptController::bindThread() (nullptr on the other threads).
+ARDUINO_EMULATOR_EXPORT inline thread_local std::atomic<SketchState>*
+    sketch_state = nullptr;
 
 // ============================================================================
-//! \class ArduinoEmulator
-//! \brief Main Arduino hardware emulator class
+//! \brief Park the calling thread forever if it runs an abandoned sketch: a
+//! thread cannot be killed, but once parked it no longer uses the CPU nor
+//! touches the board, and never returns to the code which ran the sketch.
+//! Called by every Arduino API function, including the ones writing outputs
+//! (sleeping is safe where an exception is not).
+// ============================================================================
+inline void parkIfAbandoned()
+{
+    std::atomic<SketchState>* state = sketch_state;
+    if ((state == nullptr) ||
+        (state->load(std::memory_order_relaxed) < SketchState::Abandoned))
+        return;
+
+    state->store(SketchState::Parked);
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+}
+
+// ============================================================================
+//! \class InterruptController
+//! \brief Pending interrupts of a board, serviced on the sketch thread.
 //!
-//! This is the core class that brings together all emulation components:
-//! - Digital and analog pins
-//! - Serial (UART) communication
-//! - SPI bus
-//! - Timer and timing functions
+//! As the interrupt flags of the AVR, raising an interrupt only marks its
+//! line as pending, so any thread (timer dispatcher, web server) can raise
+//! one without locking. The ISRs are executed later by the sketch thread at
+//! safe points (Arduino API calls, delays and between two loop() calls):
+//! they never run concurrently with loop(), but a long computation without
+//! API call delays them. Pending lines are serviced by priority, the lowest
+//! line first as in the AVR vector table. An interrupt raised while its line
+//! is already pending is merged with it.
 //!
-//! The emulator runs in a separate thread and provides a complete
-//! Arduino-compatible interface for testing sketches without physical
-//! hardware.
+//! Lines 0 to AVR_VECTOR_COUNT - 1 are the AVR vectors (ISR() handlers). The
+//! next lines are free for attachInterrupt().
 //!
-//! \note This emulator simulates an Arduino Uno with 20 pins (0-19)
-//! \note PWM is available on pins 3, 5, 6, 9, 10, 11
+//! After cancel(), the next cancellation point of the sketch thread (see
+//! checkCancelled()) throws SketchCancelled. The cancellation state belongs
+//! to the thread (see SketchState): a thread abandoned by abandon() keeps it
+//! when reset() gives a fresh one to the next sketch thread.
 // ============================================================================
-class ArduinoEmulator
+class InterruptController
 {
 public:
 
+    //! \brief Counters of an interrupt line.
+    struct Stats
+    {
+        //! \brief Interrupts raised.
+        uint64_t raised = 0;
+        //! \brief Interrupts raised while the line was already pending.
+        uint64_t merged = 0;
+        //! \brief ISRs executed.
+        uint64_t serviced = 0;
+        //! \brief Sum of the delays between raise and ISR (emulator time).
+        uint64_t total_latency_us = 0;
+        //! \brief Longest delay between raise and ISR (emulator time).
+        uint64_t max_latency_us = 0;
+    };
+
     // ------------------------------------------------------------------------
-    //! \brief Constructor
-    //!
-    //! Initializes all pins with default configuration.
-    //! Pins are configured as INPUT by default, with specific pins marked as
-    //! PWM-capable.
+    //! \brief Constructor.
+    //! \param p_clock Emulator time in microseconds, to measure latencies.
+    //! \param p_lines Number of interrupt lines.
     // ------------------------------------------------------------------------
-    ArduinoEmulator()
+    explicit InterruptController(std::function<uint64_t()> const& p_clock,
+                                 size_t p_lines = AVR_VECTOR_COUNT)
+        : m_clock(p_clock)
     {
-        initializePins();
+        resize(p_lines);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Destructor
-    //!
-    //! Ensures the simulation thread is properly stopped before destruction.
+    //! \brief Change the number of lines. Handlers and counters are cleared.
+    //! Must not be called while the simulation is running.
     // ------------------------------------------------------------------------
-    ~ArduinoEmulator()
+    void resize(size_t p_lines)
     {
-        stop();
+        m_count = p_lines;
+        m_lines = std::make_unique<Line[]>(p_lines);
+        m_words = (p_lines + 63u) / 64u;
+        m_pending = std::make_unique<std::atomic<uint64_t>[]>(m_words);
+        for (size_t i = 0; i < m_words; ++i)
+        {
+            m_pending[i].store(0u, std::memory_order_relaxed);
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Start the Arduino emulator
-    //!
-    //! Starts the timer and launches the simulation thread.
-    //! The simulation loop runs continuously until stop() is called.
+    //! \brief Number of interrupt lines.
     // ------------------------------------------------------------------------
-    void start()
+    size_t lines() const
     {
-        // If a thread is still running, stop it first to avoid std::terminate()
-        if (simulation_thread.joinable())
+        return m_count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the ISR of a line.
+    //! \param p_line Line number.
+    //! \param p_handler ISR, or nullptr to use the one declared with ISR()
+    //! for an AVR vector (no ISR for the other lines).
+    // ------------------------------------------------------------------------
+    void setHandler(size_t p_line, IsrHandler p_handler)
+    {
+        if (p_line < m_count)
         {
-            running = false;
-            simulation_thread.join();
+            m_lines[p_line].handler.store(p_handler, std::memory_order_release);
         }
-
-        running = true;
-        timer.start();
-        simulation_thread = std::thread(&ArduinoEmulator::simulationLoop, this);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Stop the Arduino emulator
-    //!
-    //! Stops the simulation thread and waits for it to complete.
+    //! \brief Remove the ISRs given to setHandler().
     // ------------------------------------------------------------------------
-    void stop()
+    void clearHandlers()
     {
-        running = false;
-        if (simulation_thread.joinable())
+        for (size_t i = 0; i < m_count; ++i)
         {
-            simulation_thread.join();
+            m_lines[i].handler.store(nullptr, std::memory_order_release);
         }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Reset the Arduino emulator to initial state
-    //!
-    //! Resets all pins, clears serial buffers, resets timer, and stops audio.
-    //! This is equivalent to pressing the reset button on a real Arduino.
+    //! \brief Mark a line as pending (callable from any thread).
+    //! \param p_line Line number.
+    //! \return false if the line does not exist or was already pending.
     // ------------------------------------------------------------------------
-    void reset()
+    bool raise(size_t p_line)
     {
-        // Stop the simulation if running
-        stop();
+        if (p_line >= m_count)
+            return false;
 
-        // Reset all pins to default state
-        for (auto& [pin_num, pin] : pins)
+        Line& line = m_lines[p_line];
+        line.raised.fetch_add(1u, std::memory_order_relaxed);
+
+        uint64_t idle = NOT_PENDING;
+        if (!line.raised_at.compare_exchange_strong(idle, m_clock()))
         {
-            pin.value = LOW;
-            pin.mode = INPUT;
-            pin.pwm_value = 0;
-            pin.analog_value = 0;
-            pin.configured = false;
-            pin.interrupt_callback = nullptr;
-            pin.interrupt_mode = 0;
-            pin.last_value = LOW;
+            line.merged.fetch_add(1u, std::memory_order_relaxed);
+            return false;
         }
 
-        // Stop all tones
-        tone_generator.stopTone();
+        // Sequentially consistent with the waiter registration in
+        // waitUntil(): either the waiter sees the line, or we see the waiter.
+        m_pending[p_line / 64u].fetch_or(uint64_t(1) << (p_line % 64u));
+        if (m_waiters.load() != 0u)
+        {
+            {
+                std::scoped_lock lock(m_mutex);
+            }
+            m_cond.notify_all();
+        }
+        return true;
+    }
 
-        // Reset analog reference
-        analog_reference = DEFAULT;
+    // ------------------------------------------------------------------------
+    //! \brief Set the global interrupt flag (sei).
+    // ------------------------------------------------------------------------
+    void enable()
+    {
+        m_enabled.store(true);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Check if the simulation is running
-    //! \return true if simulation is running
+    //! \brief Clear the global interrupt flag (cli).
     // ------------------------------------------------------------------------
-    bool isRunning() const
+    void disable()
     {
-        return running;
+        m_enabled.store(false);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Set the running state
-    //! \param p_running New running state
+    //! \brief Check the global interrupt flag.
     // ------------------------------------------------------------------------
-    void setRunning(bool p_running)
+    bool isEnabled() const
     {
-        running = p_running;
+        return m_enabled.load(std::memory_order_relaxed);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Configure a pin's mode
-    //! \param p_pin Pin number (0-19)
-    //! \param p_mode Pin mode (INPUT, OUTPUT, or INPUT_PULLUP)
-    //!
-    //! Emulates Arduino's pinMode() function.
+    //! \brief Make the calling thread the one executing the ISRs. Without
+    //! binding, the first thread reaching a safe point is used.
     // ------------------------------------------------------------------------
-    void pinMode(int p_pin, int p_mode)
+    void bindThread()
     {
-        if (pins.find(p_pin) != pins.end())
-        {
-            pins[p_pin].mode = p_mode;
-            pins[p_pin].configured = true;
+        // The thread owns its state: once abandoned, it still reads it after
+        // reset() gave another one to the next sketch thread
+        static thread_local std::shared_ptr<std::atomic<SketchState>> owner;
 
-            // INPUT_PULLUP sets the pin to HIGH by default (pull-up resistor)
-            if (p_mode == INPUT_PULLUP)
-            {
-                pins[p_pin].value = HIGH;
-            }
-            // INPUT_PULLDOWN sets the pin to LOW by default (pull-down
-            // resistor)
-            else if (p_mode == INPUT_PULLDOWN)
-            {
-                pins[p_pin].value = LOW;
-            }
-        }
+        std::scoped_lock lock(m_mutex);
+        owner = m_state;
+        sketch_state = owner.get();
+        m_thread.store(std::this_thread::get_id());
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Write a digital value to a pin
-    //! \param p_pin Pin number (0-19)
-    //! \param p_value Value to write (HIGH or LOW)
-    //!
-    //! Emulates Arduino's digitalWrite() function.
+    //! \brief Make the next cancellation point of the sketch thread throw
+    //! SketchCancelled (callable from any thread). Cleared by reset().
     // ------------------------------------------------------------------------
-    void digitalWrite(int p_pin, int p_value)
+    void cancel()
     {
-        if (pins.find(p_pin) != pins.end())
         {
-            pins[p_pin].digitalWrite(p_value);
-            checkInterrupt(p_pin);
+            std::scoped_lock lock(m_mutex);
+            SketchState running = SketchState::Running;
+            m_state->compare_exchange_strong(running, SketchState::Cancelled);
         }
+        m_cond.notify_all();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Read a digital value from a pin
-    //! \param p_pin Pin number (0-19)
-    //! \return Current pin value (HIGH or LOW)
-    //!
-    //! Emulates Arduino's digitalRead() function.
+    //! \brief Give up a cancelled sketch thread which did not unwind (it has
+    //! been detached): it parks at its next Arduino API call. Call reset()
+    //! before running the next sketch.
+    //! \return State of the abandoned thread, to know when it is parked.
     // ------------------------------------------------------------------------
-    int digitalRead(int p_pin)
+    std::shared_ptr<std::atomic<SketchState>> abandon()
     {
-        if (pins.find(p_pin) != pins.end())
-        {
-            return pins[p_pin].digitalRead();
-        }
-        return LOW;
+        std::scoped_lock lock(m_mutex);
+        m_state->store(SketchState::Abandoned);
+        return m_state;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Write an analog (PWM) value to a pin
-    //! \param p_pin Pin number (must be PWM-capable: 3, 5, 6, 9, 10, 11)
-    //! \param p_value PWM value (0-255)
-    //!
-    //! Emulates Arduino's analogWrite() function.
+    //! \brief Check if the sketch executed by the calling thread has been
+    //! cancelled (false outside the sketch threads).
     // ------------------------------------------------------------------------
-    void analogWrite(int p_pin, int p_value)
+    bool isCancelled() const
     {
-        if (pins.find(p_pin) != pins.end())
-        {
-            pins[p_pin].analogWrite(p_value);
-        }
+        std::atomic<SketchState>* state = sketch_state;
+        return (state != nullptr) &&
+               (state->load(std::memory_order_relaxed) != SketchState::Running);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Read an analog value from a pin
-    //! \param p_pin Pin number (0-19)
-    //! \return Analog value (0-1023)
-    //!
-    //! Emulates Arduino's analogRead() function.
+    //! \brief Cancellation point: unwind the sketch if it has been cancelled,
+    //! park it if it has been abandoned. Does nothing outside the sketch
+    //! threads, nor while an exception is unwinding the stack (called from a
+    //! destructor).
+    //! \throw SketchCancelled if the sketch has been cancelled.
     // ------------------------------------------------------------------------
-    int analogRead(int p_pin)
+    void checkCancelled()
     {
-        // On real Arduino, analogRead(0) reads A0, analogRead(1) reads A1, etc.
-        // Convert analog pin numbers 0-5 to their actual pin numbers (14-19)
-        if (p_pin >= 0 && p_pin <= 5)
-        {
-            p_pin += 14; // A0 = 14, A1 = 15, ..., A5 = 19
-        }
-
-        if (pins.find(p_pin) != pins.end())
+        parkIfAbandoned();
+        if (isCancelled() && (std::uncaught_exceptions() == 0))
         {
-            // Analog pins don't require pinMode() - mark as configured on first
-            // analogRead()
-            pins[p_pin].configured = true;
-            return pins[p_pin].analogRead();
+            throw SketchCancelled();
         }
-        return 0;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get access to the SPI emulator
-    //! \return Reference to the SPI emulator instance
+    //! \brief Safe point: execute the pending ISRs by priority if interrupts
+    //! are enabled. Does nothing outside the sketch thread.
     // ------------------------------------------------------------------------
-    SPIEmulator& getSPI()
+    void dispatch()
     {
-        return spi;
-    }
+        if (!isEnabled() || !hasPending() || !onSketchThread())
+            return;
+
+        size_t index;
+        while (isEnabled() && nextPending(index))
+        {
+            Line& line = m_lines[index];
+            m_pending[index / 64u].fetch_and(~(uint64_t(1) << (index % 64u)));
+            uint64_t raised_at = line.raised_at.exchange(NOT_PENDING);
+
+            uint64_t now = m_clock();
+            uint64_t latency = (now > raised_at) ? (now - raised_at) : 0u;
+            line.serviced.fetch_add(1u, std::memory_order_relaxed);
+            line.total_latency_us.fetch_add(latency, std::memory_order_relaxed);
+            if (latency > line.max_latency_us.load(std::memory_order_relaxed))
+            {
+                line.max_latency_us.store(latency, std::memory_order_relaxed);
+            }
+
+            IsrHandler handler = line.handler.load(std::memory_order_acquire);
+            if ((handler == nullptr) && (index < AVR_VECTOR_COUNT))
+            {
+                handler = isr_vectors[index];
+            }
+            if (handler != nullptr)
+            {
+                // As the AVR: interrupts are disabled on ISR entry (unless the
+                // ISR calls sei() to allow nesting) and enabled on return.
+                m_enabled.store(false);
+                handler();
+                m_enabled.store(true);
+            }
+        }
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Get access to the Serial emulator
-    //! \return Reference to the Serial emulator instance
-    // ------------------------------------------------------------------------
-    SerialEmulator& getSerial()
+    //! \brief Sleep until a deadline or until an interrupt can be serviced
+    //! by the sketch thread (or the sketch is cancelled).
+    //! \return true if woken up to call dispatch() before the deadline.
+    // ------------------------------------------------------------------------
+    bool waitUntil(std::chrono::steady_clock::time_point p_deadline)
     {
-        return serial;
+        if (!onSketchThread())
+        {
+            std::this_thread::sleep_until(p_deadline);
+            return false;
+        }
+
+        std::unique_lock lock(m_mutex);
+        m_waiters.fetch_add(1u);
+        bool ready = m_cond.wait_until(
+            lock,
+            p_deadline,
+            [this]()
+            { return isCancelled() || (isEnabled() && hasPending()); });
+        m_waiters.fetch_sub(1u);
+        return ready;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get access to the Timer emulator
-    //! \return Reference to the Timer emulator instance
+    //! \brief Counters of a line.
     // ------------------------------------------------------------------------
-    TimerEmulator& getTimer()
+    Stats stats(size_t p_line) const
     {
-        return timer;
+        Stats stats;
+        if (p_line < m_count)
+        {
+            Line const& line = m_lines[p_line];
+            stats.raised = line.raised.load(std::memory_order_relaxed);
+            stats.merged = line.merged.load(std::memory_order_relaxed);
+            stats.serviced = line.serviced.load(std::memory_order_relaxed);
+            stats.total_latency_us =
+                line.total_latency_us.load(std::memory_order_relaxed);
+            stats.max_latency_us =
+                line.max_latency_us.load(std::memory_order_relaxed);
+        }
+        return stats;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Get access to a specific pin (for web API)
-    //! \param p_pin Pin number (0-19)
-    //! \return Pointer to the Pin object, or nullptr if invalid
-    //!
-    //! Used by the web interface to read pin states.
+    //! \brief Drop the pending interrupts, clear the counters and the
+    //! cancellation, enable the interrupts and unbind the sketch thread.
+    //! Handlers are kept.
     // ------------------------------------------------------------------------
-    Pin* getPin(int p_pin)
+    void reset()
     {
-        if (pins.find(p_pin) != pins.end())
+        for (size_t i = 0; i < m_words; ++i)
+        {
+            m_pending[i].store(0u);
+        }
+        for (size_t i = 0; i < m_count; ++i)
+        {
+            Line& line = m_lines[i];
+            line.raised_at.store(NOT_PENDING);
+            line.raised.store(0u);
+            line.merged.store(0u);
+            line.serviced.store(0u);
+            line.total_latency_us.store(0u);
+            line.max_latency_us.store(0u);
+        }
+        m_enabled.store(true);
+        m_thread.store(std::thread::id());
+
+        // A sketch thread still running keeps its state
+        std::scoped_lock lock(m_mutex);
+        if (m_state->load() != SketchState::Running)
         {
-            return &pins[p_pin];
+            m_state = std::make_shared<std::atomic<SketchState>>(
+                SketchState::Running);
         }
-        return nullptr;
     }
 
+private:
+
+    //! \brief Raise time of a line not pending.
+    static constexpr uint64_t NOT_PENDING =
+        std::numeric_limits<uint64_t>::max();
+
+    //! \brief State of an interrupt line.
+    struct Line
+    {
+        std::atomic<IsrHandler> handler{ nullptr };
+        std::atomic<uint64_t> raised_at{ NOT_PENDING };
+        std::atomic<uint64_t> raised{ 0 };
+        std::atomic<uint64_t> merged{ 0 };
+        std::atomic<uint64_t> serviced{ 0 };
+        std::atomic<uint64_t> total_latency_us{ 0 };
+        std::atomic<uint64_t> max_latency_us{ 0 };
+    };
+
     // ------------------------------------------------------------------------
-    //! \brief Force a pin's value (for simulating external inputs)
-    //! \param p_pin Pin number (0-19)
-    //! \param p_value Value to set (HIGH or LOW)
-    //!
-    //! Used by the web interface to simulate external inputs like button
-    //! presses or sensor readings. Bypasses the normal pinMode restrictions.
+    //! \brief Check if a line is pending.
     // ------------------------------------------------------------------------
-    void forcePinValue(int p_pin, int p_value)
+    bool hasPending() const
     {
-        if (pins.find(p_pin) != pins.end())
+        for (size_t i = 0; i < m_words; ++i)
         {
-            pins[p_pin].value = !!p_value;
-            checkInterrupt(p_pin);
+            if (m_pending[i].load(std::memory_order_acquire) != 0u)
+                return true;
         }
+        return false;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Set a pin's analog value (for simulating analog inputs)
-    //! \param p_pin Pin number (0-19)
-    //! \param p_analog_value Analog value to set (0-1023)
-    //!
-    //! Used by the web interface to simulate analog sensor readings.
+    //! \brief Find the pending line of highest priority.
     // ------------------------------------------------------------------------
-    void setAnalogValue(int p_pin, int p_analog_value)
+    bool nextPending(size_t& p_line) const
     {
-        if (pins.find(p_pin) != pins.end())
+        for (size_t i = 0; i < m_words; ++i)
         {
-            pins[p_pin].analog_value = p_analog_value;
-            // Also update digital value based on threshold
-            pins[p_pin].value = (p_analog_value > 512) ? HIGH : LOW;
+            uint64_t word = m_pending[i].load(std::memory_order_acquire);
+            if (word != 0u)
+            {
+                p_line = i * 64u + size_t(__builtin_ctzll(word));
+                return true;
+            }
         }
+        return false;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Set the analog read resolution
-    //! \param p_resolution Resolution in bits (1-32)
+    //! \brief Check if the calling thread executes the ISRs (binding it if
+    //! no thread is bound).
     // ------------------------------------------------------------------------
-    void setAnalogReadResolution(int p_resolution)
+    bool onSketchThread()
+    {
+        std::thread::id self = std::this_thread::get_id();
+        std::thread::id bound = m_thread.load(std::memory_order_relaxed);
+        if (bound == std::thread::id())
+        {
+            m_thread.compare_exchange_strong(bound, self);
+            return m_thread.load() == self;
+        }
+        return bound == self;
+    }
+
+private:
+
+    //! \brief Emulator time in microseconds
+    std::function<uint64_t()> m_clock;
+    //! \brief Interrupt lines
+    std::unique_ptr<Line[]> m_lines;
+    //! \brief Number of lines
+    size_t m_count = 0;
+    //! \brief One pending bit per line (bit 0 of word 0 = line 0)
+    std::unique_ptr<std::atomic<uint64_t>[]> m_pending;
+    //! \brief Number of words of m_pending
+    size_t m_words = 0;
+    //! \brief Global interrupt flag (I bit of SREG)
+    std::atomic<bool> m_enabled{ true };
+    //! \brief Cancellation state of the sketch thread (the next one after a
+    //! cancellation), shared with the thread by bindThread()
+    std::shared_ptr<std::atomic<SketchState>> m_state =
+        std::make_shared<std::atomic<SketchState>>(SketchState::Running);
+    //! \brief Thread executing the ISRs
+    std::atomic<std::thread::id> m_thread{};
+    //! \brief Number of threads sleeping in waitUntil()
+    std::atomic<size_t> m_waiters{ 0 };
+    //! \brief Protects the sleep in waitUntil()
+    std::mutex m_mutex;
+    //! \brief Wakes up waitUntil()
+    std::condition_variable m_cond;
+};
+
+// ============================================================================
+//! \brief Characteristics of an AVR timer.
+// ============================================================================
+struct AvrTimerSpec
+{
+    //! \brief Prescaler of each clock select value (0 = no clock).
+    std::array<uint32_t, 8> prescalers;
+    //! \brief Vector numbers of the input capture, compare match A, compare
+    //! match B and overflow interrupts (-1 if the timer does not have it).
+    std::array<int, 4> vectors;
+};
+
+// ============================================================================
+//! \class AvrTimer
+//! \brief Register-level model of the AVR Timer/Counter 0, 1 and 2.
+//!
+//! The counter value is not incremented on each tick: it is computed from
+//! the emulator time when TCNTn is read. When interrupts are enabled in
+//! TIMSKn, the next compare match or overflow is computed in timer ticks
+//! and scheduled on the TimerEmulator, so interrupts are raised on the
+//! InterruptController at the exact prescaled rate (without drift and
+//! without a thread per timer). Flags of the interrupts not enabled are
+//! updated when TIFRn is read.
+//!
+//! Supported waveform generation modes: normal, CTC, fast PWM and phase
+//! correct PWM (phase and frequency correct is handled as phase correct).
+//! Output compare pins and external clock sources are not emulated.
+//!
+//! \tparam T uint8_t for the 8-bit timers, uint16_t for the 16-bit timer.
+// ============================================================================
+template <typename T>
+class AvrTimer: public AvrPeripheral, public AvrTimerRegisters<T>
+{
+public:
+
+    using Registers = AvrTimerRegisters<T>;
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_timer Time base and scheduler of the emulator.
+    //! \param p_interrupts Interrupt controller of the emulator.
+    //! \param p_spec Prescalers and interrupt vectors of the timer.
+    // ------------------------------------------------------------------------
+    AvrTimer(TimerEmulator& p_timer,
+             InterruptController& p_interrupts,
+             AvrTimerSpec const& p_spec)
+        : Registers(static_cast<AvrPeripheral&>(*this)),
+          m_timer(p_timer),
+          m_interrupts(p_interrupts),
+          m_spec(p_spec)
     {
-        analog_read_resolution = p_resolution;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Set the analog write resolution
-    //! \param p_resolution Resolution in bits (1-32)
+    //! \brief Destructor: cancel the pending interrupt.
     // ------------------------------------------------------------------------
-    void setAnalogWriteResolution(int p_resolution)
+    ~AvrTimer() override
     {
-        analog_write_resolution = p_resolution;
+        m_timer.cancel(m_event);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Set the analog reference
-    //! \param p_reference Reference type (DEFAULT, INTERNAL, or EXTERNAL)
+    //! \brief Reset the registers to 0 (timer stopped).
     // ------------------------------------------------------------------------
-    void setAnalogReference(int p_reference)
+    void reset()
     {
-        analog_reference = p_reference;
+        std::scoped_lock lock(m_mutex);
+
+        m_timer.cancel(m_event);
+        ++m_generation;
+        m_registers.fill(0);
+        m_origin_us = now();
+        m_origin_position = 0;
+        m_ticks = 0;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Attach an interrupt to a pin
-    //! \param p_pin Pin number
-    //! \param p_function Interrupt callback function
-    //! \param p_mode Interrupt mode (CHANGE, RISING, or FALLING)
+    //! \brief Read a register (TCNTn and TIFRn are computed from the time).
     // ------------------------------------------------------------------------
-    void attachInterrupt(int p_pin, void (*p_function)(), int p_mode)
+    uint16_t readRegister(int p_id) override
     {
-        if (pins.find(p_pin) != pins.end())
+        std::scoped_lock lock(m_mutex);
+
+        if (p_id == Registers::TCNT)
         {
-            pins[p_pin].interrupt_callback = p_function;
-            pins[p_pin].interrupt_mode = p_mode;
-            pins[p_pin].last_value = pins[p_pin].value;
+            return count(position(ticksAt(now()), waveform()), waveform());
         }
+        if (p_id == Registers::TIFR)
+        {
+            updateFlags(ticksAt(now()));
+        }
+        return m_registers[static_cast<size_t>(p_id)];
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Detach an interrupt from a pin
-    //! \param p_pin Pin number
+    //! \brief Write a register and reschedule the next interrupt.
     // ------------------------------------------------------------------------
-    void detachInterrupt(int p_pin)
+    void writeRegister(int p_id, uint16_t p_value) override
     {
-        if (pins.find(p_pin) != pins.end())
+        std::scoped_lock lock(m_mutex);
+
+        // Freeze the counter state with the previous configuration
+        uint64_t now_us = now();
+        uint64_t ticks = ticksAt(now_us);
+        updateFlags(ticks);
+        uint32_t current = position(ticks, waveform());
+
+        switch (p_id)
         {
-            pins[p_pin].interrupt_callback = nullptr;
-            pins[p_pin].interrupt_mode = 0;
+            case Registers::TIFR:
+                // Writing a logical one clears the flag
+                m_registers[Registers::TIFR] = static_cast<uint16_t>(
+                    m_registers[Registers::TIFR] & ~p_value);
+                break;
+            case Registers::TCNT:
+                current = p_value;
+                m_registers[Registers::TCNT] = p_value;
+                break;
+            default:
+                m_registers[static_cast<size_t>(p_id)] = p_value;
+                break;
         }
+
+        // Restart counting from the current position with the new setting
+        Waveform wf = waveform();
+        m_origin_us = now_us;
+        m_origin_position = (current < cycle(wf)) ? current : 0u;
+        m_ticks = 0;
+        scheduleNextEvent();
     }
 
 private:
 
+    //! \brief Counting sequence selected by the WGM bits.
+    struct Waveform
+    {
+        enum Kind
+        {
+            Normal,
+            Ctc,
+            Fast,
+            PhaseCorrect
+        };
+
+        Kind kind;
+        //! \brief Counter value at the top of the sequence.
+        uint32_t top;
+        //! \brief TOP is given by ICRn (input capture flag set at TOP).
+        bool icr_top;
+    };
+
+    //! \brief Interrupt sources, in priority order, and their TIMSK/TIFR bit.
+    enum Source
+    {
+        Capture,
+        CompareA,
+        CompareB,
+        Overflow,
+        SOURCE_COUNT
+    };
+
+    static constexpr std::array<uint8_t, SOURCE_COUNT> source_bits = {
+        0x20, 0x02, 0x04, 0x01
+    };
+
+    static constexpr uint32_t MAX = std::numeric_limits<T>::max();
+
     // ------------------------------------------------------------------------
-    //! \brief Check and trigger interrupt if conditions are met
-    //! \param p_pin Pin number to check
+    //! \brief Emulator time in microseconds.
     // ------------------------------------------------------------------------
-    void checkInterrupt(int p_pin)
+    uint64_t now() const
     {
-        if (pins.find(p_pin) == pins.end())
-            return;
+        return static_cast<uint64_t>(m_timer.micros());
+    }
 
-        Pin& pin = pins[p_pin];
-        if (!pin.interrupt_callback)
-            return;
+    // ------------------------------------------------------------------------
+    //! \brief Prescaler selected by the CS bits (0 = stopped).
+    // ------------------------------------------------------------------------
+    uint32_t prescaler() const
+    {
+        return m_spec.prescalers[m_registers[Registers::TCCRB] & 0x07u];
+    }
 
-        bool trigger = false;
-        int current_value = pin.value;
-        int last = pin.last_value;
+    // ------------------------------------------------------------------------
+    //! \brief Timer ticks elapsed since the origin.
+    // ------------------------------------------------------------------------
+    uint64_t ticksAt(uint64_t p_now_us) const
+    {
+        if ((prescaler() == 0u) || (p_now_us < m_origin_us))
+            return 0u;
+        return (p_now_us - m_origin_us) * AVR_TICKS_PER_US / prescaler();
+    }
 
-        switch (pin.interrupt_mode)
+    // ------------------------------------------------------------------------
+    //! \brief Decode the waveform generation mode.
+    // ------------------------------------------------------------------------
+    Waveform waveform() const
+    {
+        uint32_t ocra_top = m_registers[Registers::OCRA];
+        uint32_t icr_top = m_registers[Registers::ICR];
+        uint32_t wgm = m_registers[Registers::TCCRA] & 0x03u;
+
+        if (MAX == 0xFFu)
         {
-            case CHANGE:
-                trigger = (current_value != last);
-                break;
-            case RISING:
-                trigger = (last == LOW && current_value == HIGH);
-                break;
-            case FALLING:
-                trigger = (last == HIGH && current_value == LOW);
-                break;
+            wgm |= (m_registers[Registers::TCCRB] >> 1) & 0x04u;
+            switch (wgm)
+            {
+                case 1: return { Waveform::PhaseCorrect, 0xFFu, false };
+                case 2: return { Waveform::Ctc, ocra_top, false };
+                case 3: return { Waveform::Fast, 0xFFu, false };
+                case 5: return { Waveform::PhaseCorrect, ocra_top, false };
+                case 7: return { Waveform::Fast, ocra_top, false };
+                default: return { Waveform::Normal, MAX, false };
+            }
+        }
+
+        wgm |= (m_registers[Registers::TCCRB] >> 1) & 0x0Cu;
+        switch (wgm)
+        {
+            case 1: return { Waveform::PhaseCorrect, 0xFFu, false };
+            case 2: return { Waveform::PhaseCorrect, 0x1FFu, false };
+            case 3: return { Waveform::PhaseCorrect, 0x3FFu, false };
+            case 4: return { Waveform::Ctc, ocra_top, false };
+            case 5: return { Waveform::Fast, 0xFFu, false };
+            case 6: return { Waveform::Fast, 0x1FFu, false };
+            case 7: return { Waveform::Fast, 0x3FFu, false };
+            case 8: return { Waveform::PhaseCorrect, icr_top, true };
+            case 9: return { Waveform::PhaseCorrect, ocra_top, false };
+            case 10: return { Waveform::PhaseCorrect, icr_top, true };
+            case 11: return { Waveform::PhaseCorrect, ocra_top, false };
+            case 12: return { Waveform::Ctc, icr_top, true };
+            case 14: return { Waveform::Fast, icr_top, true };
+            case 15: return { Waveform::Fast, ocra_top, false };
+            default: return { Waveform::Normal, MAX, false };
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of ticks of a counting sequence.
+    // ------------------------------------------------------------------------
+    static uint32_t cycle(Waveform const& p_wf)
+    {
+        if (p_wf.kind == Waveform::PhaseCorrect)
+            return (p_wf.top == 0u) ? 1u : 2u * p_wf.top;
+        return p_wf.top + 1u;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Position in the counting sequence after the given ticks.
+    // ------------------------------------------------------------------------
+    uint32_t position(uint64_t p_ticks, Waveform const& p_wf) const
+    {
+        return static_cast<uint32_t>((m_origin_position + p_ticks) %
+                                     cycle(p_wf));
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Counter value at a position of the sequence (phase correct
+    //! modes count down in the second half).
+    // ------------------------------------------------------------------------
+    static uint16_t count(uint32_t p_position, Waveform const& p_wf)
+    {
+        if ((p_wf.kind == Waveform::PhaseCorrect) && (p_position > p_wf.top))
+            return static_cast<uint16_t>(2u * p_wf.top - p_position);
+        return static_cast<uint16_t>(p_position);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Positions of the sequence where an interrupt source triggers.
+    //! \return Number of positions stored in p_positions (0 to 2).
+    // ------------------------------------------------------------------------
+    size_t positions(Source p_source,
+                     Waveform const& p_wf,
+                     std::array<uint32_t, 2>& p_positions) const
+    {
+        uint32_t compare = (p_source == CompareA)
+                               ? m_registers[Registers::OCRA]
+                               : m_registers[Registers::OCRB];
+        switch (p_source)
+        {
+            case Capture:
+                p_positions[0] = p_wf.top;
+                return p_wf.icr_top ? 1u : 0u;
+            case Overflow:
+                if (p_wf.kind == Waveform::Fast)
+                    p_positions[0] = p_wf.top;
+                else
+                    p_positions[0] = 0u;
+                // In CTC mode, the counter never reaches MAX unless TOP is MAX
+                return ((p_wf.kind != Waveform::Ctc) || (p_wf.top == MAX)) ? 1u
+                                                                           : 0u;
             default:
-                break;
+                if (compare > p_wf.top)
+                    return 0u;
+                p_positions[0] = compare;
+                if ((p_wf.kind == Waveform::PhaseCorrect) && (compare > 0u) &&
+                    (compare < p_wf.top))
+                {
+                    // Matched when counting up then when counting down
+                    p_positions[1] = 2u * p_wf.top - compare;
+                    return 2u;
+                }
+                return 1u;
         }
+    }
 
-        pin.last_value = current_value;
+    // ------------------------------------------------------------------------
+    //! \brief First tick after p_after where the source triggers.
+    //! \return 0 if the source never triggers.
+    // ------------------------------------------------------------------------
+    uint64_t nextTick(Source p_source, Waveform const& p_wf,
+                      uint64_t p_after) const
+    {
+        std::array<uint32_t, 2> pos{};
+        size_t n = positions(p_source, p_wf, pos);
+        uint32_t length = cycle(p_wf);
+        uint32_t current = position(p_after + 1u, p_wf);
 
-        if (trigger)
+        uint64_t next = 0u;
+        for (size_t i = 0; i < n; ++i)
         {
-            pin.interrupt_callback();
+            uint64_t tick =
+                p_after + 1u + (pos[i] + length - current) % length;
+            if ((next == 0u) || (tick < next))
+                next = tick;
         }
+        return next;
     }
 
-private:
+    // ------------------------------------------------------------------------
+    //! \brief Set the flags of the sources triggered since the last update.
+    // ------------------------------------------------------------------------
+    void updateFlags(uint64_t p_ticks)
+    {
+        if (p_ticks <= m_ticks)
+            return;
+
+        Waveform wf = waveform();
+        for (size_t i = 0; i < SOURCE_COUNT; ++i)
+        {
+            uint64_t tick = nextTick(Source(i), wf, m_ticks);
+            if ((tick != 0u) && (tick <= p_ticks))
+            {
+                m_registers[Registers::TIFR] |= source_bits[i];
+            }
+        }
+        m_ticks = p_ticks;
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Initialize all pins
-    //!
-    //! Creates 20 pins (Arduino Uno standard) and marks pins 3, 5, 6, 9, 10, 11
-    //! as PWM-capable.
+    //! \brief Schedule the next enabled interrupt on the emulator timer.
     // ------------------------------------------------------------------------
-    void initializePins()
+    void scheduleNextEvent()
     {
-        // Initialize Arduino Uno pins
-        for (int i = 0; i < 20; i++)
+        m_timer.cancel(m_event);
+        uint64_t generation = ++m_generation;
+        if ((prescaler() == 0u) ||
+            ((m_registers[Registers::TIMSK] & 0x27u) == 0u))
+            return;
+
+        Waveform wf = waveform();
+        uint64_t next = 0u;
+        for (size_t i = 0; i < SOURCE_COUNT; ++i)
         {
-            pins[i] = Pin();
+            if ((m_registers[Registers::TIMSK] & source_bits[i]) == 0u)
+                continue;
+            uint64_t tick = nextTick(Source(i), wf, m_ticks);
+            if ((tick != 0u) && ((next == 0u) || (tick < next)))
+                next = tick;
         }
-        // PWM-capable pins
-        pins[3].pwm_capable = true;
-        pins[5].pwm_capable = true;
-        pins[6].pwm_capable = true;
-        pins[9].pwm_capable = true;
-        pins[10].pwm_capable = true;
-        pins[11].pwm_capable = true;
+        if (next == 0u)
+            return;
+
+        // Round up to the microsecond resolution of the scheduler
+        uint64_t cycles = next * prescaler();
+        uint64_t due = m_origin_us + (cycles + AVR_TICKS_PER_US - 1u) /
+                                         AVR_TICKS_PER_US;
+        m_event = m_timer.scheduleAt(
+            [this, generation, next]() { onEvent(generation, next); }, due);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Simulation loop (runs in separate thread)
-    //!
-    //! Continuously updates timer callbacks while the simulation is running.
-    //! Runs at approximately 1000 Hz (1ms sleep).
+    //! \brief Scheduler callback: raise the interrupts of the triggered
+    //! sources.
     // ------------------------------------------------------------------------
-    void simulationLoop()
+    void onEvent(uint64_t p_generation, uint64_t p_ticks)
     {
-        while (running)
+        std::scoped_lock lock(m_mutex);
+
+        // Rescheduled meanwhile by a register write
+        if (p_generation != m_generation)
+            return;
+
+        updateFlags(p_ticks);
+        for (size_t i = 0; i < SOURCE_COUNT; ++i)
         {
-            timer.updateCallbacks();
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            uint8_t bit = source_bits[i];
+            if (((m_registers[Registers::TIFR] & bit) == 0u) ||
+                ((m_registers[Registers::TIMSK] & bit) == 0u))
+                continue;
+
+            // The flag is handed to the interrupt controller
+            m_registers[Registers::TIFR] =
+                static_cast<uint16_t>(m_registers[Registers::TIFR] & ~bit);
+            if (m_spec.vectors[i] >= 0)
+            {
+                m_interrupts.raise(static_cast<size_t>(m_spec.vectors[i]));
+            }
         }
+        scheduleNextEvent();
     }
 
 private:
 
-    std::map<int, Pin> pins;         ///< Map of all pins (0-19)
-    SPIEmulator spi;                 ///< SPI bus emulator
-    SerialEmulator serial;           ///< Serial (UART) emulator
-    TimerEmulator timer;             ///< Timer emulator
-    bool running = false;            ///< Simulation running state
-    std::thread simulation_thread;   ///< Simulation thread
-    int analog_read_resolution = 10; ///< ADC resolution in bits (default 10)
-    int analog_write_resolution = 8; ///< PWM resolution in bits (default 8)
-    int analog_reference = DEFAULT;  ///< Analog reference type
+    TimerEmulator& m_timer;            ///< Time base and scheduler
+    InterruptController& m_interrupts; ///< Receives the interrupts
+    AvrTimerSpec m_spec;               ///< Prescalers and vectors
+    //! \brief Register values
+    std::array<uint16_t, Registers::REGISTER_COUNT> m_registers{};
+    //! \brief Registers are accessed by the sketch and the scheduler
+    std::mutex m_mutex;
+    uint64_t m_origin_us = 0;         ///< Time of the last reconfiguration
+    uint32_t m_origin_position = 0;   ///< Position in the sequence at origin
+    uint64_t m_ticks = 0;             ///< Ticks since origin of the flags
+    uint64_t m_generation = 0;        ///< Invalidates outdated events
+    TimerEmulator::TimerId m_event = 0; ///< Scheduled interrupt
 };
 
-/// Global instance for Arduino compatibility
-inline ArduinoEmulator arduino_sim;
-
-/// Global random number generator (Mersenne Twister)
-inline std::mt19937 arduino_random_engine(std::random_device{}());
-
 // ============================================================================
-//! \defgroup GlobalFunctions Global Arduino Functions
-//! \brief Arduino-compatible global functions
-//!
-//! These functions provide Arduino-style global interface to the emulator.
-//! \{
+//! \brief The three timers of the ATmega328P.
 // ============================================================================
-
-// ----------------------------------------------------------------------------
-//! \brief Configure a pin's mode
-//! \param p_pin Pin number
-//! \param p_mode Pin mode (INPUT, OUTPUT, or INPUT_PULLUP)
-// ----------------------------------------------------------------------------
-inline void pinMode(int p_pin, int p_mode)
-{
-    arduino_sim.pinMode(p_pin, p_mode);
-}
-
-// ----------------------------------------------------------------------------
-//! \brief Write a digital value to a pin
-//! \param p_pin Pin number
-//! \param p_value Value to write (HIGH or LOW)
-// ----------------------------------------------------------------------------
-inline void digitalWrite(int p_pin, int p_value)
+class AvrTimers
 {
-    arduino_sim.digitalWrite(p_pin, p_value);
-}
+public:
 
-// ----------------------------------------------------------------------------
-//! \brief Read a digital value from a pin
-//! \param p_pin Pin number
-//! \return Current pin value (HIGH or LOW)
-// ----------------------------------------------------------------------------
-inline int digitalRead(int p_pin)
-{
-    return arduino_sim.digitalRead(p_pin);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_timer Time base and scheduler of the emulator.
+    //! \param p_interrupts Interrupt controller of the emulator.
+    // ------------------------------------------------------------------------
+    AvrTimers(TimerEmulator& p_timer, InterruptController& p_interrupts)
+        : timer0(p_timer,
+                 p_interrupts,
+                 { { 0, 1, 8, 64, 256, 1024, 0, 0 },
+                   { -1,
+                     TIMER0_COMPA_vect_num,
+                     TIMER0_COMPB_vect_num,
+                     TIMER0_OVF_vect_num } }),
+          timer1(p_timer,
+                 p_interrupts,
+                 { { 0, 1, 8, 64, 256, 1024, 0, 0 },
+                   { TIMER1_CAPT_vect_num,
+                     TIMER1_COMPA_vect_num,
+                     TIMER1_COMPB_vect_num,
+                     TIMER1_OVF_vect_num } }),
+          timer2(p_timer,
+                 p_interrupts,
+                 { { 0, 1, 8, 32, 64, 128, 256, 1024 },
+                   { -1,
+                     TIMER2_COMPA_vect_num,
+                     TIMER2_COMPB_vect_num,
+                     TIMER2_OVF_vect_num } })
+    {
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Write an analog (PWM) value to a pin
-//! \param p_pin Pin number
-//! \param p_value PWM value (0-255)
-// ----------------------------------------------------------------------------
-inline void analogWrite(int p_pin, int p_value)
-{
-    arduino_sim.analogWrite(p_pin, p_value);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Stop the timers and clear their registers.
+    // ------------------------------------------------------------------------
+    void reset()
+    {
+        timer0.reset();
+        timer1.reset();
+        timer2.reset();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Read an analog value from a pin
-//! \param p_pin Pin number
-//! \return Analog value (0-1023)
-// ----------------------------------------------------------------------------
-inline int analogRead(int p_pin)
-{
-    return arduino_sim.analogRead(p_pin);
-}
+    AvrTimer<uint8_t> timer0;  ///< 8-bit Timer/Counter 0
+    AvrTimer<uint16_t> timer1; ///< 16-bit Timer/Counter 1
+    AvrTimer<uint8_t> timer2;  ///< 8-bit Timer/Counter 2
+};
 
-// ----------------------------------------------------------------------------
-//! \brief Get elapsed time in milliseconds
-//! \return Milliseconds since program start
-// ----------------------------------------------------------------------------
-inline long millis()
+// ============================================================================
+//! \class SquareWaveStream
+//! \brief SFML audio stream playing a square wave.
+//!
+//! Creating an instance opens the audio device of the host.
+// ============================================================================
+class SquareWaveStream: public sf::SoundStream
 {
-    return arduino_sim.getTimer().millis();
-}
+public:
 
-// ----------------------------------------------------------------------------
-//! \brief Get elapsed time in microseconds
-//! \return Microseconds since program start
-// ----------------------------------------------------------------------------
-inline long micros()
-{
-    return arduino_sim.getTimer().micros();
-}
-
-// ----------------------------------------------------------------------------
-//! \brief Delay execution for specified milliseconds
-//! \param p_ms Milliseconds to delay
-// ----------------------------------------------------------------------------
-inline void delay(long p_ms)
-{
-    arduino_sim.getTimer().delay(p_ms);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Constructor
+    // ------------------------------------------------------------------------
+    SquareWaveStream()
+    {
+        initialize(1, 44100); // Mono, 44.1kHz
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Delay execution for specified microseconds
-//! \param p_us Microseconds to delay
-// ----------------------------------------------------------------------------
-inline void delayMicroseconds(int p_us)
-{
-    std::this_thread::sleep_for(std::chrono::microseconds(p_us));
-}
+    // ------------------------------------------------------------------------
+    //! \brief Destructor
+    // ------------------------------------------------------------------------
+    ~SquareWaveStream()
+    {
+        stop();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Measure the duration of a pulse on a pin
-//! \param p_pin Pin number
-//! \param p_state State to measure (HIGH or LOW)
-//! \param p_timeout Timeout in microseconds (default: 1000000)
-//! \return Duration of the pulse in microseconds
-//!
-//! In simulation mode, returns a mock value based on pin state.
-// ----------------------------------------------------------------------------
-inline long pulseIn(int p_pin, int p_state, long p_timeout = 1000000)
-{
-    (void)p_timeout; // Unused in simulation
-    // Simple simulation: return a value based on current pin state
-    int pin_value = arduino_sim.digitalRead(p_pin);
-    if (pin_value == p_state)
+    // ------------------------------------------------------------------------
+    //! \brief Set the frequency of the wave.
+    //! \param p_frequency Frequency in Hz (0 for silence).
+    // ------------------------------------------------------------------------
+    void setFrequency(int p_frequency)
     {
-        // Return a simulated pulse duration
-        std::uniform_int_distribution<long> dist(1000, 1499);
-        return dist(arduino_random_engine); // 1000-1499 microseconds
+        m_frequency.store(p_frequency);
+        m_phase = 0;
     }
-    return 0;
-}
 
-// ----------------------------------------------------------------------------
-//! \brief Set the analog read resolution
-//! \param p_resolution Resolution in bits
-// ----------------------------------------------------------------------------
-inline void analogReadResolution(int p_resolution)
-{
-    arduino_sim.setAnalogReadResolution(p_resolution);
-}
+private:
 
-// ----------------------------------------------------------------------------
-//! \brief Set the analog write resolution
-//! \param p_resolution Resolution in bits
-// ----------------------------------------------------------------------------
-inline void analogWriteResolution(int p_resolution)
-{
-    arduino_sim.setAnalogWriteResolution(p_resolution);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get the next chunk of audio data (SFML callback)
+    //! \param p_data Pointer to audio sample buffer
+    //! \param p_sample_count Number of samples to generate
+    //! \return true to continue playing, false to stop
+    // ------------------------------------------------------------------------
+    bool onGetData(Chunk& p_data) override
+    {
+        const unsigned int sample_count = 4410; // 0.1 second buffer
+        std::vector<sf::Int16>& samples = m_samples;
+        samples.resize(sample_count);
 
-// ----------------------------------------------------------------------------
-//! \brief Set the analog reference voltage
-//! \param p_reference Reference type (DEFAULT, INTERNAL, or EXTERNAL)
-// ----------------------------------------------------------------------------
-inline void analogReference(int p_reference)
-{
-    arduino_sim.setAnalogReference(p_reference);
-}
+        int freq = m_frequency.load();
+        if (freq <= 0)
+        {
+            // Silence
+            std::fill(samples.begin(), samples.end(), 0);
+        }
+        else
+        {
+            // Generate square wave
+            const double sample_rate = 44100.0;
+            const double amplitude = 8000.0;
+            const double two_pi = 2.0 * 3.14159265358979323846;
 
-// ----------------------------------------------------------------------------
-//! \brief Attach an interrupt to a pin
-//! \param p_pin Pin number
-//! \param p_function Interrupt callback function
-//! \param p_mode Interrupt mode (CHANGE, RISING, or FALLING)
-// ----------------------------------------------------------------------------
-inline void attachInterrupt(int p_pin, void (*p_function)(), int p_mode)
-{
-    arduino_sim.attachInterrupt(p_pin, p_function, p_mode);
-}
+            for (unsigned int i = 0; i < sample_count; ++i)
+            {
+                double time = static_cast<double>(m_phase) / sample_rate;
+                double sine_value = std::sin(two_pi * freq * time);
 
-// ----------------------------------------------------------------------------
-//! \brief Detach an interrupt from a pin
-//! \param p_pin Pin number
-// ----------------------------------------------------------------------------
-inline void detachInterrupt(int p_pin)
-{
-    arduino_sim.detachInterrupt(p_pin);
-}
+                // Square wave: sign of sine wave
+                samples[i] = static_cast<sf::Int16>((sine_value > 0 ? 1 : -1) *
+                                                    amplitude);
 
-// ----------------------------------------------------------------------------
-//! \brief Generate a tone on a pin
-//! \param p_pin Pin number
-//! \param p_frequency Frequency in Hz
-//!
-//! Generates a square wave tone using SFML audio output.
-//! Also sets the pin to HIGH state.
-// ----------------------------------------------------------------------------
-inline void tone(int p_pin, int p_frequency)
-{
-    // Auto-configure pin as OUTPUT if not already configured
-    Pin const* pin = arduino_sim.getPin(p_pin);
-    if (pin && !pin->configured)
-    {
-        arduino_sim.pinMode(p_pin, OUTPUT);
-    }
+                m_phase++;
+                if (m_phase >= static_cast<unsigned long>(sample_rate))
+                    m_phase -= static_cast<unsigned long>(sample_rate);
+            }
+        }
 
-    arduino_sim.digitalWrite(p_pin, HIGH);
-    tone_generator.playTone(p_frequency, p_pin);
-}
+        p_data.samples = samples.data();
+        p_data.sampleCount = sample_count;
+        return true; // Continue playing
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Generate a tone on a pin for a duration
-//! \param p_pin Pin number
-//! \param p_frequency Frequency in Hz
-//! \param p_duration Duration in milliseconds
-//!
-//! Generates a square wave tone for the specified duration using SFML.
-//! Sets the pin HIGH during playback, then LOW after.
-// ----------------------------------------------------------------------------
-inline void tone(int p_pin, int p_frequency, long p_duration)
-{
-    // Auto-configure pin as OUTPUT if not already configured
-    Pin const* pin = arduino_sim.getPin(p_pin);
-    if (pin && !pin->configured)
+    // ------------------------------------------------------------------------
+    //! \brief Seek to a position in the stream (SFML callback)
+    //! \param p_time_offset Time offset to seek to
+    // ------------------------------------------------------------------------
+    void onSeek(sf::Time p_time_offset) override
     {
-        arduino_sim.pinMode(p_pin, OUTPUT);
+        m_phase = static_cast<unsigned long>(
+            static_cast<double>(p_time_offset.asSeconds()) * 44100.0);
     }
 
-    arduino_sim.digitalWrite(p_pin, HIGH);
-    tone_generator.playTone(p_frequency, p_duration, p_pin);
-    arduino_sim.digitalWrite(p_pin, LOW);
-}
+private:
 
-// ----------------------------------------------------------------------------
-//! \brief Stop generating a tone on a pin
-//! \param p_pin Pin number
+    //! \brief Current tone frequency in Hz
+    std::atomic<int> m_frequency{ 0 };
+    //! \brief Current phase in the waveform
+    unsigned long m_phase{ 0 };
+    //! \brief Audio buffer handed to SFML (one per stream since each stream
+    //! has its own audio thread)
+    std::vector<sf::Int16> m_samples;
+};
+
+// ============================================================================
+//! \class ToneGenerator
+//! \brief State of the tone() function and its audio output.
 //!
-//! Stops the currently playing tone and sets the pin to LOW.
-// ----------------------------------------------------------------------------
-inline void noTone(int p_pin)
+//! Tones are played on the host speakers through SFML, with a square wave
+//! similar to Arduino's tone() function. The audio device is only opened on
+//! the first tone, and never when the audio output is disabled (i.e. headless
+//! runs): the tone state is still tracked.
+// ============================================================================
+class ToneGenerator
 {
-    tone_generator.stopTone();
-    arduino_sim.digitalWrite(p_pin, LOW);
-}
+public:
 
-// Math functions
+    // ------------------------------------------------------------------------
+    //! \brief Enable or disable the sound on the host speakers.
+    //! \param p_enable false to never open the audio device.
+    // ------------------------------------------------------------------------
+    void setAudioOutput(bool p_enable)
+    {
+        m_audio_output = p_enable;
+        if (!p_enable)
+        {
+            m_stream.reset();
+        }
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Constrain a value within a range
-//! \param p_value Value to constrain
-//! \param p_min Minimum value
-//! \param p_max Maximum value
-//! \return Constrained value
-// ----------------------------------------------------------------------------
-inline int constrain(int p_value, int p_min, int p_max)
-{
-    if (p_value < p_min)
-        return p_min;
-    if (p_value > p_max)
-        return p_max;
-    return p_value;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Start playing a tone at the specified frequency
+    //! \param p_frequency Frequency in Hz
+    //! \param p_pin Pin number playing the tone
+    // ------------------------------------------------------------------------
+    void playTone(int p_frequency, int p_pin = -1)
+    {
+        if (p_frequency <= 0)
+            return;
 
-// ----------------------------------------------------------------------------
-//! \brief Map a value from one range to another
-//! \param p_val Value to map
-//! \param p_min Input range minimum
-//! \param p_max Input range maximum
-//! \param p_new_min Output range minimum
-//! \param p_new_max Output range maximum
-//! \return Mapped value
-// ----------------------------------------------------------------------------
-inline long
-map(long p_val, long p_min, long p_max, long p_new_min, long p_new_max)
-{
-    return (p_val - p_min) * (p_new_max - p_new_min) / (p_max - p_min) +
-           p_new_min;
-}
+        m_frequency.store(p_frequency);
+        m_current_pin.store(p_pin);
+        m_is_playing = true;
 
-// ----------------------------------------------------------------------------
-//! \brief Return the maximum of two values
-//! \param p_val1 First value
-//! \param p_val2 Second value
-//! \return Maximum value
-// ----------------------------------------------------------------------------
-inline int max(int p_val1, int p_val2)
-{
-    return (p_val1 > p_val2) ? p_val1 : p_val2;
-}
+        if (m_audio_output)
+        {
+            if (!m_stream)
+            {
+                m_stream = std::make_unique<SquareWaveStream>();
+            }
+            m_stream->setFrequency(p_frequency);
+            m_stream->play();
+        }
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Return the minimum of two values
-//! \param p_val1 First value
-//! \param p_val2 Second value
-//! \return Minimum value
-// ----------------------------------------------------------------------------
-inline int min(int p_val1, int p_val2)
-{
-    return (p_val1 < p_val2) ? p_val1 : p_val2;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Stop playing the current tone
+    // ------------------------------------------------------------------------
+    void stopTone()
+    {
+        if (m_stream)
+        {
+            m_stream->stop();
+            m_stream->setFrequency(0);
+        }
+        m_frequency.store(0);
+        m_current_pin.store(-1);
+        m_is_playing = false;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Calculate the square of a number
-//! \param p_value Input value
-//! \return Square of the value
-// ----------------------------------------------------------------------------
-inline int sq(int p_value)
-{
-    return p_value * p_value;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get current frequency
+    //! \return Current tone frequency in Hz
+    // ------------------------------------------------------------------------
+    int getFrequency() const
+    {
+        return m_frequency.load();
+    }
 
-// Character functions
+    // ------------------------------------------------------------------------
+    //! \brief Get current pin playing tone
+    //! \return Pin number or -1 if none
+    // ------------------------------------------------------------------------
+    int getCurrentPin() const
+    {
+        return m_current_pin.load();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is alphabetic
-//! \param p_c Character to check
-//! \return true if alphabetic, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isAlpha(char p_c)
-{
-    return std::isalpha(static_cast<unsigned char>(p_c)) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Check if a tone is currently playing
+    //! \return true if playing, false otherwise
+    // ------------------------------------------------------------------------
+    bool isPlaying() const
+    {
+        return m_is_playing.load();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is alphanumeric
-//! \param p_c Character to check
-//! \return true if alphanumeric, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isAlphaNumeric(char p_c)
-{
-    return std::isalnum(static_cast<unsigned char>(p_c)) != 0;
-}
+private:
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is ASCII
-//! \param p_c Character to check
-//! \return true if 7-bit ASCII, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isAscii(char p_c)
-{
-    return (static_cast<unsigned char>(p_c) <= 127);
-}
+    //! \brief Current tone frequency in Hz
+    std::atomic<int> m_frequency{ 0 };
+    //! \brief Current pin playing tone
+    std::atomic<int> m_current_pin{ -1 };
+    //! \brief Current tone playing state
+    std::atomic<bool> m_is_playing{ false };
+    //! \brief Play the tones on the host speakers
+    bool m_audio_output = true;
+    //! \brief Audio stream (created on the first tone)
+    std::unique_ptr<SquareWaveStream> m_stream;
+};
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is a control character
-//! \param p_c Character to check
-//! \return true if control character, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isControl(char p_c)
+// ============================================================================
+//! \brief State changes published by the ArduinoEmulator to its observer.
+// ============================================================================
+enum class EmulatorEvent
 {
-    return std::iscntrl(static_cast<unsigned char>(p_c)) != 0;
-}
+    //! \brief Value, mode or PWM of a pin changed.
+    PinChanged,
+    //! \brief New data was written on the serial output.
+    SerialOutput,
+    //! \brief A tone started or stopped.
+    ToneChanged
+};
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is a digit
-//! \param p_c Character to check
-//! \return true if digit (0-9), false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isDigit(char p_c)
-{
-    return std::isdigit(static_cast<unsigned char>(p_c)) != 0;
-}
+class ArduinoEmulator;
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is a printable character (excluding space)
-//! \param p_c Character to check
-//! \return true if printable and not space, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isGraph(char p_c)
-{
-    return std::isgraph(static_cast<unsigned char>(p_c)) != 0;
-}
+//! \brief Emulator used by the Arduino API functions called from this thread.
+//! nullptr means the default arduino_sim instance. See EmulatorScope.
+ARDUINO_EMULATOR_EXPORT inline thread_local ArduinoEmulator* current_emulator =
+    nullptr;
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is a hexadecimal digit
-//! \param p_c Character to check
-//! \return true if hex digit (0-9, A-F, a-f), false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isHexadecimalDigit(char p_c)
+// ============================================================================
+//! \class ArduinoEmulator
+//! \brief Main Arduino hardware emulator class
+//!
+//! This is the core class that brings together all emulation components:
+//! - Digital and analog pins
+//! - Serial (UART) communication, up to the 4 ports of the Mega
+//! - SPI bus
+//! - I2C bus and its device models
+//! - Timer and timing functions
+//!
+//! The emulator runs in a separate thread and provides a complete
+//! Arduino-compatible interface for testing sketches without physical
+//! hardware.
+//!
+//! \note By default this emulator simulates an Arduino Uno with 20 pins
+//! (0-19) and PWM on pins 3, 5, 6, 9, 10, 11. Call configurePins() to match
+//! another board.
+//!
+//! \note Instances share nothing: several boards can be emulated in the same
+//! process, each one driven by its own thread bound with EmulatorScope.
+// ============================================================================
+class ArduinoEmulator
 {
-    return std::isxdigit(static_cast<unsigned char>(p_c)) != 0;
-}
+public:
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is lowercase
-//! \param p_c Character to check
-//! \return true if lowercase, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isLowerCase(char p_c)
-{
-    return std::islower(static_cast<unsigned char>(p_c)) != 0;
-}
+    //! \brief Maximum number of hardware UARTs (Serial to Serial3).
+    static constexpr size_t MAX_UARTS = 4;
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is printable (including space)
-//! \param p_c Character to check
-//! \return true if printable, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isPrintable(char p_c)
-{
-    return std::isprint(static_cast<unsigned char>(p_c)) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Constructor
+    //!
+    //! Initializes all pins with default configuration.
+    //! Pins are configured as INPUT by default, with specific pins marked as
+    //! PWM-capable.
+    // ------------------------------------------------------------------------
+    ArduinoEmulator()
+    {
+        timer.setSafePoint([this]() { interrupt_controller.dispatch(); });
+        configurePins(20, { 3, 5, 6, 9, 10, 11 }, { 14, 15, 16, 17, 18, 19 });
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is punctuation
-//! \param p_c Character to check
-//! \return true if punctuation, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isPunct(char p_c)
-{
-    return std::ispunct(static_cast<unsigned char>(p_c)) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Destructor
+    //!
+    //! Ensures the simulation thread is properly stopped before destruction.
+    // ------------------------------------------------------------------------
+    ~ArduinoEmulator()
+    {
+        stop();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is whitespace
-//! \param p_c Character to check
-//! \return true if whitespace, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isSpace(char p_c)
-{
-    return std::isspace(static_cast<unsigned char>(p_c)) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Start the Arduino emulator
+    //!
+    //! Starts the timer and launches the simulation thread.
+    //! The simulation loop runs continuously until stop() is called.
+    // ------------------------------------------------------------------------
+    void start()
+    {
+        // If a thread is still running, stop it first to avoid std::terminate()
+        if (simulation_thread.joinable())
+        {
+            running = false;
+            timer.wakeUp();
+            simulation_thread.join();
+        }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is uppercase
-//! \param p_c Character to check
-//! \return true if uppercase, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isUpperCase(char p_c)
-{
-    return std::isupper(static_cast<unsigned char>(p_c)) != 0;
-}
+        running = true;
+        interrupt_controller.reset();
+        avr_timers.reset();
+        timer.start();
+        recorder.restartTime();
+        simulation_thread = std::thread(&ArduinoEmulator::simulationLoop, this);
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Check if character is whitespace (same as isSpace)
-//! \param p_c Character to check
-//! \return true if whitespace, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean isWhitespace(char p_c)
-{
-    return isSpace(p_c);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Stop the Arduino emulator
+    //!
+    //! Stops the simulation thread and waits for it to complete.
+    // ------------------------------------------------------------------------
+    void stop()
+    {
+        running = false;
+        timer.wakeUp();
+        if (simulation_thread.joinable())
+        {
+            simulation_thread.join();
+        }
+    }
 
-// Random functions (Note: conflicts with stdlib random() avoided by using long
-// return type)
+    // ------------------------------------------------------------------------
+    //! \brief Create the pins of the emulated board.
+    //! \param p_total_pins Number of pins (pins are numbered from 0).
+    //! \param p_pwm_pins Pins supporting analogWrite().
+    //! \param p_analog_pins Pin numbers of the analog channels A0, A1 ...
+    //!
+    //! All pins are reset to INPUT. Must not be called while the simulation is
+    //! running.
+    // ------------------------------------------------------------------------
+    void configurePins(size_t p_total_pins,
+                       std::vector<int> const& p_pwm_pins,
+                       std::vector<int> const& p_analog_pins)
+    {
+        // Pins are not copyable (atomic change sequence number)
+        pins = std::vector<Pin>(p_total_pins);
+        interrupt_controller.resize(AVR_VECTOR_COUNT + p_total_pins);
+        for (int pwm_pin : p_pwm_pins)
+        {
+            if (Pin* pin = pinAt(pwm_pin))
+            {
+                pin->pwm_capable = true;
+            }
+        }
+        analog_pins = p_analog_pins;
+        markAllPinsChanged();
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Generate a random number within a range.
-//! \param p_max Maximum value (exclusive).
-//! \return Random number between 0 and p_max-1.
-// ----------------------------------------------------------------------------
-inline long random(long p_max)
-{
-    std::uniform_int_distribution<long> dist(0, p_max - 1);
-    return dist(arduino_random_engine);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Reset the Arduino emulator to initial state
+    //!
+    //! Resets all pins, clears serial buffers, resets timer, and stops audio.
+    //! This is equivalent to pressing the reset button on a real Arduino.
+    // ------------------------------------------------------------------------
+    void reset()
+    {
+        // Stop the simulation if running
+        stop();
 
-// ----------------------------------------------------------------------------
-//! \brief Generate a random number within a range.
-//! \param p_min Minimum value (inclusive).
-//! \param p_max Maximum value (exclusive).
-//! \return Random number between p_min and p_max-1.
-// ----------------------------------------------------------------------------
-inline long random(long p_min, long p_max)
-{
-    std::uniform_int_distribution<long> dist(p_min, p_max - 1);
-    return dist(arduino_random_engine);
-}
+        // Reset all pins to default state
+        for (auto& pin : pins)
+        {
+            pin.value = LOW;
+            pin.mode = INPUT;
+            pin.pwm_value = 0;
+            pin.analog_value = 0;
+            pin.configured = false;
+            pin.interrupt_mode = 0;
+            pin.last_value = LOW;
+        }
+
+        // Stop all tones
+        tone_generator.stopTone();
+
+        // Stop the timer peripherals and forget the interrupts
+        avr_timers.reset();
+        interrupt_controller.reset();
+        interrupt_controller.clearHandlers();
+
+        // The pins are reset without digitalWrite(): release the SPI devices
+        spi.reset();
+
+        // Reset analog reference
+        analog_reference = DEFAULT;
+
+        markAllPinsChanged();
+        notify(EmulatorEvent::ToneChanged, -1);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the observer of the emulator state changes.
+    //! \param p_handler Function receiving the event and the pin concerned
+    //! (the serial port for SerialOutput, -1 when not related to a single
+    //! pin). Called from the thread doing the change (mainly the sketch
+    //! thread): it shall be fast and must not call back the emulator. Set it
+    //! before starting the simulation.
+    // ------------------------------------------------------------------------
+    void setEventHandler(
+        std::function<void(EmulatorEvent, int)> const& p_handler)
+    {
+        event_handler = p_handler;
+        for (size_t port = 0; port < MAX_UARTS; ++port)
+        {
+            if (p_handler)
+            {
+                uarts[port].setOutputCallback(
+                    [this, port]()
+                    { notify(EmulatorEvent::SerialOutput, int(port)); });
+            }
+            else
+            {
+                uarts[port].setOutputCallback(nullptr);
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Publish a state change to the observer (if any).
+    //! \param p_event Kind of change.
+    //! \param p_pin Pin concerned or -1.
+    // ------------------------------------------------------------------------
+    void notify(EmulatorEvent p_event, int p_pin) const
+    {
+        if (event_handler)
+            event_handler(p_event, p_pin);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if the simulation is running
+    //! \return true if simulation is running
+    // ------------------------------------------------------------------------
+    bool isRunning() const
+    {
+        return running;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the running state
+    //! \param p_running New running state
+    // ------------------------------------------------------------------------
+    void setRunning(bool p_running)
+    {
+        running = p_running;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Configure a pin's mode
+    //! \param p_pin Pin number (0-19)
+    //! \param p_mode Pin mode (INPUT, OUTPUT, or INPUT_PULLUP)
+    //!
+    //! Emulates Arduino's pinMode() function.
+    // ------------------------------------------------------------------------
+    void pinMode(int p_pin, int p_mode)
+    {
+        if (Pin* pin = pinAt(p_pin))
+        {
+            pin->mode = p_mode;
+            pin->configured = true;
+
+            // INPUT_PULLUP sets the pin to HIGH by default (pull-up resistor)
+            if (p_mode == INPUT_PULLUP)
+            {
+                pin->value = HIGH;
+            }
+            // INPUT_PULLDOWN sets the pin to LOW by default (pull-down
+            // resistor)
+            else if (p_mode == INPUT_PULLDOWN)
+            {
+                pin->value = LOW;
+            }
+
+            pinChanged(*pin, p_pin);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write a digital value to a pin
+    //! \param p_pin Pin number (0-19)
+    //! \param p_value Value to write (HIGH or LOW)
+    //!
+    //! Emulates Arduino's digitalWrite() function.
+    // ------------------------------------------------------------------------
+    void digitalWrite(int p_pin, int p_value)
+    {
+        if (Pin* pin = pinAt(p_pin))
+        {
+            int old_value = pin->value;
+            pin->digitalWrite(p_value);
+            if (pin->value != old_value)
+                pinChanged(*pin, p_pin);
+            spi.chipSelect(p_pin, pin->value);
+            checkInterrupt(*pin, p_pin);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Read a digital value from a pin
+    //! \param p_pin Pin number (0-19)
+    //! \return Current pin value (HIGH or LOW)
+    //!
+    //! Emulates Arduino's digitalRead() function.
+    // ------------------------------------------------------------------------
+    int digitalRead(int p_pin)
+    {
+        Pin const* pin = pinAt(p_pin);
+        return pin ? pin->digitalRead() : LOW;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write an analog (PWM) value to a pin
+    //! \param p_pin Pin number (must be PWM-capable: 3, 5, 6, 9, 10, 11)
+    //! \param p_value PWM value (0-255)
+    //!
+    //! Emulates Arduino's analogWrite() function.
+    // ------------------------------------------------------------------------
+    void analogWrite(int p_pin, int p_value)
+    {
+        if (Pin* pin = pinAt(p_pin))
+        {
+            int old_pwm = pin->pwm_value;
+            int old_mode = pin->mode;
+            pin->analogWrite(p_value);
+            if ((pin->pwm_value != old_pwm) || (pin->mode != old_mode))
+                pinChanged(*pin, p_pin);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Read an analog value from a pin
+    //! \param p_pin Pin number (0-19)
+    //! \return Analog value (0-1023)
+    //!
+    //! Emulates Arduino's analogRead() function.
+    // ------------------------------------------------------------------------
+    int analogRead(int p_pin)
+    {
+        // On real Arduino, analogRead(0) reads A0, analogRead(1) reads A1, etc.
+        // Convert analog channel numbers to their actual pin numbers (i.e.
+        // A0 = 14, A1 = 15, ..., A5 = 19 on Arduino Uno)
+        if (p_pin >= 0 && size_t(p_pin) < analog_pins.size())
+        {
+            p_pin = analog_pins[size_t(p_pin)];
+        }
+
+        if (Pin* pin = pinAt(p_pin))
+        {
+            // Analog pins don't require pinMode() - mark as configured on first
+            // analogRead()
+            if (!pin->configured)
+            {
+                pin->configured = true;
+                pinChanged(*pin, p_pin);
+            }
+            return pin->analogRead();
+        }
+        return 0;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the SPI bus (to plug device models)
+    //! \return Reference to the SPI bus instance
+    // ------------------------------------------------------------------------
+    SPIBus& getSPI()
+    {
+        return spi;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Create an SPI NOR flash timed by the emulator clock, to plug
+    //! on the SPI bus.
+    //! \param p_size Capacity in bytes.
+    // ------------------------------------------------------------------------
+    std::shared_ptr<SPIFlashDevice> makeSPIFlash(size_t p_size)
+    {
+        return std::make_shared<SPIFlashDevice>(
+            [this]() { return uint64_t(timer.micros()); }, p_size);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the EEPROM emulator
+    //! \return Reference to the EEPROM emulator instance
+    // ------------------------------------------------------------------------
+    EEPROMEmulator& getEEPROM()
+    {
+        return eeprom;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the I2C bus (to plug device models)
+    //! \return Reference to the I2C bus instance
+    // ------------------------------------------------------------------------
+    I2CBus& getI2C()
+    {
+        return i2c;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the Serial emulator
+    //! \return Reference to the Serial emulator instance
+    // ------------------------------------------------------------------------
+    SerialEmulator& getSerial(size_t p_port = 0)
+    {
+        return uarts[p_port];
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Seed the random number generator
-//! \param p_seed Seed value
-// ----------------------------------------------------------------------------
-inline void randomSeed(unsigned long p_seed)
-{
-    arduino_random_engine.seed(p_seed);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Set the number of hardware UARTs of the board.
+    //! \param p_count 1 (Serial) to MAX_UARTS (Serial to Serial3 of the Mega).
+    //!
+    //! Serial ports beyond the count ignore begin() and stay disabled.
+    // ------------------------------------------------------------------------
+    void configureUarts(size_t p_count)
+    {
+        uart_count = std::clamp(p_count, size_t(1), MAX_UARTS);
+    }
 
-// Bit manipulation functions
+    // ------------------------------------------------------------------------
+    //! \brief Get the number of hardware UARTs of the board.
+    // ------------------------------------------------------------------------
+    size_t getUartCount() const
+    {
+        return uart_count;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Get the value of a specific bit
-//! \param p_value Value to read from
-//! \param p_bit_number Bit number (0 = LSB)
-//! \return true if bit is set, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean bit(int p_value, int p_bit_number)
-{
-    return ((p_value >> p_bit_number) & 1) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Select the transmission timing model of all the UARTs.
+    //! \param p_timing Instant (default) or baud rate accurate.
+    // ------------------------------------------------------------------------
+    void setUartTiming(UartTiming p_timing)
+    {
+        for (auto& uart : uarts)
+        {
+            uart.setTiming(p_timing);
+        }
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Clear a specific bit
-//! \param p_value Reference to value to modify
-//! \param p_bit Bit number to clear
-// ----------------------------------------------------------------------------
-inline void bitClear(int& p_value, int p_bit)
-{
-    p_value &= ~(1 << p_bit);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the Timer emulator
+    //! \return Reference to the Timer emulator instance
+    // ------------------------------------------------------------------------
+    TimerEmulator& getTimer()
+    {
+        return timer;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Read the value of a specific bit
-//! \param p_value Value to read from
-//! \param p_bit_number Bit number (0 = LSB)
-//! \return true if bit is set, false otherwise
-// ----------------------------------------------------------------------------
-inline boolean bitRead(int p_value, int p_bit_number)
-{
-    return ((p_value >> p_bit_number) & 1) != 0;
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the AVR timer peripherals
+    //! \return Reference to the Timer/Counter 0, 1 and 2 models
+    // ------------------------------------------------------------------------
+    AvrTimers& getAvrTimers()
+    {
+        return avr_timers;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Set a specific bit
-//! \param p_value Reference to value to modify
-//! \param p_bit Bit number to set
-// ----------------------------------------------------------------------------
-inline void bitSet(int& p_value, int p_bit)
-{
-    p_value |= (1 << p_bit);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the interrupt controller
+    //! \return Reference to the pending interrupts, masking and counters
+    // ------------------------------------------------------------------------
+    InterruptController& getInterruptController()
+    {
+        return interrupt_controller;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Write a value to a specific bit
-//! \param p_value Reference to value to modify
-//! \param p_bit Bit number
-//! \param p_bit_value Value to write (0 or 1)
-// ----------------------------------------------------------------------------
-inline void bitWrite(int& p_value, int p_bit, int p_bit_value)
-{
-    if (p_bit_value)
-        p_value |= (1 << p_bit);
-    else
-        p_value &= ~(1 << p_bit);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the tone generator
+    //! \return Reference to the tone generator used by tone() and noTone()
+    // ------------------------------------------------------------------------
+    ToneGenerator& getToneGenerator()
+    {
+        return tone_generator;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Get the high byte of an int
-//! \param p_value Value to extract from
-//! \return High byte (bits 8-15)
-// ----------------------------------------------------------------------------
-inline byte highByte(int p_value)
-{
-    return static_cast<byte>((p_value >> 8) & 0xFF);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Get access to the random number generator
+    //! \return Reference to the generator used by random() and randomSeed()
+    // ------------------------------------------------------------------------
+    std::mt19937& getRandomEngine()
+    {
+        return random_engine;
+    }
 
-// ----------------------------------------------------------------------------
-//! \brief Get the low byte of an int
-//! \param p_value Value to extract from
-//! \return Low byte (bits 0-7)
-// ----------------------------------------------------------------------------
-inline byte lowByte(int p_value)
-{
-    return static_cast<byte>(p_value & 0xFF);
-}
+    // ------------------------------------------------------------------------
+    //! \brief Start recording the pin changes into a VCD file.
+    //! \param p_path Path of the VCD file (GTKWave format).
+    //! \return false if the file cannot be created.
+    //!
+    //! Records the digital value of all pins, the PWM duty cycle of the PWM
+    //! pins and the ADC value of the analog pins, timestamped with micros().
+    //! Must not be called while configurePins() is running.
+    // ------------------------------------------------------------------------
+    bool startRecording(std::string const& p_path)
+    {
+        std::vector<VcdPin> signals(pins.size());
+        for (size_t i = 0; i < pins.size(); ++i)
+        {
+            signals[i].pwm_capable = pins[i].pwm_capable;
+            signals[i].analog_channel = -1;
+            signals[i].initial = sample(pins[i], int(i));
+        }
+        for (size_t channel = 0; channel < analog_pins.size(); ++channel)
+        {
+            int pin = analog_pins[channel];
+            if ((pin >= 0) && (size_t(pin) < signals.size()))
+            {
+                signals[size_t(pin)].analog_channel = int(channel);
+            }
+        }
+        return recorder.open(p_path, signals);
+    }
 
-// ----------------------------------------------------------------------------/!
-// \}  //
-// ----------------------------------------------------------------------------
-// // end of GlobalFunctions
+    // ------------------------------------------------------------------------
+    //! \brief Stop recording the pin changes and close the VCD file.
+    // ------------------------------------------------------------------------
+    void stopRecording()
+    {
+        recorder.close();
+    }
 
-/// ============================================================================
-//! \class SerialClass
-//! \brief Arduino-compatible Serial communication class
-//!
-//! Provides the standard Arduino Serial interface for communication.
-//! This is a global object accessed as 'Serial' in Arduino code.
-// ============================================================================
-class SerialClass
-{
-private:
+    // ------------------------------------------------------------------------
+    //! \brief Get access to a specific pin (for web API)
+    //! \param p_pin Pin number (0-19)
+    //! \return Pointer to the Pin object, or nullptr if invalid
+    //!
+    //! Used by the web interface to read pin states.
+    // ------------------------------------------------------------------------
+    Pin* getPin(int p_pin)
+    {
+        return pinAt(p_pin);
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Convert a number to a string in the specified base
-    //! \param p_val Value to convert
-    //! \param p_base Base (BIN=2, OCT=8, DEC=10, HEX=16)
-    //! \return String representation
+    //! \brief Get the number of pins of the emulated board.
     // ------------------------------------------------------------------------
-    std::string numberToBase(long p_val, int p_base) const
+    size_t getPinCount() const
     {
-        if (p_val == 0)
-            return "0";
+        return pins.size();
+    }
 
-        bool negative = p_val < 0;
-        unsigned long val = negative ? static_cast<unsigned long>(-p_val)
-                                     : static_cast<unsigned long>(p_val);
-        unsigned int base = static_cast<unsigned int>(p_base);
-        std::string result;
-        const char* digits = "0123456789ABCDEF";
+    // ------------------------------------------------------------------------
+    //! \brief Get the change sequence number of the pins.
+    //! \return The sequence number of the last pin modification. Pins whose
+    //! Pin::change_seq is greater than a previously returned value changed
+    //! since then. Pins are stamped before their number is published, so no
+    //! change is missed by a reader running concurrently with the sketch.
+    // ------------------------------------------------------------------------
+    uint64_t getPinChangeSeq() const
+    {
+        return pin_change_seq.load(std::memory_order_acquire);
+    }
 
-        while (val > 0)
+    // ------------------------------------------------------------------------
+    //! \brief Record a modification of a pin done directly through getPin().
+    //! \param p_pin Pin number.
+    // ------------------------------------------------------------------------
+    void markPinChanged(int p_pin)
+    {
+        if (Pin* pin = pinAt(p_pin))
         {
-            result = digits[val % base] + result;
-            val /= base;
+            pinChanged(*pin, p_pin);
         }
+    }
 
-        if (negative && p_base == 10)
-            result = "-" + result;
-
-        return result;
+    // ------------------------------------------------------------------------
+    //! \brief Get the pin number of an analog channel.
+    //! \param p_channel Analog channel (0 for A0, 1 for A1 ...).
+    //! \return The pin number or -1 if the channel does not exist.
+    // ------------------------------------------------------------------------
+    int getAnalogPin(int p_channel) const
+    {
+        if (p_channel < 0 || size_t(p_channel) >= analog_pins.size())
+            return -1;
+        return analog_pins[size_t(p_channel)];
     }
 
-public:
+    // ------------------------------------------------------------------------
+    //! \brief Force a pin's value (for simulating external inputs)
+    //! \param p_pin Pin number (0-19)
+    //! \param p_value Value to set (HIGH or LOW)
+    //!
+    //! Used by the web interface to simulate external inputs like button
+    //! presses or sensor readings. Bypasses the normal pinMode restrictions.
+    // ------------------------------------------------------------------------
+    void forcePinValue(int p_pin, int p_value)
+    {
+        if (Pin* pin = pinAt(p_pin))
+        {
+            pin->value = !!p_value;
+            pinChanged(*pin, p_pin);
+            checkInterrupt(*pin, p_pin);
+        }
+    }
 
     // ------------------------------------------------------------------------
-    //! \brief Initialize serial communication
-    //! \param p_baud_rate Baud rate (for compatibility, not enforced in
-    //! simulation)
+    //! \brief Set a pin's analog value (for simulating analog inputs)
+    //! \param p_pin Pin number (0-19)
+    //! \param p_analog_value Analog value to set (0-1023)
+    //!
+    //! Used by the web interface to simulate analog sensor readings.
     // ------------------------------------------------------------------------
-    void begin(int p_baud_rate) const
+    void setAnalogValue(int p_pin, int p_analog_value)
     {
-        arduino_sim.getSerial().begin(p_baud_rate);
+        if (Pin* pin = pinAt(p_pin))
+        {
+            pin->analog_value = p_analog_value;
+            // Also update digital value based on threshold
+            pin->value = (p_analog_value > 512) ? HIGH : LOW;
+            pinChanged(*pin, p_pin);
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a string without newline
-    //! \param p_str Null-terminated string to print
+    //! \brief Set the analog read resolution
+    //! \param p_resolution Resolution in bits (1-32)
     // ------------------------------------------------------------------------
-    void print(const char* p_str) const
+    void setAnalogReadResolution(int p_resolution)
     {
-        arduino_sim.getSerial().print(p_str);
+        analog_read_resolution = p_resolution;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print an integer without newline
-    //! \param p_val Integer to print
+    //! \brief Set the analog write resolution
+    //! \param p_resolution Resolution in bits (1-32)
     // ------------------------------------------------------------------------
-    void print(int p_val) const
+    void setAnalogWriteResolution(int p_resolution)
     {
-        arduino_sim.getSerial().print(std::to_string(p_val).c_str());
+        analog_write_resolution = p_resolution;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a long without newline
-    //! \param p_val Long to print
+    //! \brief Set the analog reference
+    //! \param p_reference Reference type (DEFAULT, INTERNAL, or EXTERNAL)
     // ------------------------------------------------------------------------
-    void print(long p_val) const
+    void setAnalogReference(int p_reference)
     {
-        arduino_sim.getSerial().print(std::to_string(p_val).c_str());
+        analog_reference = p_reference;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a double without newline
-    //! \param p_val Double to print
+    //! \brief Attach an interrupt to a pin
+    //! \param p_pin Pin number
+    //! \param p_function Interrupt callback function
+    //! \param p_mode Interrupt mode (CHANGE, RISING, or FALLING)
     // ------------------------------------------------------------------------
-    void print(double p_val) const
+    void attachInterrupt(int p_pin, void (*p_function)(), int p_mode)
     {
-        arduino_sim.getSerial().print(std::to_string(p_val).c_str());
+        if (Pin* pin = pinAt(p_pin))
+        {
+            interrupt_controller.setHandler(interruptLine(p_pin), p_function);
+            pin->interrupt_mode = p_mode;
+            pin->last_value = pin->value;
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print an integer in a specific format without newline
-    //! \param p_val Integer to print
-    //! \param p_format Format (DEC, HEX, OCT, BIN)
+    //! \brief Detach an interrupt from a pin
+    //! \param p_pin Pin number
     // ------------------------------------------------------------------------
-    void print(int p_val, int p_format) const
+    void detachInterrupt(int p_pin)
     {
-        std::string str = numberToBase(p_val, p_format);
-        arduino_sim.getSerial().print(str.c_str());
+        if (Pin* pin = pinAt(p_pin))
+        {
+            interrupt_controller.setHandler(interruptLine(p_pin), nullptr);
+            pin->interrupt_mode = 0;
+        }
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a long in a specific format without newline
-    //! \param p_val Long to print
-    //! \param p_format Format (DEC, HEX, OCT, BIN)
+    //! \brief Interrupt controller line of a pin.
+    //! \param p_pin Pin number.
+    //!
+    //! Pins 2 and 3 use the INT0 and INT1 vectors as on the Arduino Uno. The
+    //! other pins (pin change interrupts on the AVR) get a line of lower
+    //! priority than all the AVR vectors, ordered by pin number.
     // ------------------------------------------------------------------------
-    void print(long p_val, int p_format) const
+    static size_t interruptLine(int p_pin)
     {
-        std::string str = numberToBase(p_val, p_format);
-        arduino_sim.getSerial().print(str.c_str());
+        if (p_pin == 2)
+            return size_t(INT0_vect_num);
+        if (p_pin == 3)
+            return size_t(INT1_vect_num);
+        return AVR_VECTOR_COUNT + size_t(p_pin);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Write a single byte to serial output
-    //! \param p_byte Byte to write (raw value, not ASCII)
+    //! \brief Safe point of the sketch: execute the pending ISRs (does
+    //! nothing when called from another thread than the sketch one).
     // ------------------------------------------------------------------------
-    void write(uint8_t p_byte) const
+    void serviceInterrupts()
     {
-        arduino_sim.getSerial().write(p_byte);
+        parkIfAbandoned();
+        interrupt_controller.dispatch();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a string with newline
-    //! \param p_str Null-terminated string to print
+    //! \brief Cancellation point of the sketch: execute the pending ISRs,
+    //! then unwind the sketch if it has been cancelled.
+    //! \throw SketchCancelled if the sketch has been cancelled.
     // ------------------------------------------------------------------------
-    void println(const char* p_str) const
+    void cancellationPoint()
     {
-        arduino_sim.getSerial().println(p_str);
+        parkIfAbandoned();
+        interrupt_controller.dispatch();
+        interrupt_controller.checkCancelled();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print an integer with newline
-    //! \param p_val Integer to print
+    //! \brief Delay the sketch while servicing the interrupts.
+    //! \param p_us Microseconds to delay
+    //!
+    //! Emulates Arduino's delayMicroseconds() function.
     // ------------------------------------------------------------------------
-    void println(int p_val) const
+    void delayMicroseconds(long p_us)
     {
-        print(p_val);
-        arduino_sim.getSerial().println();
+        if (timer.clockMode() == ClockMode::Virtual)
+        {
+            // Interrupts raised during the delay are serviced by the safe
+            // point of the timer, at their simulated time.
+            timer.delayMicroseconds(p_us);
+        }
+        else if (p_us > 0)
+        {
+            sleepUntil(std::chrono::steady_clock::now() +
+                       std::chrono::microseconds(p_us));
+        }
+        serviceInterrupts();
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a long with newline
-    //! \param p_val Long to print
+    //! \brief Sleep the sketch thread until a host time, servicing the
+    //! interrupts raised meanwhile.
     // ------------------------------------------------------------------------
-    void println(long p_val) const
+    void sleepUntil(std::chrono::steady_clock::time_point p_deadline)
     {
-        print(p_val);
-        arduino_sim.getSerial().println();
+        // A cancellation ends the sleep: the caller reaches its cancellation
+        // point sooner
+        while (interrupt_controller.waitUntil(p_deadline) &&
+               !interrupt_controller.isCancelled())
+        {
+            serviceInterrupts();
+        }
     }
 
+private:
+
     // ------------------------------------------------------------------------
-    //! \brief Print a double with newline
-    //! \param p_val Double to print
+    //! \brief Check and raise the interrupt of a pin if conditions are met.
+    //! The ISR is executed later by the sketch thread.
+    //! \param pin Pin to check
+    //! \param p_pin Pin number
     // ------------------------------------------------------------------------
-    void println(double p_val) const
+    void checkInterrupt(Pin& pin, int p_pin)
     {
-        print(p_val);
-        arduino_sim.getSerial().println();
+        if (pin.interrupt_mode == 0)
+            return;
+
+        bool trigger = false;
+        int current_value = pin.value;
+        int last = pin.last_value;
+
+        switch (pin.interrupt_mode)
+        {
+            case CHANGE:
+                trigger = (current_value != last);
+                break;
+            case RISING:
+                trigger = (last == LOW && current_value == HIGH);
+                break;
+            case FALLING:
+                trigger = (last == HIGH && current_value == LOW);
+                break;
+            default:
+                break;
+        }
+
+        pin.last_value = current_value;
+
+        if (trigger)
+        {
+            interrupt_controller.raise(interruptLine(p_pin));
+        }
     }
 
+private:
+
     // ------------------------------------------------------------------------
-    //! \brief Print just a newline
+    //! \brief Create a UART timed by the emulator clock.
     // ------------------------------------------------------------------------
-    void println() const
+    SerialEmulator makeUart()
     {
-        arduino_sim.getSerial().println();
+        return SerialEmulator([this]() { return uint64_t(timer.micros()); });
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print an integer in a specific format with newline
-    //! \param p_val Integer to print
-    //! \param p_format Format (DEC, HEX, OCT, BIN)
+    //! \brief Get a pin from its number with bounds checking.
+    //! \param p_pin Pin number.
+    //! \return Pointer to the pin, or nullptr if the pin does not exist.
     // ------------------------------------------------------------------------
-    void println(int p_val, int p_format) const
+    Pin* pinAt(int p_pin)
     {
-        print(p_val, p_format);
-        arduino_sim.getSerial().println();
+        return (size_t(p_pin) < pins.size()) ? &pins[size_t(p_pin)] : nullptr;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Print a long in a specific format with newline
-    //! \param p_val Long to print
-    //! \param p_format Format (DEC, HEX, OCT, BIN)
+    //! \brief Stamp a modified pin with a new change sequence number and
+    //! notify the observer.
     // ------------------------------------------------------------------------
-    void println(long p_val, int p_format) const
+    void pinChanged(Pin& p_pin, int p_number)
     {
-        print(p_val, p_format);
-        arduino_sim.getSerial().println();
+        // The pin is stamped before the number is published: a reader seeing
+        // the new number also sees the stamp. Retry when another thread (the
+        // web server setting a pin) took the number meanwhile.
+        uint64_t seq = pin_change_seq.load(std::memory_order_relaxed);
+        do
+        {
+            p_pin.change_seq.store(seq + 1u, std::memory_order_release);
+        } while (!pin_change_seq.compare_exchange_weak(
+            seq, seq + 1u, std::memory_order_acq_rel));
+        if (recorder.isRecording())
+        {
+            recorder.record(sample(p_pin, p_number));
+        }
+        notify(EmulatorEvent::PinChanged, p_number);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Check if Serial is ready (for compatibility with Leonardo, etc.)
-    //! \return Always true in the emulator
+    //! \brief Timestamped state of a pin for the VCD recorder.
     // ------------------------------------------------------------------------
-    explicit operator bool() const
+    PinSample sample(Pin const& p_pin, int p_number)
     {
-        return true;
+        return PinSample{ uint64_t(timer.micros()),
+                          p_number,
+                          p_pin.value,
+                          p_pin.pwm_value,
+                          p_pin.analog_value };
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Check if data is available
-    //! \return Number of bytes available
+    //! \brief Stamp all pins as modified (after a reset or a new board).
     // ------------------------------------------------------------------------
-    int available() const
+    void markAllPinsChanged()
     {
-        return arduino_sim.getSerial().available();
+        // Same publication order as pinChanged()
+        uint64_t seq = pin_change_seq.load(std::memory_order_relaxed);
+        do
+        {
+            for (auto& pin : pins)
+            {
+                pin.change_seq.store(seq + 1u, std::memory_order_release);
+            }
+        } while (!pin_change_seq.compare_exchange_weak(
+            seq, seq + 1u, std::memory_order_acq_rel));
+        if (recorder.isRecording())
+        {
+            for (size_t i = 0; i < pins.size(); ++i)
+            {
+                recorder.record(sample(pins[i], int(i)));
+            }
+        }
+        notify(EmulatorEvent::PinChanged, -1);
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Read a byte from serial
-    //! \return Byte read, or -1 if none available
+    //! \brief Simulation loop (runs in separate thread)
+    //!
+    //! Fires the timer callbacks while the simulation is running, sleeping
+    //! until the next one is due.
     // ------------------------------------------------------------------------
-    char read() const
+    void simulationLoop()
     {
-        return arduino_sim.getSerial().read();
+        // Timer callbacks use the Arduino API of this board
+        current_emulator = this;
+
+        while (running)
+        {
+            timer.updateCallbacks();
+            timer.waitCallbacks();
+        }
     }
+
+private:
+
+    std::vector<Pin> pins;           ///< All pins indexed by pin number
+    std::vector<int> analog_pins;    ///< Pin numbers of A0, A1 ...
+    std::atomic<uint64_t> pin_change_seq{ 0 }; ///< Last pin change number
+    //! \brief SPI bus emulator
+    SPIBus spi{ [this]() { return uint64_t(timer.micros()); } };
+    I2CBus i2c;                      ///< I2C bus emulator
+    //! \brief EEPROM emulator
+    EEPROMEmulator eeprom{ [this]() { return uint64_t(timer.micros()); } };
+    TimerEmulator timer;             ///< Timer emulator
+    //! \brief Hardware UARTs: Serial, Serial1 ... Serial3
+    std::array<SerialEmulator, MAX_UARTS> uarts{
+        { makeUart(), makeUart(), makeUart(), makeUart() }
+    };
+    size_t uart_count = 1; ///< UARTs of the board
+    //! \brief Pending interrupts, serviced on the sketch thread
+    InterruptController interrupt_controller{
+        [this]() { return uint64_t(timer.micros()); }
+    };
+    AvrTimers avr_timers{ timer, interrupt_controller }; ///< AVR timers
+    ToneGenerator tone_generator;    ///< Audio output of tone()
+    std::mt19937 random_engine{ std::random_device{}() }; ///< random() source
+    VcdRecorder recorder;            ///< Waveform of the pin changes
+    std::atomic<bool> running{ false }; ///< Simulation running state
+    std::thread simulation_thread;   ///< Simulation thread
+    int analog_read_resolution = 10; ///< ADC resolution in bits (default 10)
+    int analog_write_resolution = 8; ///< PWM resolution in bits (default 8)
+    int analog_reference = DEFAULT;  ///< Analog reference type
+    std::function<void(EmulatorEvent, int)>
+        event_handler; ///< Observer of the state changes
 };
 
-/// Global Serial object (Arduino-compatible)
-inline SerialClass Serial;
+/// Default instance, used by the threads not bound to another emulator
+extern ARDUINO_EMULATOR_EXPORT ArduinoEmulator arduino_sim;
+
+// ============================================================================
+//! \brief Return the emulator driven by the Arduino API on the calling thread.
+//! \return The emulator bound by EmulatorScope, else arduino_sim.
+// ============================================================================
+inline ArduinoEmulator& currentEmulator()
+{
+    // Every Arduino API call is a parking point of an abandoned sketch
+    parkIfAbandoned();
+    ArduinoEmulator* emulator = current_emulator;
+    return (emulator != nullptr) ? *emulator : arduino_sim;
+}
 
 // ============================================================================
-//! \class SPIClass
-//! \brief Arduino-compatible SPI communication class
+//! \class EmulatorScope
+//! \brief Bind an emulator to the calling thread for the lifetime of the
+//! scope.
+//!
+//! The Arduino API functions (digitalWrite(), millis(), Serial ...) act on
+//! the emulator bound to the calling thread. To emulate N boards in the same
+//! process, run the setup() and loop() of each board on its own thread and
+//! create an EmulatorScope at the start of the thread:
 //!
-//! Provides the standard Arduino SPI interface for SPI bus communication.
-//! This is a global object accessed as 'SPI' in Arduino code.
+//! \code
+//! std::thread thread([&board]() {
+//!     EmulatorScope scope(board);
+//!     setup();
+//!     for (;;) loop();
+//! });
+//! \endcode
 // ============================================================================
-class SPIClass
+class EmulatorScope
 {
 public:
 
     // ------------------------------------------------------------------------
-    //! \brief Initialize SPI bus
-    // ------------------------------------------------------------------------
-    void begin() const
-    {
-        arduino_sim.getSPI().begin();
-    }
-
-    // ------------------------------------------------------------------------
-    //! \brief Disable SPI bus
+    //! \brief Bind the emulator to the calling thread.
+    //! \param p_emulator Emulator used by the Arduino API in this scope.
     // ------------------------------------------------------------------------
-    void end() const
+    explicit EmulatorScope(ArduinoEmulator& p_emulator)
+        : m_previous(current_emulator)
     {
-        arduino_sim.getSPI().end();
+        current_emulator = &p_emulator;
     }
 
     // ------------------------------------------------------------------------
-    //! \brief Transfer a byte over SPI
-    //! \param p_data Byte to send
-    //! \return Byte received
+    //! \brief Restore the previously bound emulator.
     // ------------------------------------------------------------------------
-    uint8_t transfer(uint8_t p_data) const
+    ~EmulatorScope()
     {
-        return arduino_sim.getSPI().transfer(p_data);
+        current_emulator = m_previous;
     }
-};
 
-/// Global SPI object (Arduino-compatible)
-inline SPIClass SPI;
+    EmulatorScope(EmulatorScope const&) = delete;
+    EmulatorScope& operator=(EmulatorScope const&) = delete;
 
-// ----------------------------------------------------------------------------
-//! \brief Arduino setup function (to be defined by user)
-//!
-//! This function is called once when the program starts.
-//! Define this function in your Arduino sketch.
-// ----------------------------------------------------------------------------
-void setup();
+private:
 
-// ----------------------------------------------------------------------------
-//! \brief Arduino loop function (to be defined by user)
-//!
-//! This function is called repeatedly after setup().
-//! Define this function in your Arduino sketch.
-// ----------------------------------------------------------------------------
-void loop();
\ No newline at end of file
+    //! \brief Emulator bound before this scope
+    ArduinoEmulator* m_previous;
+};
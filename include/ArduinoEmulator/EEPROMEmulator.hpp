@@ -0,0 +1,239 @@
+// ============================================================================
+//! \file EEPROMEmulator.hpp
+//! \brief Emulated EEPROM stored in a memory-mapped file.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include "ArduinoEmulator/MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ============================================================================
+//! \class EEPROMEmulator
+//! \brief EEPROM of the microcontroller, whose content is a file mapped in
+//! memory: the sketch reads and writes the file in place and the content
+//! survives emulator restarts. A new EEPROM is erased (0xFF).
+//!
+//! Each write of a cell is counted in a second mapped file (file path +
+//! ".wear", native 32-bit integers), so that a sketch writing the same cells
+//! in its loop() (a wear hotspot: the AVR EEPROM endures 100,000 writes) is
+//! found after the run. update() only writes the cells whose value changes.
+//! Optionally, a cell write lasts 3.3 ms as on AVR: the next EEPROM access
+//! waits for its end.
+// ============================================================================
+class EEPROMEmulator
+{
+public:
+
+    //! \brief Size of the ATmega328P EEPROM (Uno, Nano).
+    static constexpr size_t DEFAULT_SIZE = 1024;
+    //! \brief Duration of a cell write on AVR in microseconds.
+    static constexpr uint64_t WRITE_TIME_US = 3300;
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor: erased EEPROM in memory until open() is called.
+    //! \param p_clock Emulator time in microseconds, to time the writes.
+    // ------------------------------------------------------------------------
+    explicit EEPROMEmulator(std::function<uint64_t()> const& p_clock)
+        : m_clock(p_clock)
+    {
+        open("", DEFAULT_SIZE);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Store the content in a file, created erased if needed.
+    //! \param p_path File path (empty for memory only).
+    //! \param p_size Size of the EEPROM in bytes.
+    //! \return false if the file or its wear file cannot be mapped (the
+    //! EEPROM is then erased, in memory).
+    // ------------------------------------------------------------------------
+    bool open(std::string const& p_path, size_t p_size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t wear_size = p_size * sizeof(uint32_t);
+        bool opened =
+            m_storage.open(p_path, p_size, 0xFF) &&
+            m_wear.open(p_path.empty() ? p_path : p_path + ".wear", wear_size);
+        if (!opened)
+        {
+            m_storage.open("", p_size, 0xFF);
+            m_wear.open("", wear_size);
+        }
+        m_writes = 0;
+        return opened;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Ask the kernel to write the modified content back to the file.
+    // ------------------------------------------------------------------------
+    void sync()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_storage.sync();
+        m_wear.sync();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Size of the EEPROM in bytes.
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_storage.size();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Path of the file (empty when in memory).
+    // ------------------------------------------------------------------------
+    std::string path() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_storage.path();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Enable the duration of the writes.
+    // ------------------------------------------------------------------------
+    void setWriteLatency(bool p_enabled)
+    {
+        m_write_time_us = p_enabled ? WRITE_TIME_US : 0u;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Duration of a cell write in microseconds (0 = instant).
+    // ------------------------------------------------------------------------
+    uint64_t writeTime() const
+    {
+        return m_write_time_us;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Time left before the end of the pending writes in microseconds.
+    // ------------------------------------------------------------------------
+    uint64_t busyTime() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t now = m_clock();
+        return (m_ready_us > now) ? (m_ready_us - now) : 0u;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Read cells.
+    //! \param p_address First cell.
+    //! \param p_buffer Destination.
+    //! \param p_size Number of cells (the cells beyond the end read 0xFF).
+    // ------------------------------------------------------------------------
+    void read(size_t p_address, void* p_buffer, size_t p_size) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = (p_address < m_storage.size())
+                           ? std::min(p_size, m_storage.size() - p_address)
+                           : 0u;
+        std::memcpy(p_buffer, m_storage.data() + p_address, count);
+        std::memset(static_cast<uint8_t*>(p_buffer) + count,
+                    0xFF,
+                    p_size - count);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write cells.
+    //! \param p_address First cell.
+    //! \param p_data Values.
+    //! \param p_size Number of cells (the cells beyond the end are ignored).
+    //! \param p_update Only write the cells whose value changes.
+    //! \return Number of cells written.
+    // ------------------------------------------------------------------------
+    size_t write(size_t p_address,
+                 void const* p_data,
+                 size_t p_size,
+                 bool p_update)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = (p_address < m_storage.size())
+                           ? std::min(p_size, m_storage.size() - p_address)
+                           : 0u;
+        uint8_t const* values = static_cast<uint8_t const*>(p_data);
+        uint8_t* cells = m_storage.data() + p_address;
+        size_t written = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (p_update && (cells[i] == values[i]))
+                continue;
+
+            // Counters are copied: the mapped bytes are not declared as
+            // integers
+            cells[i] = values[i];
+            uint8_t* counter = m_wear.data() + (p_address + i) * 4u;
+            uint32_t writes;
+            std::memcpy(&writes, counter, sizeof(writes));
+            writes++;
+            std::memcpy(counter, &writes, sizeof(writes));
+            written++;
+        }
+
+        m_writes += written;
+        if (written > 0)
+        {
+            m_ready_us = m_clock() + written * m_write_time_us;
+        }
+        return written;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get a copy of the content.
+    // ------------------------------------------------------------------------
+    std::vector<uint8_t> content() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::vector<uint8_t>(m_storage.data(),
+                                    m_storage.data() + m_storage.size());
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of writes of each cell (across the runs when stored in
+    //! a file).
+    // ------------------------------------------------------------------------
+    std::vector<uint32_t> writeCounts() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<uint32_t> counts(m_wear.size() / sizeof(uint32_t), 0u);
+        std::memcpy(counts.data(), m_wear.data(), m_wear.size());
+        return counts;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of cell writes since open().
+    // ------------------------------------------------------------------------
+    uint64_t writes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_writes;
+    }
+
+private:
+
+    //! \brief Emulator time in microseconds
+    std::function<uint64_t()> m_clock;
+    //! \brief Content of the EEPROM
+    MappedFile m_storage;
+    //! \brief Write counter of each cell
+    MappedFile m_wear;
+    //! \brief Cell writes since open()
+    uint64_t m_writes = 0;
+    //! \brief Duration of a cell write (0 = instant)
+    std::atomic<uint64_t> m_write_time_us{ 0 };
+    //! \brief Emulator time at which the pending writes end
+    uint64_t m_ready_us = 0;
+    //! \brief Serializes the sketch and the threads reading the counters
+    mutable std::mutex m_mutex;
+};
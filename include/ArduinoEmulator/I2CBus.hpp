@@ -0,0 +1,414 @@
+// ============================================================================
+//! \file I2CBus.hpp
+//! \brief Emulated I2C (TWI) bus with pluggable device models.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ============================================================================
+//! \class I2CDevice
+//! \brief Model of a slave device plugged on the I2C bus.
+//!
+//! The bus calls the device once per transaction with all the bytes of the
+//! transaction, never once per byte.
+// ============================================================================
+class I2CDevice
+{
+public:
+
+    virtual ~I2CDevice() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief The master writes bytes (from the START to the STOP).
+    //! \param p_data Bytes written, without the address byte.
+    //! \param p_size Number of bytes (0 for a simple address probe).
+    //! \return false to NACK the data.
+    // ------------------------------------------------------------------------
+    virtual bool write(uint8_t const* p_data, size_t p_size) = 0;
+
+    // ------------------------------------------------------------------------
+    //! \brief The master reads bytes.
+    //! \param p_data Destination of the bytes.
+    //! \param p_size Number of bytes requested.
+    //! \return Number of bytes sent by the device.
+    // ------------------------------------------------------------------------
+    virtual size_t read(uint8_t* p_data, size_t p_size) = 0;
+};
+
+// ============================================================================
+//! \class I2CRegisterDevice
+//! \brief Generic sensor made of a register file, as most I2C chips.
+//!
+//! The first byte written selects the register, the following bytes are
+//! stored from it and reads start from it, the register pointer being
+//! incremented after each byte. Registers can be set and watched from any
+//! thread (web interface, test scripts) while the sketch uses the device.
+// ============================================================================
+class I2CRegisterDevice: public I2CDevice
+{
+public:
+
+    //! \brief Observer of the registers written by the sketch.
+    using WriteCallback = std::function<void(uint8_t, uint8_t)>;
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_size Number of registers (at most 256).
+    // ------------------------------------------------------------------------
+    explicit I2CRegisterDevice(size_t p_size = 256)
+        : m_registers(std::clamp(p_size, size_t(1), size_t(256)), 0u)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set registers, as the chip would update its measures.
+    //! \param p_register First register.
+    //! \param p_values Values stored from the first register.
+    // ------------------------------------------------------------------------
+    void setRegisters(uint8_t p_register, std::vector<uint8_t> const& p_values)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t index = p_register;
+        for (uint8_t value : p_values)
+        {
+            m_registers[index++ % m_registers.size()] = value;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get a copy of all the registers.
+    // ------------------------------------------------------------------------
+    std::vector<uint8_t> registers() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_registers;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the function called for each register written by the
+    //! sketch, with the register and its new value. Called from the sketch
+    //! thread, the device being locked: it can only change the registers
+    //! through its parameters.
+    // ------------------------------------------------------------------------
+    void setWriteCallback(WriteCallback const& p_callback)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_write_callback = p_callback;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Select the register pointer and store the next bytes.
+    // ------------------------------------------------------------------------
+    bool write(uint8_t const* p_data, size_t p_size) override
+    {
+        if (p_size == 0)
+            return true;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pointer = size_t(p_data[0]) % m_registers.size();
+        for (size_t i = 1; i < p_size; ++i)
+        {
+            m_registers[m_pointer] = p_data[i];
+            if (m_write_callback)
+                m_write_callback(uint8_t(m_pointer), p_data[i]);
+            m_pointer = (m_pointer + 1u) % m_registers.size();
+        }
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Send the registers from the register pointer.
+    // ------------------------------------------------------------------------
+    size_t read(uint8_t* p_data, size_t p_size) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < p_size; ++i)
+        {
+            p_data[i] = m_registers[m_pointer];
+            m_pointer = (m_pointer + 1u) % m_registers.size();
+        }
+        return p_size;
+    }
+
+private:
+
+    //! \brief Register file
+    std::vector<uint8_t> m_registers;
+    //! \brief Register accessed by the next byte
+    size_t m_pointer = 0;
+    //! \brief Observer of the writes of the sketch
+    WriteCallback m_write_callback;
+    //! \brief Serializes the sketch and the other threads
+    mutable std::mutex m_mutex;
+};
+
+// ============================================================================
+//! \class I2CBus
+//! \brief I2C bus of the board: the devices plugged on it and the buffers of
+//! the master (the Wire library).
+//!
+//! Like the Wire library of the Arduino core, the master buffers up to
+//! BUFFER_SIZE bytes between beginTransmission() and endTransmission(),
+//! then hands them to the addressed device in a single call. A request
+//! fills the receive buffer in a single call too.
+// ============================================================================
+class I2CBus
+{
+public:
+
+    //! \brief Size of the transmit and receive buffers (BUFFER_LENGTH).
+    static constexpr size_t BUFFER_SIZE = 32;
+    //! \brief Lowest 7-bit address of a device (lower ones are reserved).
+    static constexpr int FIRST_ADDRESS = 0x08;
+    //! \brief Highest 7-bit address of a device (higher ones are reserved).
+    static constexpr int LAST_ADDRESS = 0x77;
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if a device can use an address: 7-bit addresses outside
+    //! 0x08 .. 0x77 are reserved by the I2C specification.
+    // ------------------------------------------------------------------------
+    static bool isDeviceAddress(int p_address)
+    {
+        return (p_address >= FIRST_ADDRESS) && (p_address <= LAST_ADDRESS);
+    }
+
+    //! \brief Status returned by endTransmission().
+    enum Status : uint8_t
+    {
+        Success = 0,
+        AddressNack = 2,
+        DataNack = 3
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Plug a device on the bus, replacing the one at this address.
+    //! \param p_address 7-bit address.
+    //! \param p_device Device model (nullptr to unplug).
+    // ------------------------------------------------------------------------
+    void attach(uint8_t p_address, std::shared_ptr<I2CDevice> p_device)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (p_device)
+        {
+            m_devices[p_address & 0x7Fu] = std::move(p_device);
+        }
+        else
+        {
+            m_devices.erase(p_address & 0x7Fu);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the device plugged at an address (nullptr if none).
+    // ------------------------------------------------------------------------
+    std::shared_ptr<I2CDevice> device(uint8_t p_address) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_devices.find(p_address & 0x7Fu);
+        return (it == m_devices.end()) ? nullptr : it->second;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the addresses of the plugged devices.
+    // ------------------------------------------------------------------------
+    std::vector<uint8_t> addresses() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<uint8_t> result;
+        for (auto const& it : m_devices)
+        {
+            result.push_back(it.first);
+        }
+        return result;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Enable the master and empty its buffers.
+    // ------------------------------------------------------------------------
+    void begin()
+    {
+        m_tx_size = 0;
+        m_rx_size = 0;
+        m_rx_index = 0;
+        m_transmitting = false;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the maximum time Wire waits for data (Stream::setTimeout).
+    //! \param p_ms Timeout in milliseconds (1 s by default).
+    // ------------------------------------------------------------------------
+    void setTimeout(unsigned long p_ms)
+    {
+        m_timeout_ms = p_ms;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the maximum time Wire waits for data in milliseconds.
+    // ------------------------------------------------------------------------
+    unsigned long timeout() const
+    {
+        return m_timeout_ms;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the SCL frequency.
+    //! \param p_hz Frequency in Hz (100 kHz standard mode, 400 kHz fast).
+    // ------------------------------------------------------------------------
+    void setClock(uint32_t p_hz)
+    {
+        if (p_hz > 0)
+            m_clock_hz = p_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the SCL frequency in Hz.
+    // ------------------------------------------------------------------------
+    uint32_t clock() const
+    {
+        return m_clock_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Duration of a transaction on the wires.
+    //! \param p_size Number of data bytes.
+    //! \return Microseconds for START, address, data and STOP (9 clocks per
+    //! byte with its ACK bit, plus one clock for START and STOP).
+    // ------------------------------------------------------------------------
+    uint64_t transferTime(size_t p_size) const
+    {
+        uint64_t clocks = (uint64_t(p_size) + 1u) * 9u + 2u;
+        return (clocks * 1000000u + m_clock_hz - 1u) / m_clock_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Start buffering a write transaction.
+    //! \param p_address 7-bit address of the device.
+    // ------------------------------------------------------------------------
+    void beginTransmission(uint8_t p_address)
+    {
+        m_tx_address = p_address;
+        m_tx_size = 0;
+        m_transmitting = true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Append bytes to the write transaction.
+    //! \return Number of bytes fitting in the buffer.
+    // ------------------------------------------------------------------------
+    size_t queue(uint8_t const* p_data, size_t p_size)
+    {
+        if (!m_transmitting)
+            return 0;
+        size_t count = std::min(p_size, BUFFER_SIZE - m_tx_size);
+        std::memcpy(m_tx_buffer.data() + m_tx_size, p_data, count);
+        m_tx_size += count;
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes of the pending write transaction.
+    // ------------------------------------------------------------------------
+    size_t pendingBytes() const
+    {
+        return m_tx_size;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Send the buffered bytes to the device.
+    //! \return Success, AddressNack if no device answers, or DataNack.
+    // ------------------------------------------------------------------------
+    Status endTransmission()
+    {
+        m_transmitting = false;
+        std::shared_ptr<I2CDevice> target = device(m_tx_address);
+        if (!target)
+            return AddressNack;
+        return target->write(m_tx_buffer.data(), m_tx_size) ? Success
+                                                            : DataNack;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Read bytes from a device into the receive buffer.
+    //! \param p_address 7-bit address of the device.
+    //! \param p_size Number of bytes (at most BUFFER_SIZE).
+    //! \return Number of bytes received (0 if no device answers), never more
+    //! than requested whatever the device model returns.
+    // ------------------------------------------------------------------------
+    size_t requestFrom(uint8_t p_address, size_t p_size)
+    {
+        m_rx_index = 0;
+        m_rx_size = 0;
+        std::shared_ptr<I2CDevice> target = device(p_address);
+        if (target)
+        {
+            size_t size = std::min(p_size, BUFFER_SIZE);
+            m_rx_size = std::min(target->read(m_rx_buffer.data(), size), size);
+        }
+        return m_rx_size;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of received bytes not yet read.
+    // ------------------------------------------------------------------------
+    size_t available() const
+    {
+        return m_rx_size - m_rx_index;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Extract received bytes.
+    //! \return Number of bytes extracted.
+    // ------------------------------------------------------------------------
+    size_t read(uint8_t* p_data, size_t p_size)
+    {
+        size_t count = std::min(p_size, available());
+        std::memcpy(p_data, m_rx_buffer.data() + m_rx_index, count);
+        m_rx_index += count;
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Next received byte without extracting it (-1 if none).
+    // ------------------------------------------------------------------------
+    int peek() const
+    {
+        return (available() == 0) ? -1 : m_rx_buffer[m_rx_index];
+    }
+
+private:
+
+    //! \brief Devices by address
+    std::map<uint8_t, std::shared_ptr<I2CDevice>> m_devices;
+    //! \brief Serializes the sketch and the threads plugging devices
+    mutable std::mutex m_mutex;
+    //! \brief SCL frequency in Hz
+    uint32_t m_clock_hz = 100000u;
+    //! \brief Maximum time Wire waits for data in milliseconds
+    unsigned long m_timeout_ms = 1000;
+    //! \brief Address of the pending write transaction
+    uint8_t m_tx_address = 0;
+    //! \brief Between beginTransmission() and endTransmission()
+    bool m_transmitting = false;
+    //! \brief Bytes of the pending write transaction
+    std::array<uint8_t, BUFFER_SIZE> m_tx_buffer{};
+    //! \brief Number of bytes in the transmit buffer
+    size_t m_tx_size = 0;
+    //! \brief Bytes received by the last request
+    std::array<uint8_t, BUFFER_SIZE> m_rx_buffer{};
+    //! \brief Number of bytes in the receive buffer
+    size_t m_rx_size = 0;
+    //! \brief Next received byte to read
+    size_t m_rx_index = 0;
+};
@@ -0,0 +1,98 @@
+// ============================================================================
+//! \file MappedFile.hpp
+//! \brief Host file mapped in memory, backing the emulated non-volatile
+//! memories.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ============================================================================
+//! \class MappedFile
+//! \brief Storage of an emulated memory chip: a host file mapped in memory,
+//! so that the sketch reads and writes the file without serialization nor
+//! intermediate copy, and its content survives emulator restarts.
+//!
+//! Without file path, the storage is anonymous memory lost at exit. New bytes
+//! are zeros, left as file holes so that only the written blocks use disk
+//! space. A non-zero fill value (0xFF, the erased state of the EEPROM and the
+//! SPI flash) is written instead: such files are fully allocated.
+// ============================================================================
+class MappedFile
+{
+public:
+
+    MappedFile() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief Destructor: unmap the file (its content is kept).
+    // ------------------------------------------------------------------------
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    // ------------------------------------------------------------------------
+    //! \brief Map a file, creating or extending it if shorter than the
+    //! requested size.
+    //! \param p_path File path (empty for anonymous memory).
+    //! \param p_size Number of bytes to map.
+    //! \param p_fill Value of the bytes added to the file (a non-zero value
+    //! writes them, so they use disk space).
+    //! \return false if the file cannot be mapped (the previous mapping is
+    //! closed anyway).
+    // ------------------------------------------------------------------------
+    bool open(std::string const& p_path, size_t p_size, uint8_t p_fill = 0);
+
+    // ------------------------------------------------------------------------
+    //! \brief Unmap the file. The kernel writes back the modified pages.
+    // ------------------------------------------------------------------------
+    void close();
+
+    // ------------------------------------------------------------------------
+    //! \brief Ask the kernel to write back the modified pages now (without
+    //! waiting for the disk).
+    // ------------------------------------------------------------------------
+    void sync();
+
+    // ------------------------------------------------------------------------
+    //! \brief Mapped bytes (nullptr when closed).
+    // ------------------------------------------------------------------------
+    uint8_t* data() const
+    {
+        return m_data;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of mapped bytes.
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Mapped file path (empty for anonymous memory).
+    // ------------------------------------------------------------------------
+    std::string const& path() const
+    {
+        return m_path;
+    }
+
+private:
+
+    //! \brief Mapped bytes
+    uint8_t* m_data = nullptr;
+    //! \brief Number of mapped bytes
+    size_t m_size = 0;
+    //! \brief Mapped file path
+    std::string m_path;
+};
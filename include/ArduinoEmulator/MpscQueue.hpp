@@ -0,0 +1,144 @@
+// ============================================================================
+//! \file MpscQueue.hpp
+//! \brief Bounded lock-free multi-producer/single-consumer queue.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// ============================================================================
+//! \class MpscQueue
+//! \brief Bounded FIFO for any number of producer threads and one consumer
+//! thread.
+//!
+//! Each slot of the preallocated storage carries a sequence number telling
+//! whether it is free or holds an element (Dmitry Vyukov's bounded queue).
+//! Producers reserve a slot with a single compare-and-swap and never wait:
+//! when the queue is full, push() fails and the element is counted as
+//! dropped.
+//!
+//! \tparam T Trivially copyable element type.
+// ============================================================================
+template <typename T>
+class MpscQueue
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_capacity Minimum number of elements (rounded up to the next
+    //! power of two).
+    // ------------------------------------------------------------------------
+    explicit MpscQueue(size_t p_capacity)
+    {
+        size_t capacity = 2;
+        while (capacity < p_capacity)
+            capacity <<= 1;
+        m_slots = std::make_unique<Slot[]>(capacity);
+        m_mask = capacity - 1;
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Producer: append an element.
+    //! \param p_value Element to append.
+    //! \return false if the queue is full (the element is dropped).
+    // ------------------------------------------------------------------------
+    bool push(T const& p_value)
+    {
+        size_t position = m_head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[position & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) -
+                        static_cast<intptr_t>(position);
+            if (diff == 0)
+            {
+                // Slot free: try to reserve it
+                if (m_head.compare_exchange_weak(position,
+                                                 position + 1,
+                                                 std::memory_order_relaxed))
+                {
+                    slot.value = p_value;
+                    slot.sequence.store(position + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                // Slot not yet consumed: full
+                m_dropped.fetch_add(1u, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                // Another producer took this slot
+                position = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: extract the oldest element.
+    //! \param p_value [out] Extracted element.
+    //! \return false if the queue is empty.
+    // ------------------------------------------------------------------------
+    bool pop(T& p_value)
+    {
+        Slot& slot = m_slots[m_tail & m_mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != m_tail + 1)
+            return false;
+
+        p_value = slot.value;
+        slot.sequence.store(m_tail + m_mask + 1, std::memory_order_release);
+        ++m_tail;
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of elements lost because the queue was full.
+    // ------------------------------------------------------------------------
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Maximum number of elements.
+    // ------------------------------------------------------------------------
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+
+    //! \brief Element storage and its state.
+    struct Slot
+    {
+        std::atomic<size_t> sequence{ 0 };
+        T value{};
+    };
+
+    //! \brief Storage (power of two size)
+    std::unique_ptr<Slot[]> m_slots;
+    //! \brief Storage size minus one, to wrap indices
+    size_t m_mask = 0;
+    //! \brief Next slot to reserve by producers
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    //! \brief Next slot to read (only modified by the consumer)
+    alignas(64) size_t m_tail = 0;
+    //! \brief Elements lost on overflow
+    std::atomic<uint64_t> m_dropped{ 0 };
+};
@@ -0,0 +1,326 @@
+// ============================================================================
+//! \file RingBuffer.hpp
+//! \brief Bounded lock-free single-producer/single-consumer byte ring.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// ============================================================================
+//! \brief What RingBuffer::write() does when the ring is full.
+// ============================================================================
+enum class OverflowPolicy
+{
+    //! \brief Drop the bytes not fitting in the ring and count them.
+    Drop,
+    //! \brief Sleep until the consumer makes room (or until close()).
+    Block
+};
+
+// ============================================================================
+//! \class RingBuffer
+//! \brief Bounded byte FIFO for exactly one producer thread and one consumer
+//! thread.
+//!
+//! Head and tail are free-running indices published with acquire/release
+//! atomics, so neither side takes a lock, except to wake up a producer
+//! sleeping on a full ring with the Block policy. Reads and writes are done
+//! in bulk with at most two memcpy (when the data wraps around the end of
+//! the storage).
+// ============================================================================
+class RingBuffer
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_capacity Minimum capacity in bytes (rounded up to the next
+    //! power of two).
+    //! \param p_policy Behavior when the ring is full.
+    // ------------------------------------------------------------------------
+    explicit RingBuffer(size_t p_capacity,
+                        OverflowPolicy p_policy = OverflowPolicy::Drop)
+        : m_policy(p_policy)
+    {
+        size_t capacity = 1;
+        while (capacity < p_capacity)
+            capacity <<= 1;
+        m_data.resize(capacity);
+        m_mask = capacity - 1;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Producer: append bytes to the ring.
+    //! \param p_data Bytes to append.
+    //! \param p_size Number of bytes.
+    //! \return Number of bytes stored. Bytes which did not fit are added to
+    //! the dropped counter.
+    // ------------------------------------------------------------------------
+    size_t write(const void* p_data, size_t p_size)
+    {
+        auto const* src = static_cast<uint8_t const*>(p_data);
+        size_t written = tryWrite(src, p_size);
+
+        if (m_policy == OverflowPolicy::Block)
+        {
+            while ((written < p_size) && !m_closed.load())
+            {
+                waitSpace();
+                written += tryWrite(src + written, p_size - written);
+            }
+        }
+
+        if (written < p_size)
+        {
+            m_dropped.fetch_add(p_size - written, std::memory_order_relaxed);
+        }
+        return written;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: extract bytes from the ring.
+    //! \param p_data Destination buffer.
+    //! \param p_size Maximum number of bytes to extract.
+    //! \return Number of bytes extracted.
+    // ------------------------------------------------------------------------
+    size_t read(void* p_data, size_t p_size)
+    {
+        size_t count = peek(p_data, p_size);
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + count,
+                     std::memory_order_release);
+        wakeProducer();
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: copy bytes without extracting them.
+    //! \param p_data Destination buffer.
+    //! \param p_size Maximum number of bytes to copy.
+    //! \return Number of bytes copied.
+    // ------------------------------------------------------------------------
+    size_t peek(void* p_data, size_t p_size) const
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t count = std::min(p_size, head - tail);
+        if (count == 0)
+            return 0;
+
+        auto* dst = static_cast<uint8_t*>(p_data);
+        size_t offset = tail & m_mask;
+        size_t first = std::min(count, m_data.size() - offset);
+        std::memcpy(dst, m_data.data() + offset, first);
+        std::memcpy(dst + first, m_data.data(), count - first);
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: hand the pending bytes to a sink without copying them.
+    //! \param p_sink Called with each contiguous slice of the storage (at most
+    //! two), as size_t(uint8_t const* data, size_t size). Returns the number
+    //! of bytes it has consumed.
+    //! \return Number of bytes extracted.
+    // ------------------------------------------------------------------------
+    template <typename Sink>
+    size_t drain(Sink&& p_sink)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (count < head - tail)
+        {
+            size_t offset = (tail + count) & m_mask;
+            size_t slice = std::min(head - tail - count,
+                                    m_data.size() - offset);
+            size_t consumed = p_sink(m_data.data() + offset, slice);
+            count += consumed;
+            if (consumed < slice)
+                break;
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        wakeProducer();
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Producer: let a source write straight into the free storage.
+    //! \param p_source Called with each contiguous free slice of the storage
+    //! (at most two), as size_t(uint8_t* data, size_t size). Returns the
+    //! number of bytes it has stored.
+    //! \return Number of bytes appended.
+    // ------------------------------------------------------------------------
+    template <typename Source>
+    size_t fill(Source&& p_source)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t free = m_data.size() - (head - tail);
+        size_t count = 0;
+        while (count < free)
+        {
+            size_t offset = (head + count) & m_mask;
+            size_t slice = std::min(free - count, m_data.size() - offset);
+            size_t stored = p_source(m_data.data() + offset, slice);
+            count += stored;
+            if (stored < slice)
+                break;
+        }
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: discard all pending bytes.
+    // ------------------------------------------------------------------------
+    void clear()
+    {
+        m_tail.store(m_head.load(std::memory_order_acquire),
+                     std::memory_order_release);
+        wakeProducer();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wake up and refuse a producer blocked on a full ring.
+    // ------------------------------------------------------------------------
+    void close()
+    {
+        m_closed = true;
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+        }
+        m_wait_cond.notify_all();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Accept blocking writes again after close().
+    // ------------------------------------------------------------------------
+    void open()
+    {
+        m_closed = false;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes waiting to be read.
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) -
+               m_tail.load(std::memory_order_acquire);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes which can be written without overflow.
+    // ------------------------------------------------------------------------
+    size_t space() const
+    {
+        return m_data.size() - size();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Total storage in bytes.
+    // ------------------------------------------------------------------------
+    size_t capacity() const
+    {
+        return m_data.size();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Change the overflow policy (not while a write is in progress).
+    // ------------------------------------------------------------------------
+    void setOverflowPolicy(OverflowPolicy p_policy)
+    {
+        m_policy = p_policy;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of bytes lost because the ring was full.
+    // ------------------------------------------------------------------------
+    uint64_t dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Producer: sleep until the ring has room or is closed.
+    // ------------------------------------------------------------------------
+    void waitSpace()
+    {
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        m_waiting.fetch_add(1u);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_wait_cond.wait(lock,
+                         [this]() { return (space() > 0) || m_closed.load(); });
+        m_waiting.fetch_sub(1u);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Consumer: wake up the producer sleeping in waitSpace(), if any.
+    //! The fence orders the tail update before the check of the sleeper, as
+    //! the sleeper orders its registration before the check of the tail.
+    // ------------------------------------------------------------------------
+    void wakeProducer()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed) == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+        }
+        m_wait_cond.notify_one();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Producer: store as many bytes as possible without waiting.
+    // ------------------------------------------------------------------------
+    size_t tryWrite(uint8_t const* p_src, size_t p_size)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t count = std::min(p_size, m_data.size() - (head - tail));
+        if (count == 0)
+            return 0;
+
+        size_t offset = head & m_mask;
+        size_t first = std::min(count, m_data.size() - offset);
+        std::memcpy(m_data.data() + offset, p_src, first);
+        std::memcpy(m_data.data(), p_src + first, count - first);
+
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+
+    //! \brief Storage (power of two size)
+    std::vector<uint8_t> m_data;
+    //! \brief Storage size minus one, to wrap indices
+    size_t m_mask = 0;
+    //! \brief Behavior when full
+    OverflowPolicy m_policy;
+    //! \brief Next write index (only modified by the producer)
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    //! \brief Next read index (only modified by the consumer)
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    //! \brief Bytes lost on overflow
+    std::atomic<uint64_t> m_dropped{ 0 };
+    //! \brief Release blocked producers
+    std::atomic<bool> m_closed{ false };
+    //! \brief Producers sleeping in waitSpace()
+    std::atomic<size_t> m_waiting{ 0 };
+    //! \brief Protects the sleep in waitSpace()
+    std::mutex m_wait_mutex;
+    //! \brief Wakes up waitSpace()
+    std::condition_variable m_wait_cond;
+};
@@ -0,0 +1,521 @@
+// ============================================================================
+//! \file SPIBus.hpp
+//! \brief Emulated SPI bus with device models selected by chip-select pins.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// ============================================================================
+//! \class SPIDevice
+//! \brief Model of a slave device plugged on the SPI bus, selected when its
+//! chip-select (CS) pin is driven LOW.
+// ============================================================================
+class SPIDevice
+{
+public:
+
+    virtual ~SPIDevice() = default;
+
+    // ------------------------------------------------------------------------
+    //! \brief The CS pin went LOW: a transaction starts.
+    // ------------------------------------------------------------------------
+    virtual void select() {}
+
+    // ------------------------------------------------------------------------
+    //! \brief The CS pin went HIGH: the transaction ends.
+    // ------------------------------------------------------------------------
+    virtual void deselect() {}
+
+    // ------------------------------------------------------------------------
+    //! \brief Exchange bytes with the master (full duplex).
+    //! \param p_data [in] Bytes sent by the master (MOSI), [out] bytes sent
+    //! by the device (MISO).
+    //! \param p_size Number of bytes.
+    // ------------------------------------------------------------------------
+    virtual void transfer(uint8_t* p_data, size_t p_size) = 0;
+};
+
+// ============================================================================
+//! \class SPIRegisterDevice
+//! \brief Register-mapped sensor, as most SPI sensors (BME280, ADXL345 ...).
+//!
+//! The first byte of a transaction is the register address, its bit 7 telling
+//! a read (1) or a write (0). The following bytes are read from or written to
+//! the registers, the address being incremented after each byte. Registers
+//! can be set from any thread while the sketch uses the device.
+// ============================================================================
+class SPIRegisterDevice: public SPIDevice
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_size Number of registers (at most 128).
+    // ------------------------------------------------------------------------
+    explicit SPIRegisterDevice(size_t p_size = 128)
+        : m_registers(std::clamp(p_size, size_t(1), size_t(128)), 0u)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set registers, as the chip would update its measures.
+    //! \param p_register First register.
+    //! \param p_values Values stored from the first register.
+    // ------------------------------------------------------------------------
+    void setRegisters(uint8_t p_register, std::vector<uint8_t> const& p_values)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t index = p_register;
+        for (uint8_t value : p_values)
+        {
+            m_registers[index++ % m_registers.size()] = value;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get a copy of all the registers.
+    // ------------------------------------------------------------------------
+    std::vector<uint8_t> registers() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_registers;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait for the address byte.
+    // ------------------------------------------------------------------------
+    void select() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_addressed = false;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Decode the address byte then read or write the registers.
+    // ------------------------------------------------------------------------
+    void transfer(uint8_t* p_data, size_t p_size) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < p_size; ++i)
+        {
+            if (!m_addressed)
+            {
+                m_reading = (p_data[i] & 0x80u) != 0u;
+                m_pointer = size_t(p_data[i] & 0x7Fu) % m_registers.size();
+                m_addressed = true;
+                p_data[i] = 0xFFu;
+                continue;
+            }
+            if (m_reading)
+            {
+                p_data[i] = m_registers[m_pointer];
+            }
+            else
+            {
+                m_registers[m_pointer] = p_data[i];
+                p_data[i] = 0xFFu;
+            }
+            m_pointer = (m_pointer + 1u) % m_registers.size();
+        }
+    }
+
+private:
+
+    //! \brief Register file
+    std::vector<uint8_t> m_registers;
+    //! \brief Register accessed by the next byte
+    size_t m_pointer = 0;
+    //! \brief The address byte of the transaction has been received
+    bool m_addressed = false;
+    //! \brief The transaction reads the registers
+    bool m_reading = false;
+    //! \brief Serializes the sketch and the other threads
+    mutable std::mutex m_mutex;
+};
+
+// ============================================================================
+//! \class SPIFramebufferDevice
+//! \brief Display controller receiving pixels: the bytes written by the
+//! sketch fill a fixed-size framebuffer, wrapping to its start once full.
+//!
+//! Commands and pixels are not told apart: send the commands in their own
+//! transaction to keep them out of the framebuffer, or reset the cursor.
+// ============================================================================
+class SPIFramebufferDevice: public SPIDevice
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_size Size of the framebuffer in bytes (i.e. 1024 for a
+    //! 128x64 monochrome OLED).
+    // ------------------------------------------------------------------------
+    explicit SPIFramebufferDevice(size_t p_size)
+        : m_frame(std::max(p_size, size_t(1)), 0u)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get a copy of the framebuffer.
+    // ------------------------------------------------------------------------
+    std::vector<uint8_t> frame() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frame;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of times the framebuffer has been filled.
+    // ------------------------------------------------------------------------
+    uint64_t frames() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_frames;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Write the next bytes at the start of the framebuffer.
+    // ------------------------------------------------------------------------
+    void resetCursor()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cursor = 0;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Store the bytes at the cursor (MISO stays high).
+    // ------------------------------------------------------------------------
+    void transfer(uint8_t* p_data, size_t p_size) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (p_size > 0)
+        {
+            size_t count = std::min(p_size, m_frame.size() - m_cursor);
+            std::memcpy(m_frame.data() + m_cursor, p_data, count);
+            std::memset(p_data, 0xFF, count);
+            m_cursor += count;
+            if (m_cursor == m_frame.size())
+            {
+                m_cursor = 0;
+                m_frames++;
+            }
+            p_data += count;
+            p_size -= count;
+        }
+    }
+
+private:
+
+    //! \brief Pixels
+    std::vector<uint8_t> m_frame;
+    //! \brief Position of the next byte
+    size_t m_cursor = 0;
+    //! \brief Number of complete frames
+    uint64_t m_frames = 0;
+    //! \brief Serializes the sketch and the other threads
+    mutable std::mutex m_mutex;
+};
+
+// ============================================================================
+//! \class SPIBus
+//! \brief SPI bus of the board: the devices plugged on it, selected by their
+//! chip-select pin, and a bounded trace of the last transfers.
+//!
+//! A transfer goes to the selected device (the one with the lowest CS pin if
+//! the sketch selects several); without selected device, MISO is pulled up
+//! and reads 0xFF. The trace keeps the last TRACE_SIZE transfers with their
+//! first bytes, so streaming to a display does not grow the memory.
+// ============================================================================
+class SPIBus
+{
+public:
+
+    //! \brief Number of transfers kept in the trace.
+    static constexpr size_t TRACE_SIZE = 256;
+    //! \brief Number of bytes of a transfer kept in the trace.
+    static constexpr size_t TRACE_BYTES = 16;
+    //! \brief SCK frequency of the Arduino core (SPI_CLOCK_DIV4 at 16 MHz).
+    static constexpr uint32_t DEFAULT_CLOCK_HZ = 4000000u;
+
+    //! \brief Transfer recorded in the trace.
+    struct Transfer
+    {
+        //! \brief Emulator time in microseconds.
+        uint64_t time_us = 0;
+        //! \brief CS pin of the selected device (-1 if none).
+        int cs_pin = -1;
+        //! \brief Number of bytes exchanged.
+        size_t size = 0;
+        //! \brief First bytes sent by the master.
+        std::array<uint8_t, TRACE_BYTES> mosi{};
+        //! \brief First bytes sent by the device.
+        std::array<uint8_t, TRACE_BYTES> miso{};
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_clock Emulator time in microseconds, to date the trace.
+    // ------------------------------------------------------------------------
+    explicit SPIBus(std::function<uint64_t()> const& p_clock)
+        : m_clock(p_clock)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Enable the SPI bus.
+    // ------------------------------------------------------------------------
+    void begin()
+    {
+        m_enabled = true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Disable the SPI bus.
+    // ------------------------------------------------------------------------
+    void end()
+    {
+        m_enabled = false;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Board reset: disable the bus at its default clock and release
+    //! the chip selects, as the pull-ups of the devices do while the MCU
+    //! pins float. Devices are kept plugged and the trace is kept.
+    // ------------------------------------------------------------------------
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_enabled = false;
+        m_clock_hz = DEFAULT_CLOCK_HZ;
+        m_lsb_first = false;
+        m_data_mode = 0u;
+        for (int cs_pin : m_selected)
+        {
+            m_devices[cs_pin]->deselect();
+        }
+        m_selected.clear();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the SCK frequency.
+    //! \param p_hz Frequency in Hz (4 MHz by default).
+    // ------------------------------------------------------------------------
+    void setClock(uint32_t p_hz)
+    {
+        if (p_hz > 0)
+            m_clock_hz = p_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the SCK frequency in Hz.
+    // ------------------------------------------------------------------------
+    uint32_t clock() const
+    {
+        return m_clock_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the bit order and the data mode of the transaction.
+    //! \param p_lsb_first Least significant bit first (LSBFIRST): the words
+    //! are sent least significant byte first.
+    //! \param p_data_mode Clock polarity and phase (SPI_MODE0 by default).
+    // ------------------------------------------------------------------------
+    void setFormat(bool p_lsb_first, uint8_t p_data_mode)
+    {
+        m_lsb_first = p_lsb_first;
+        m_data_mode = p_data_mode;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if the transaction sends the least significant bit
+    //! first.
+    // ------------------------------------------------------------------------
+    bool lsbFirst() const
+    {
+        return m_lsb_first;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the data mode of the transaction (clock polarity and
+    //! phase).
+    // ------------------------------------------------------------------------
+    uint8_t dataMode() const
+    {
+        return m_data_mode;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Duration of a transfer on the wires in microseconds (8 clocks
+    //! per byte).
+    // ------------------------------------------------------------------------
+    uint64_t transferTime(size_t p_size) const
+    {
+        return (uint64_t(p_size) * 8000000u + m_clock_hz - 1u) / m_clock_hz;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Plug a device on the bus, replacing the one on this CS pin.
+    //! \param p_cs_pin Chip-select pin of the device.
+    //! \param p_device Device model (nullptr to unplug).
+    // ------------------------------------------------------------------------
+    void attach(int p_cs_pin, std::shared_ptr<SPIDevice> p_device)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (p_device)
+        {
+            m_devices[p_cs_pin] = std::move(p_device);
+        }
+        else
+        {
+            m_devices.erase(p_cs_pin);
+            m_selected.erase(p_cs_pin);
+        }
+        m_has_devices = !m_devices.empty();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the device plugged on a CS pin (nullptr if none).
+    // ------------------------------------------------------------------------
+    std::shared_ptr<SPIDevice> device(int p_cs_pin) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_devices.find(p_cs_pin);
+        return (it == m_devices.end()) ? nullptr : it->second;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the CS pins of the plugged devices.
+    // ------------------------------------------------------------------------
+    std::vector<int> chipSelects() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<int> result;
+        for (auto const& it : m_devices)
+        {
+            result.push_back(it.first);
+        }
+        return result;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Follow the digital level of a pin: select or deselect the
+    //! device plugged on it.
+    //! \param p_pin Pin number.
+    //! \param p_value New level (LOW selects the device).
+    // ------------------------------------------------------------------------
+    void chipSelect(int p_pin, int p_value)
+    {
+        // Called on each digitalWrite(): skip the lock without devices.
+        if (!m_has_devices.load(std::memory_order_relaxed))
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_devices.find(p_pin);
+        if (it == m_devices.end())
+            return;
+
+        if (p_value == 0)
+        {
+            if (m_selected.insert(p_pin).second)
+                it->second->select();
+        }
+        else if (m_selected.erase(p_pin) > 0)
+        {
+            it->second->deselect();
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Exchange bytes with the selected device, in place.
+    //! \param p_data [in] MOSI bytes, [out] MISO bytes.
+    //! \param p_size Number of bytes.
+    // ------------------------------------------------------------------------
+    void transfer(uint8_t* p_data, size_t p_size)
+    {
+        if (!m_enabled || (p_size == 0))
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Transfer& record = m_trace[m_trace_count++ % TRACE_SIZE];
+        record.time_us = m_clock();
+        record.size = p_size;
+        size_t traced = std::min(p_size, TRACE_BYTES);
+        std::memcpy(record.mosi.data(), p_data, traced);
+
+        if (m_selected.empty())
+        {
+            record.cs_pin = -1;
+            std::memset(p_data, 0xFF, p_size);
+        }
+        else
+        {
+            record.cs_pin = *m_selected.begin();
+            m_devices[record.cs_pin]->transfer(p_data, p_size);
+        }
+        std::memcpy(record.miso.data(), p_data, traced);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the last transfers, oldest first.
+    // ------------------------------------------------------------------------
+    std::vector<Transfer> trace() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = std::min<size_t>(m_trace_count, TRACE_SIZE);
+        std::vector<Transfer> result;
+        result.reserve(count);
+        for (uint64_t i = m_trace_count - count; i < m_trace_count; ++i)
+        {
+            result.push_back(m_trace[i % TRACE_SIZE]);
+        }
+        return result;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Total number of transfers since the start.
+    // ------------------------------------------------------------------------
+    uint64_t transfers() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_trace_count;
+    }
+
+private:
+
+    //! \brief Emulator time in microseconds
+    std::function<uint64_t()> m_clock;
+    //! \brief SPI enabled state
+    bool m_enabled = false;
+    //! \brief SCK frequency in Hz
+    uint32_t m_clock_hz = DEFAULT_CLOCK_HZ;
+    //! \brief Least significant bit first
+    bool m_lsb_first = false;
+    //! \brief Clock polarity and phase
+    uint8_t m_data_mode = 0u;
+    //! \brief Devices by CS pin
+    std::map<int, std::shared_ptr<SPIDevice>> m_devices;
+    //! \brief At least one device is plugged
+    std::atomic<bool> m_has_devices{ false };
+    //! \brief CS pins driven LOW (sorted)
+    std::set<int> m_selected;
+    //! \brief Last transfers (circular)
+    std::array<Transfer, TRACE_SIZE> m_trace{};
+    //! \brief Number of transfers recorded
+    uint64_t m_trace_count = 0;
+    //! \brief Serializes the sketch and the threads plugging devices
+    mutable std::mutex m_mutex;
+};
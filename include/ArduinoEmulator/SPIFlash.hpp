@@ -0,0 +1,201 @@
+// ============================================================================
+//! \file SPIFlash.hpp
+//! \brief Emulated SPI NOR flash stored in a memory-mapped image file.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include "ArduinoEmulator/MappedFile.hpp"
+#include "ArduinoEmulator/SPIBus.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ============================================================================
+//! \class SPIFlashDevice
+//! \brief SPI NOR flash following the Winbond W25Q command set, as used by
+//! the data-logger libraries (SerialFlash, SPIMemory, LittleFS ...).
+//!
+//! Commands: read (0x03), fast read (0x0B), page program (0x02), 4 KB sector
+//! erase (0x20), 32 KB and 64 KB block erase (0x52, 0xD8), chip erase (0xC7,
+//! 0x60), write enable/disable (0x06, 0x04), read status (0x05), JEDEC ID
+//! (0x9F) and 4-byte addressing (0xB7, 0xE9) for chips above 16 MB. Other
+//! commands are ignored. As on the chip, programming only clears bits, erases
+//! set them back to 1 and need the write enable latch, and the chip is busy
+//! (status bit 0) during the program and erase times at the emulator clock.
+//!
+//! The content lives in a memory-mapped image file, read and programmed in
+//! place by the SPI transfers. The image holds the flash bytes as they are,
+//! so it can be written to or read from a real chip: a new image is erased
+//! (0xFF). It is therefore not sparse: the whole capacity uses disk space,
+//! and erases write their sectors instead of freeing them. The number of erases of each 4 KB sector is counted in a second
+//! mapped file (image path + ".wear", native 32-bit integers) to analyze the
+//! wear across runs.
+// ============================================================================
+class SPIFlashDevice: public SPIDevice
+{
+public:
+
+    //! \brief Programming unit: a page program wraps inside its page.
+    static constexpr size_t PAGE_SIZE = 256;
+    //! \brief Smallest erase unit, whose erases are counted.
+    static constexpr size_t SECTOR_SIZE = 4096;
+    //! \brief Smallest capacity (W25X05).
+    static constexpr size_t MIN_SIZE = 64u * 1024u;
+    //! \brief Largest capacity (W25Q256): bigger chips do not follow the
+    //! JEDEC capacity code log2(size).
+    static constexpr size_t MAX_SIZE = 32u * 1024u * 1024u;
+
+    //! \brief Duration of the internal operations (zero = instant).
+    struct Timings
+    {
+        //! \brief Page program in microseconds.
+        uint64_t page_program_us = 700;
+        //! \brief 4 KB sector erase in microseconds.
+        uint64_t sector_erase_us = 45000;
+        //! \brief 32 KB or 64 KB block erase in microseconds.
+        uint64_t block_erase_us = 150000;
+        //! \brief Chip erase in microseconds.
+        uint64_t chip_erase_us = 40000000;
+    };
+
+    //! \brief Traffic since the start.
+    struct Stats
+    {
+        //! \brief Bytes read by the sketch.
+        uint64_t read_bytes = 0;
+        //! \brief Bytes programmed by the sketch.
+        uint64_t programmed_bytes = 0;
+        //! \brief Sectors erased (a block erase counts all its sectors).
+        uint64_t erased_sectors = 0;
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor: blank chip in memory until open() is called.
+    //! \param p_clock Emulator time in microseconds, to time the busy state.
+    //! \param p_size Capacity in bytes, rounded up to a power of two within
+    //! MIN_SIZE .. MAX_SIZE. The JEDEC ID is the one of the Winbond chip of
+    //! this size.
+    // ------------------------------------------------------------------------
+    SPIFlashDevice(std::function<uint64_t()> const& p_clock,
+                   size_t p_size = 16u * 1024u * 1024u);
+
+    // ------------------------------------------------------------------------
+    //! \brief Store the content in an image file, created blank if needed.
+    //! \param p_image Image file path (empty for memory only).
+    //! \return false if the image or its wear file cannot be mapped.
+    // ------------------------------------------------------------------------
+    bool open(std::string const& p_image);
+
+    // ------------------------------------------------------------------------
+    //! \brief Ask the kernel to write the modified content back to the image.
+    // ------------------------------------------------------------------------
+    void sync();
+
+    // ------------------------------------------------------------------------
+    //! \brief Capacity in bytes.
+    // ------------------------------------------------------------------------
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief JEDEC ID: manufacturer, memory type and capacity bytes.
+    // ------------------------------------------------------------------------
+    uint32_t jedecId() const
+    {
+        return m_jedec_id;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Set the duration of the internal operations.
+    // ------------------------------------------------------------------------
+    void setTimings(Timings const& p_timings);
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of erases of each 4 KB sector.
+    // ------------------------------------------------------------------------
+    std::vector<uint32_t> eraseCounts() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Get the traffic since the start.
+    // ------------------------------------------------------------------------
+    Stats getStats() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Read the flash content, as the host would dump the chip.
+    //! \param p_address First byte.
+    //! \param p_buffer Destination.
+    //! \param p_size Number of bytes (stops at the end of the chip).
+    //! \return Number of bytes read.
+    // ------------------------------------------------------------------------
+    size_t dump(size_t p_address, uint8_t* p_buffer, size_t p_size) const;
+
+    void select() override;
+    void deselect() override;
+    void transfer(uint8_t* p_data, size_t p_size) override;
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Handle the byte of the current command after its opcode.
+    //! \return Number of bytes consumed from p_data (the data phases of the
+    //! read and program commands handle the whole remaining buffer).
+    // ------------------------------------------------------------------------
+    size_t command(uint8_t* p_data, size_t p_size);
+
+    // ------------------------------------------------------------------------
+    //! \brief Erase the sectors of a range, as the chip does at CS high.
+    // ------------------------------------------------------------------------
+    void erase(size_t p_address, size_t p_size, uint64_t p_duration_us);
+
+    // ------------------------------------------------------------------------
+    //! \brief Read the status register (busy and write enable latch bits).
+    // ------------------------------------------------------------------------
+    uint8_t status() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of address bytes of the commands.
+    // ------------------------------------------------------------------------
+    size_t addressBytes() const
+    {
+        return m_four_byte ? 4u : 3u;
+    }
+
+private:
+
+    //! \brief Emulator time in microseconds
+    std::function<uint64_t()> m_clock;
+    //! \brief Capacity in bytes
+    size_t m_size;
+    //! \brief JEDEC ID
+    uint32_t m_jedec_id;
+    //! \brief Content of the chip, as is (erased bytes are 0xFF)
+    MappedFile m_storage;
+    //! \brief Erase counter of each sector
+    MappedFile m_wear;
+    //! \brief Duration of the internal operations
+    Timings m_timings;
+    //! \brief Traffic since the start
+    Stats m_stats;
+    //! \brief Opcode of the current command (-1 before the opcode)
+    int m_command = -1;
+    //! \brief Bytes received after the opcode
+    size_t m_received = 0;
+    //! \brief Address of the command, then of the next data byte
+    size_t m_address = 0;
+    //! \brief Write enable latch
+    bool m_write_enabled = false;
+    //! \brief 4-byte address mode
+    bool m_four_byte = false;
+    //! \brief Emulator time at which the program or erase ends
+    uint64_t m_busy_until = 0;
+    //! \brief Serializes the sketch and the threads reading the counters
+    mutable std::mutex m_mutex;
+};
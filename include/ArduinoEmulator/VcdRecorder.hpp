@@ -0,0 +1,396 @@
+// ============================================================================
+//! \file VcdRecorder.hpp
+//! \brief Record the pin changes into a Value Change Dump (VCD) file.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#pragma once
+
+#include "ArduinoEmulator/MpscQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+//! \brief State of a pin at a given time.
+// ============================================================================
+struct PinSample
+{
+    //! \brief Emulator time in microseconds.
+    uint64_t time_us;
+    //! \brief Pin number.
+    int32_t pin;
+    //! \brief Digital value.
+    int32_t value;
+    //! \brief PWM duty cycle.
+    int32_t pwm_value;
+    //! \brief ADC value.
+    int32_t analog_value;
+};
+
+// ============================================================================
+//! \brief Signals of a pin to declare in the VCD file.
+// ============================================================================
+struct VcdPin
+{
+    //! \brief Record the PWM duty cycle.
+    bool pwm_capable;
+    //! \brief Analog channel of the pin (-1 if none) to record the ADC value.
+    int analog_channel;
+    //! \brief State of the pin when the recording starts.
+    PinSample initial;
+};
+
+// ============================================================================
+//! \class VcdRecorder
+//! \brief Stream timestamped pin changes into a VCD file viewable with
+//! GTKWave.
+//!
+//! Recording a change only copies a PinSample into a preallocated lock-free
+//! queue, so it can be called from the sketch and the web threads. A
+//! background thread formats the changes and writes them to the file. When
+//! the writer cannot keep up, changes are dropped and counted in a comment
+//! at the end of the file.
+//!
+//! When the emulator time restarts from 0 (simulation restarted during the
+//! recording), the new times are offset by the last written time so that the
+//! trace goes on after the previous run instead of piling up on its end.
+// ============================================================================
+class VcdRecorder
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_capacity Number of changes buffered before dropping.
+    // ------------------------------------------------------------------------
+    explicit VcdRecorder(size_t p_capacity = 65536) : m_capacity(p_capacity)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Destructor: flush and close the file.
+    // ------------------------------------------------------------------------
+    ~VcdRecorder()
+    {
+        close();
+    }
+
+    VcdRecorder(VcdRecorder const&) = delete;
+    VcdRecorder& operator=(VcdRecorder const&) = delete;
+
+    // ------------------------------------------------------------------------
+    //! \brief Create the VCD file and start recording.
+    //! \param p_path Path of the VCD file.
+    //! \param p_pins Signals of each pin (indexed by pin number).
+    //! \return false if the file cannot be created.
+    // ------------------------------------------------------------------------
+    bool open(std::string const& p_path, std::vector<VcdPin> const& p_pins)
+    {
+        close();
+
+        m_file.open(p_path, std::ios::out | std::ios::trunc);
+        if (!m_file.is_open())
+        {
+            std::cerr << "Error: Cannot create VCD file: " << p_path << "\n";
+            return false;
+        }
+
+        // The queue is never freed while the recorder lives: a producer may
+        // still be pushing a late change after close().
+        if (!m_queue)
+        {
+            m_queue = std::make_unique<MpscQueue<PinSample>>(m_capacity);
+        }
+        PinSample stale;
+        while (m_queue->pop(stale))
+        {
+        }
+        m_dropped_at_open = m_queue->dropped();
+
+        writeHeader(p_pins);
+        m_file << m_buffer;
+        m_buffer.clear();
+
+        m_stop = false;
+        m_recording.store(true, std::memory_order_release);
+        m_writer = std::thread(&VcdRecorder::writerLoop, this);
+        return true;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Stop recording, flush the pending changes and close the file.
+    // ------------------------------------------------------------------------
+    void close()
+    {
+        m_recording.store(false, std::memory_order_release);
+        if (!m_writer.joinable())
+            return;
+
+        m_stop = true;
+        m_writer.join();
+
+        uint64_t dropped = m_queue->dropped() - m_dropped_at_open;
+        if (dropped > 0)
+        {
+            m_file << "$comment " << dropped << " changes dropped $end\n";
+        }
+        m_file.close();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if changes are being recorded.
+    // ------------------------------------------------------------------------
+    bool isRecording() const
+    {
+        return m_recording.load(std::memory_order_relaxed);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Mark the restart of the emulator time from 0: the following
+    //! changes are written after the changes already recorded.
+    // ------------------------------------------------------------------------
+    void restartTime()
+    {
+        record(PinSample{ 0u, TIME_RESTART, 0, 0, 0 });
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Record the new state of a pin (callable from any thread).
+    //! \param p_sample State of the pin.
+    // ------------------------------------------------------------------------
+    void record(PinSample const& p_sample)
+    {
+        if (m_recording.load(std::memory_order_acquire))
+        {
+            m_queue->push(p_sample);
+        }
+    }
+
+private:
+
+    //! \brief Pin number of the sample marking a restart of the time.
+    static constexpr int32_t TIME_RESTART = -1;
+
+    //! \brief Last written values and VCD identifiers of a pin.
+    struct Signals
+    {
+        PinSample last;
+        std::string value_id;
+        std::string pwm_id;
+        std::string analog_id;
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Build the short VCD identifier of the nth signal.
+    // ------------------------------------------------------------------------
+    static std::string identifier(size_t p_index)
+    {
+        // Printable ASCII characters from '!' to '~'
+        std::string id;
+        do
+        {
+            id += char('!' + (p_index % 94u));
+            p_index /= 94u;
+        } while (p_index > 0u);
+        return id;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Append a binary vector value change to the buffer.
+    // ------------------------------------------------------------------------
+    void writeVector(int32_t p_value, std::string const& p_id)
+    {
+        auto value = static_cast<uint32_t>(p_value);
+        m_buffer += 'b';
+        bool leading = true;
+        for (int bit = 31; bit >= 0; --bit)
+        {
+            bool set = ((value >> bit) & 1u) != 0u;
+            if (set || !leading || (bit == 0))
+            {
+                m_buffer += set ? '1' : '0';
+                leading = false;
+            }
+        }
+        m_buffer += ' ';
+        m_buffer += p_id;
+        m_buffer += '\n';
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Declare the signals and dump their initial values.
+    // ------------------------------------------------------------------------
+    void writeHeader(std::vector<VcdPin> const& p_pins)
+    {
+        std::time_t now = std::time(nullptr);
+        char date[64] = { 0 };
+        std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S",
+                      std::localtime(&now));
+
+        m_buffer = std::string("$date ") + date + " $end\n";
+        m_buffer += "$version Arduino Emulator $end\n";
+        m_buffer += "$timescale 1us $end\n";
+        m_buffer += "$scope module board $end\n";
+
+        size_t count = 0;
+        m_signals.assign(p_pins.size(), Signals());
+        for (size_t i = 0; i < p_pins.size(); ++i)
+        {
+            Signals& signals = m_signals[i];
+            std::string number = std::to_string(i);
+
+            signals.value_id = identifier(count++);
+            m_buffer += "$var wire 1 " + signals.value_id + " D" + number +
+                        " $end\n";
+            if (p_pins[i].pwm_capable)
+            {
+                signals.pwm_id = identifier(count++);
+                m_buffer += "$var integer 32 " + signals.pwm_id + " PWM" +
+                            number + " $end\n";
+            }
+            if (p_pins[i].analog_channel >= 0)
+            {
+                signals.analog_id = identifier(count++);
+                m_buffer += "$var integer 32 " + signals.analog_id + " A" +
+                            std::to_string(p_pins[i].analog_channel) +
+                            " $end\n";
+            }
+        }
+        m_buffer += "$upscope $end\n$enddefinitions $end\n";
+
+        m_last_time = 0;
+        m_time_offset = 0;
+        m_buffer += "#0\n$dumpvars\n";
+        for (size_t i = 0; i < p_pins.size(); ++i)
+        {
+            Signals& signals = m_signals[i];
+            signals.last = p_pins[i].initial;
+            m_buffer += (signals.last.value != 0) ? '1' : '0';
+            m_buffer += signals.value_id + '\n';
+            if (!signals.pwm_id.empty())
+                writeVector(signals.last.pwm_value, signals.pwm_id);
+            if (!signals.analog_id.empty())
+                writeVector(signals.last.analog_value, signals.analog_id);
+        }
+        m_buffer += "$end\n";
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Append the signals of a pin which differ from the last written
+    //! values.
+    // ------------------------------------------------------------------------
+    void writeSample(PinSample const& p_sample)
+    {
+        if (p_sample.pin == TIME_RESTART)
+        {
+            m_time_offset = m_last_time;
+            return;
+        }
+        if ((p_sample.pin < 0) || (size_t(p_sample.pin) >= m_signals.size()))
+            return;
+
+        Signals& signals = m_signals[size_t(p_sample.pin)];
+        bool value = (p_sample.value != signals.last.value);
+        bool pwm = !signals.pwm_id.empty() &&
+                   (p_sample.pwm_value != signals.last.pwm_value);
+        bool analog = !signals.analog_id.empty() &&
+                      (p_sample.analog_value != signals.last.analog_value);
+        if (!value && !pwm && !analog)
+            return;
+
+        // Changes of several threads can arrive slightly out of order: VCD
+        // time shall never go backward.
+        uint64_t time = m_time_offset + p_sample.time_us;
+        if (time > m_last_time)
+        {
+            m_last_time = time;
+            m_buffer += '#' + std::to_string(m_last_time) + '\n';
+        }
+
+        if (value)
+        {
+            m_buffer += (p_sample.value != 0) ? '1' : '0';
+            m_buffer += signals.value_id + '\n';
+        }
+        if (pwm)
+            writeVector(p_sample.pwm_value, signals.pwm_id);
+        if (analog)
+            writeVector(p_sample.analog_value, signals.analog_id);
+        signals.last = p_sample;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Background thread draining the queue into the file.
+    // ------------------------------------------------------------------------
+    void writerLoop()
+    {
+        const size_t flush_size = 64u * 1024u;
+        PinSample sample;
+
+        for (;;)
+        {
+            // Read the flag before draining so that changes pushed before
+            // close() are written.
+            bool stopping = m_stop.load();
+            bool idle = true;
+            while (m_queue->pop(sample))
+            {
+                writeSample(sample);
+                idle = false;
+                if (m_buffer.size() >= flush_size)
+                {
+                    m_file << m_buffer;
+                    m_buffer.clear();
+                }
+            }
+
+            if (stopping)
+                break;
+            if (idle)
+            {
+                // Keep the file usable if the process is killed
+                m_file << m_buffer << std::flush;
+                m_buffer.clear();
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        m_file << m_buffer;
+        m_buffer.clear();
+    }
+
+private:
+
+    //! \brief Number of buffered changes
+    size_t m_capacity;
+    //! \brief Changes waiting to be written
+    std::unique_ptr<MpscQueue<PinSample>> m_queue;
+    //! \brief Drop counter of the queue when the recording started
+    uint64_t m_dropped_at_open = 0;
+    //! \brief Changes are accepted
+    std::atomic<bool> m_recording{ false };
+    //! \brief Request the writer thread to finish
+    std::atomic<bool> m_stop{ false };
+    //! \brief Writer thread
+    std::thread m_writer;
+    //! \brief VCD file
+    std::ofstream m_file;
+    //! \brief Text waiting to be written in the file
+    std::string m_buffer;
+    //! \brief Signals of each pin (only used by the writer thread)
+    std::vector<Signals> m_signals;
+    //! \brief Time of the last written change
+    uint64_t m_last_time = 0;
+    //! \brief Added to the emulator time since its last restart
+    uint64_t m_time_offset = 0;
+};
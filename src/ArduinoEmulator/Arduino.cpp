@@ -0,0 +1,637 @@
+// ============================================================================
+//! \file Arduino.cpp
+//! \brief Implementation of the Arduino API on the emulator bound to the
+//! calling thread
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#include "ArduinoEmulator/ArduinoEmulator.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <random>
+#include <utility>
+
+// ----------------------------------------------------------------------------
+ARDUINO_EMULATOR_EXPORT std::array<IsrHandler, AVR_VECTOR_COUNT> isr_vectors{};
+ARDUINO_EMULATOR_EXPORT ArduinoEmulator arduino_sim;
+ARDUINO_EMULATOR_EXPORT SerialClass Serial(0);
+ARDUINO_EMULATOR_EXPORT SerialClass Serial1(1);
+ARDUINO_EMULATOR_EXPORT SerialClass Serial2(2);
+ARDUINO_EMULATOR_EXPORT SerialClass Serial3(3);
+ARDUINO_EMULATOR_EXPORT SPIClass SPI;
+ARDUINO_EMULATOR_EXPORT TwoWire Wire;
+ARDUINO_EMULATOR_EXPORT EEPROMClass EEPROM;
+
+// ----------------------------------------------------------------------------
+void pinMode(int p_pin, int p_mode)
+{
+    currentEmulator().pinMode(p_pin, p_mode);
+}
+
+// ----------------------------------------------------------------------------
+void digitalWrite(int p_pin, int p_value)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.serviceInterrupts();
+    board.digitalWrite(p_pin, p_value);
+}
+
+// ----------------------------------------------------------------------------
+int digitalRead(int p_pin)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.cancellationPoint();
+    return board.digitalRead(p_pin);
+}
+
+// ----------------------------------------------------------------------------
+void analogWrite(int p_pin, int p_value)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.serviceInterrupts();
+    board.analogWrite(p_pin, p_value);
+}
+
+// ----------------------------------------------------------------------------
+int analogRead(int p_pin)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.cancellationPoint();
+    return board.analogRead(p_pin);
+}
+
+// ----------------------------------------------------------------------------
+long millis()
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.cancellationPoint();
+    return board.getTimer().millis();
+}
+
+// ----------------------------------------------------------------------------
+long micros()
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.cancellationPoint();
+    return board.getTimer().micros();
+}
+
+// ----------------------------------------------------------------------------
+void delay(long p_ms)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.delayMicroseconds(p_ms * 1000);
+    board.cancellationPoint();
+}
+
+// ----------------------------------------------------------------------------
+void delayMicroseconds(int p_us)
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.delayMicroseconds(p_us);
+    board.cancellationPoint();
+}
+
+// ----------------------------------------------------------------------------
+long pulseIn(int p_pin, int p_state, long p_timeout)
+{
+    (void)p_timeout; // Unused in simulation
+    // Simple simulation: return a value based on current pin state
+    ArduinoEmulator& board = currentEmulator();
+    int pin_value = board.digitalRead(p_pin);
+    if (pin_value == p_state)
+    {
+        // Return a simulated pulse duration
+        std::uniform_int_distribution<long> dist(1000, 1499);
+        return dist(board.getRandomEngine()); // 1000-1499 microseconds
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void analogReadResolution(int p_resolution)
+{
+    currentEmulator().setAnalogReadResolution(p_resolution);
+}
+
+// ----------------------------------------------------------------------------
+void analogWriteResolution(int p_resolution)
+{
+    currentEmulator().setAnalogWriteResolution(p_resolution);
+}
+
+// ----------------------------------------------------------------------------
+void analogReference(int p_reference)
+{
+    currentEmulator().setAnalogReference(p_reference);
+}
+
+// ----------------------------------------------------------------------------
+void interrupts()
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.getInterruptController().enable();
+    board.serviceInterrupts();
+}
+
+// ----------------------------------------------------------------------------
+void noInterrupts()
+{
+    currentEmulator().getInterruptController().disable();
+}
+
+// ----------------------------------------------------------------------------
+void attachInterrupt(int p_pin, void (*p_function)(), int p_mode)
+{
+    currentEmulator().attachInterrupt(p_pin, p_function, p_mode);
+}
+
+// ----------------------------------------------------------------------------
+void detachInterrupt(int p_pin)
+{
+    currentEmulator().detachInterrupt(p_pin);
+}
+
+// ----------------------------------------------------------------------------
+void tone(int p_pin, int p_frequency)
+{
+    ArduinoEmulator& board = currentEmulator();
+
+    // Auto-configure pin as OUTPUT if not already configured
+    Pin const* pin = board.getPin(p_pin);
+    if (pin && !pin->configured)
+    {
+        board.pinMode(p_pin, OUTPUT);
+    }
+
+    board.digitalWrite(p_pin, HIGH);
+    board.getToneGenerator().playTone(p_frequency, p_pin);
+    board.notify(EmulatorEvent::ToneChanged, p_pin);
+}
+
+// ----------------------------------------------------------------------------
+void tone(int p_pin, int p_frequency, long p_duration)
+{
+    ArduinoEmulator& board = currentEmulator();
+
+    // Auto-configure pin as OUTPUT if not already configured
+    Pin const* pin = board.getPin(p_pin);
+    if (pin && !pin->configured)
+    {
+        board.pinMode(p_pin, OUTPUT);
+    }
+
+    board.digitalWrite(p_pin, HIGH);
+    board.getToneGenerator().playTone(p_frequency, p_pin);
+    board.notify(EmulatorEvent::ToneChanged, p_pin);
+    board.getTimer().delay(p_duration);
+    board.getToneGenerator().stopTone();
+    board.notify(EmulatorEvent::ToneChanged, p_pin);
+    board.digitalWrite(p_pin, LOW);
+}
+
+// ----------------------------------------------------------------------------
+void noTone(int p_pin)
+{
+    ArduinoEmulator& board = currentEmulator();
+
+    board.getToneGenerator().stopTone();
+    board.notify(EmulatorEvent::ToneChanged, p_pin);
+    board.digitalWrite(p_pin, LOW);
+}
+
+// ----------------------------------------------------------------------------
+long random(long p_max)
+{
+    std::uniform_int_distribution<long> dist(0, p_max - 1);
+    return dist(currentEmulator().getRandomEngine());
+}
+
+// ----------------------------------------------------------------------------
+long random(long p_min, long p_max)
+{
+    std::uniform_int_distribution<long> dist(p_min, p_max - 1);
+    return dist(currentEmulator().getRandomEngine());
+}
+
+// ----------------------------------------------------------------------------
+void randomSeed(unsigned long p_seed)
+{
+    currentEmulator().getRandomEngine().seed(p_seed);
+}
+
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint8_t>& avrTimer0()
+{
+    return currentEmulator().getAvrTimers().timer0;
+}
+
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint16_t>& avrTimer1()
+{
+    return currentEmulator().getAvrTimers().timer1;
+}
+
+// ----------------------------------------------------------------------------
+AvrTimerRegisters<uint8_t>& avrTimer2()
+{
+    return currentEmulator().getAvrTimers().timer2;
+}
+
+// ----------------------------------------------------------------------------
+void SerialClass::begin(int p_baud_rate)
+{
+    // The UARTs missing on the board stay disabled
+    ArduinoEmulator& board = currentEmulator();
+    if (m_port < board.getUartCount())
+    {
+        board.getSerial(m_port).begin(p_baud_rate);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void SerialClass::end()
+{
+    currentEmulator().getSerial(m_port).end();
+}
+
+// ----------------------------------------------------------------------------
+size_t SerialClass::write(uint8_t p_byte)
+{
+    return write(&p_byte, 1u);
+}
+
+// ----------------------------------------------------------------------------
+size_t SerialClass::write(const uint8_t* p_buffer, size_t p_size)
+{
+    ArduinoEmulator& board = currentEmulator();
+    SerialEmulator& serial = board.getSerial(m_port);
+    size_t count = serial.write(p_buffer, p_size);
+    if (serial.getTiming() != UartTiming::Blocking)
+        return count;
+
+    // Wait for the TX FIFO to drain, as the Arduino core does when its
+    // buffer is full. The delay services the interrupts.
+    while (count < p_size)
+    {
+        uint64_t wait_us = serial.txWaitTime(1u);
+        if (wait_us == 0)
+            break;
+        board.delayMicroseconds(long(wait_us));
+        count += serial.write(p_buffer + count, p_size - count);
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+int SerialClass::availableForWrite()
+{
+    size_t room = currentEmulator().getSerial(m_port).availableForWrite();
+    return int(std::min<size_t>(room, INT_MAX));
+}
+
+// ----------------------------------------------------------------------------
+void SerialClass::flush()
+{
+    ArduinoEmulator& board = currentEmulator();
+    uint64_t wait_us =
+        board.getSerial(m_port).txWaitTime(SerialEmulator::TX_FIFO_SIZE);
+    if (wait_us > 0)
+    {
+        board.delayMicroseconds(long(wait_us));
+    }
+}
+
+// ----------------------------------------------------------------------------
+void SerialClass::setTimeout(unsigned long p_timeout)
+{
+    currentEmulator().getSerial(m_port).setTimeout(p_timeout);
+}
+
+// ----------------------------------------------------------------------------
+unsigned long SerialClass::getTimeout() const
+{
+    return currentEmulator().getSerial(m_port).timeout();
+}
+
+// ----------------------------------------------------------------------------
+int SerialClass::available()
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.cancellationPoint();
+    return board.getSerial(m_port).available();
+}
+
+// ----------------------------------------------------------------------------
+int SerialClass::read()
+{
+    uint8_t c;
+    if (currentEmulator().getSerial(m_port).read(&c, 1u) == 0)
+        return -1;
+    return c;
+}
+
+// ----------------------------------------------------------------------------
+int SerialClass::peek()
+{
+    uint8_t c;
+    if (currentEmulator().getSerial(m_port).peek(&c, 1u) == 0)
+        return -1;
+    return c;
+}
+
+// ----------------------------------------------------------------------------
+size_t SerialClass::readBytes(char* p_buffer, size_t p_length)
+{
+    SerialEmulator& serial = currentEmulator().getSerial(m_port);
+    size_t count = 0;
+    while (count < p_length)
+    {
+        count += serial.read(p_buffer + count, p_length - count);
+        if ((count == p_length) || !waitAvailable())
+            break;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+size_t SerialClass::readBytesUntil(char p_terminator,
+                                   char* p_buffer,
+                                   size_t p_length)
+{
+    SerialEmulator& serial = currentEmulator().getSerial(m_port);
+    size_t count = 0;
+    while (count < p_length)
+    {
+        // Look for the terminator in the received bytes, then only extract
+        // the bytes up to it
+        size_t size = serial.peek(p_buffer + count, p_length - count);
+        void* end = std::memchr(p_buffer + count, p_terminator, size);
+        if (end != nullptr)
+        {
+            size = size_t(static_cast<char*>(end) - (p_buffer + count));
+            serial.read(p_buffer + count, size + 1u);
+            return count + size;
+        }
+        count += serial.read(p_buffer + count, size);
+        if ((count == p_length) || !waitAvailable())
+            break;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+// Let the simulated time pass during an SPI transfer (virtual clock only, as
+// for I2C)
+static void waitSPITransfer(ArduinoEmulator& p_board, size_t p_size)
+{
+    if (p_board.getTimer().clockMode() == ClockMode::Virtual)
+    {
+        p_board.delayMicroseconds(
+            long(p_board.getSPI().transferTime(p_size)));
+    }
+}
+
+// ----------------------------------------------------------------------------
+void SPIClass::begin() const
+{
+    currentEmulator().getSPI().begin();
+}
+
+// ----------------------------------------------------------------------------
+void SPIClass::end() const
+{
+    currentEmulator().getSPI().end();
+}
+
+// ----------------------------------------------------------------------------
+void SPIClass::beginTransaction(SPISettings const& p_settings) const
+{
+    SPIBus& spi = currentEmulator().getSPI();
+    spi.setClock(p_settings.clock);
+    spi.setFormat(p_settings.bit_order == LSBFIRST, p_settings.data_mode);
+}
+
+// ----------------------------------------------------------------------------
+uint8_t SPIClass::transfer(uint8_t p_data) const
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.getSPI().transfer(&p_data, 1u);
+    waitSPITransfer(board, 1u);
+    return p_data;
+}
+
+// ----------------------------------------------------------------------------
+uint16_t SPIClass::transfer16(uint16_t p_data) const
+{
+    bool lsb_first = currentEmulator().getSPI().lsbFirst();
+    uint8_t bytes[2] = { uint8_t(p_data >> 8), uint8_t(p_data) };
+    if (lsb_first)
+    {
+        std::swap(bytes[0], bytes[1]);
+    }
+    transfer(bytes, 2u);
+    if (lsb_first)
+    {
+        std::swap(bytes[0], bytes[1]);
+    }
+    return uint16_t((bytes[0] << 8) | bytes[1]);
+}
+
+// ----------------------------------------------------------------------------
+void SPIClass::transfer(void* p_buffer, size_t p_count) const
+{
+    ArduinoEmulator& board = currentEmulator();
+    board.getSPI().transfer(static_cast<uint8_t*>(p_buffer), p_count);
+    waitSPITransfer(board, p_count);
+}
+
+// ----------------------------------------------------------------------------
+// Let the simulated time pass during an I2C transaction (virtual clock only:
+// with the real time, the transaction is much faster than the host sleeps)
+static void waitI2CTransfer(ArduinoEmulator& p_board, size_t p_size)
+{
+    if (p_board.getTimer().clockMode() == ClockMode::Virtual)
+    {
+        p_board.delayMicroseconds(
+            long(p_board.getI2C().transferTime(p_size)));
+    }
+}
+
+// ----------------------------------------------------------------------------
+void TwoWire::begin()
+{
+    currentEmulator().getI2C().begin();
+}
+
+// ----------------------------------------------------------------------------
+void TwoWire::end()
+{
+    // Forget the pending transaction and the received bytes
+    currentEmulator().getI2C().begin();
+}
+
+// ----------------------------------------------------------------------------
+void TwoWire::setClock(uint32_t p_hz)
+{
+    currentEmulator().getI2C().setClock(p_hz);
+}
+
+// ----------------------------------------------------------------------------
+void TwoWire::beginTransmission(uint8_t p_address)
+{
+    currentEmulator().getI2C().beginTransmission(p_address);
+}
+
+// ----------------------------------------------------------------------------
+uint8_t TwoWire::endTransmission(bool /* p_send_stop */)
+{
+    ArduinoEmulator& board = currentEmulator();
+    size_t size = board.getI2C().pendingBytes();
+    uint8_t status = board.getI2C().endTransmission();
+    waitI2CTransfer(board, size);
+    return status;
+}
+
+// ----------------------------------------------------------------------------
+uint8_t TwoWire::requestFrom(uint8_t p_address,
+                             uint8_t p_quantity,
+                             bool /* p_send_stop */)
+{
+    ArduinoEmulator& board = currentEmulator();
+    size_t size = board.getI2C().requestFrom(p_address, p_quantity);
+    waitI2CTransfer(board, size);
+    return uint8_t(size);
+}
+
+// ----------------------------------------------------------------------------
+size_t TwoWire::write(uint8_t p_byte)
+{
+    return currentEmulator().getI2C().queue(&p_byte, 1u);
+}
+
+// ----------------------------------------------------------------------------
+size_t TwoWire::write(const uint8_t* p_buffer, size_t p_size)
+{
+    return currentEmulator().getI2C().queue(p_buffer, p_size);
+}
+
+// ----------------------------------------------------------------------------
+void TwoWire::setTimeout(unsigned long p_timeout)
+{
+    currentEmulator().getI2C().setTimeout(p_timeout);
+}
+
+// ----------------------------------------------------------------------------
+unsigned long TwoWire::getTimeout() const
+{
+    return currentEmulator().getI2C().timeout();
+}
+
+// ----------------------------------------------------------------------------
+int TwoWire::available()
+{
+    return int(currentEmulator().getI2C().available());
+}
+
+// ----------------------------------------------------------------------------
+int TwoWire::read()
+{
+    uint8_t c;
+    if (currentEmulator().getI2C().read(&c, 1u) == 0)
+        return -1;
+    return c;
+}
+
+// ----------------------------------------------------------------------------
+int TwoWire::peek()
+{
+    return currentEmulator().getI2C().peek();
+}
+
+// ----------------------------------------------------------------------------
+size_t TwoWire::readBytes(char* p_buffer, size_t p_length)
+{
+    return currentEmulator().getI2C().read(
+        reinterpret_cast<uint8_t*>(p_buffer), p_length);
+}
+
+// ----------------------------------------------------------------------------
+// Wait for the end of the pending EEPROM writes but the last p_keep_us
+// (virtual clock only, as for I2C). As on AVR, an access waits for the
+// previous write, and a block write waits for each cell but the last one.
+static void waitEEPROM(ArduinoEmulator& p_board, uint64_t p_keep_us)
+{
+    if (p_board.getTimer().clockMode() == ClockMode::Virtual)
+    {
+        uint64_t busy = p_board.getEEPROM().busyTime();
+        if (busy > p_keep_us)
+        {
+            p_board.delayMicroseconds(long(busy - p_keep_us));
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+EEPROMClass::Ref::operator uint8_t() const
+{
+    return EEPROM.read(m_address);
+}
+
+// ----------------------------------------------------------------------------
+EEPROMClass::Ref& EEPROMClass::Ref::operator=(uint8_t p_value)
+{
+    EEPROM.write(m_address, p_value);
+    return *this;
+}
+
+// ----------------------------------------------------------------------------
+uint8_t EEPROMClass::read(int p_address) const
+{
+    uint8_t value;
+    readBlock(p_address, &value, 1u);
+    return value;
+}
+
+// ----------------------------------------------------------------------------
+void EEPROMClass::write(int p_address, uint8_t p_value)
+{
+    ArduinoEmulator& board = currentEmulator();
+    waitEEPROM(board, 0u);
+    board.getEEPROM().write(size_t(p_address), &p_value, 1u, false);
+}
+
+// ----------------------------------------------------------------------------
+void EEPROMClass::update(int p_address, uint8_t p_value)
+{
+    updateBlock(p_address, &p_value, 1u);
+}
+
+// ----------------------------------------------------------------------------
+uint16_t EEPROMClass::length() const
+{
+    return uint16_t(currentEmulator().getEEPROM().size());
+}
+
+// ----------------------------------------------------------------------------
+void EEPROMClass::readBlock(int p_address, void* p_buffer, size_t p_size) const
+{
+    ArduinoEmulator& board = currentEmulator();
+    waitEEPROM(board, 0u);
+    board.getEEPROM().read(size_t(p_address), p_buffer, p_size);
+}
+
+// ----------------------------------------------------------------------------
+void EEPROMClass::updateBlock(int p_address,
+                              void const* p_data,
+                              size_t p_size)
+{
+    ArduinoEmulator& board = currentEmulator();
+    waitEEPROM(board, 0u);
+    EEPROMEmulator& eeprom = board.getEEPROM();
+    eeprom.write(size_t(p_address), p_data, p_size, true);
+    waitEEPROM(board, eeprom.writeTime());
+}
@@ -0,0 +1,100 @@
+// ============================================================================
+//! \file MappedFile.cpp
+//! \brief Host file mapped in memory, backing the emulated non-volatile
+//! memories.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#include "ArduinoEmulator/MappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+// ----------------------------------------------------------------------------
+bool MappedFile::open(std::string const& p_path,
+                      size_t p_size,
+                      uint8_t p_fill)
+{
+    close();
+    if (p_size == 0)
+        return false;
+
+    void* data = MAP_FAILED;
+    size_t initial_size = 0;
+    if (p_path.empty())
+    {
+        data = mmap(nullptr,
+                    p_size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1,
+                    0);
+    }
+    else
+    {
+        // Extending the file with ftruncate() leaves a hole: no disk space
+        // is used until the bytes are written
+        int fd = ::open(p_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        struct stat status;
+        if ((fd >= 0) && (fstat(fd, &status) == 0) &&
+            ((size_t(status.st_size) >= p_size) ||
+             (ftruncate(fd, off_t(p_size)) == 0)))
+        {
+            initial_size = std::min(size_t(status.st_size), p_size);
+            data = mmap(
+                nullptr, p_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        int error = errno;
+        if (fd >= 0)
+        {
+            // The mapping keeps the file open
+            ::close(fd);
+        }
+        errno = error;
+    }
+
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "Error: Cannot map the file '" << p_path
+                  << "': " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    m_data = static_cast<uint8_t*>(data);
+    m_size = p_size;
+    m_path = p_path;
+    if (p_fill != 0)
+    {
+        std::memset(m_data + initial_size, p_fill, p_size - initial_size);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+    {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_path.clear();
+    }
+}
+
+// ----------------------------------------------------------------------------
+void MappedFile::sync()
+{
+    if ((m_data != nullptr) && !m_path.empty())
+    {
+        msync(m_data, m_size, MS_ASYNC);
+    }
+}
@@ -0,0 +1,190 @@
+// ============================================================================
+//! \file Print.cpp
+//! \brief Formatting of the Arduino print() functions
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#include "ArduinoEmulator/Arduino.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+// ----------------------------------------------------------------------------
+//! \brief Characters of the longest formatted number: 64 binary digits and
+//! the sign, or the 10 digits of an unsigned long and 36 decimals.
+// ----------------------------------------------------------------------------
+constexpr size_t NUMBER_LENGTH = 72;
+
+//! \brief Maximum number of decimals printed for a floating point number.
+constexpr int MAX_DIGITS = 36;
+
+// ----------------------------------------------------------------------------
+size_t Print::write(const uint8_t* p_buffer, size_t p_size)
+{
+    size_t count = 0;
+    while ((count < p_size) && (write(p_buffer[count]) == 1u))
+    {
+        ++count;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::write(const char* p_str)
+{
+    if (p_str == nullptr)
+        return 0;
+    return write(p_str, std::strlen(p_str));
+}
+
+// ----------------------------------------------------------------------------
+//! \note Formatted into a buffer on the stack, without heap allocation. As on
+//! Arduino, base 0 writes the value as a raw byte and the other bases below
+//! 2 print in DEC.
+// ----------------------------------------------------------------------------
+template <typename T>
+size_t Print::printNumber(T p_val, int p_base)
+{
+    if (p_base == 0)
+        return write(static_cast<uint8_t>(p_val));
+    if ((p_base < 2) || (p_base > 36))
+    {
+        p_base = DEC;
+    }
+
+    // Only decimal numbers are signed: other bases print the bits
+    char buffer[NUMBER_LENGTH];
+    std::to_chars_result result =
+        (p_base == DEC)
+            ? std::to_chars(buffer, buffer + NUMBER_LENGTH, p_val)
+            : std::to_chars(buffer,
+                            buffer + NUMBER_LENGTH,
+                            static_cast<std::make_unsigned_t<T>>(p_val),
+                            p_base);
+
+    // Arduino prints hexadecimal digits in upper case
+    for (char* c = buffer; c != result.ptr; ++c)
+    {
+        *c = char(std::toupper(static_cast<unsigned char>(*c)));
+    }
+    return write(buffer, size_t(result.ptr - buffer));
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(const char* p_str)
+{
+    return write(p_str);
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(char p_c)
+{
+    return write(static_cast<uint8_t>(p_c));
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(int p_val, int p_base)
+{
+    return printNumber(p_val, p_base);
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(long p_val, int p_base)
+{
+    return printNumber(p_val, p_base);
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(unsigned int p_val, int p_base)
+{
+    return printNumber(p_val, p_base);
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::print(unsigned long p_val, int p_base)
+{
+    return printNumber(p_val, p_base);
+}
+
+// ----------------------------------------------------------------------------
+//! \note As on Arduino, "nan", "inf" and "ovf" (out of the unsigned long
+//! range of the AVR) are printed instead of the values which cannot be
+//! displayed.
+// ----------------------------------------------------------------------------
+size_t Print::print(double p_val, int p_digits)
+{
+    if (std::isnan(p_val))
+        return write("nan", 3u);
+    if (std::isinf(p_val))
+        return write("inf", 3u);
+    if ((p_val > 4294967040.0) || (p_val < -4294967040.0))
+        return write("ovf", 3u);
+
+    char buffer[NUMBER_LENGTH];
+    std::to_chars_result result =
+        std::to_chars(buffer,
+                      buffer + NUMBER_LENGTH,
+                      p_val,
+                      std::chars_format::fixed,
+                      std::clamp(p_digits, 0, MAX_DIGITS));
+    return write(buffer, size_t(result.ptr - buffer));
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println()
+{
+    return write(static_cast<uint8_t>('\n'));
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(const char* p_str)
+{
+    size_t count = print(p_str);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(char p_c)
+{
+    size_t count = print(p_c);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(int p_val, int p_base)
+{
+    size_t count = print(p_val, p_base);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(long p_val, int p_base)
+{
+    size_t count = print(p_val, p_base);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(unsigned int p_val, int p_base)
+{
+    size_t count = print(p_val, p_base);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(unsigned long p_val, int p_base)
+{
+    size_t count = print(p_val, p_base);
+    return count + println();
+}
+
+// ----------------------------------------------------------------------------
+size_t Print::println(double p_val, int p_digits)
+{
+    size_t count = print(p_val, p_digits);
+    return count + println();
+}
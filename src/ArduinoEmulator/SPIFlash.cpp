@@ -0,0 +1,328 @@
+// ============================================================================
+//! \file SPIFlash.cpp
+//! \brief Emulated SPI NOR flash stored in a memory-mapped image file.
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#include "ArduinoEmulator/SPIFlash.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+//! \brief Opcodes of the W25Q command set.
+enum Opcode : int
+{
+    WRITE_ENABLE = 0x06,
+    WRITE_DISABLE = 0x04,
+    READ_STATUS = 0x05,
+    READ_DATA = 0x03,
+    FAST_READ = 0x0B,
+    PAGE_PROGRAM = 0x02,
+    SECTOR_ERASE = 0x20,
+    BLOCK_ERASE_32K = 0x52,
+    BLOCK_ERASE_64K = 0xD8,
+    CHIP_ERASE = 0xC7,
+    CHIP_ERASE_ALT = 0x60,
+    JEDEC_ID = 0x9F,
+    ENTER_4_BYTE = 0xB7,
+    EXIT_4_BYTE = 0xE9,
+    //! \brief Rest of a command refused (busy chip or write not enabled)
+    IGNORED = 0x100
+};
+
+// ----------------------------------------------------------------------------
+SPIFlashDevice::SPIFlashDevice(std::function<uint64_t()> const& p_clock,
+                               size_t p_size)
+    : m_clock(p_clock)
+{
+    // Winbond ID: manufacturer 0xEF, type 0x40, capacity code log2(size)
+    unsigned capacity = 16u;
+    while (((size_t(1) << capacity) < std::min(p_size, MAX_SIZE)))
+    {
+        capacity++;
+    }
+    m_size = size_t(1) << capacity;
+    m_jedec_id = 0xEF4000u | capacity;
+    open("");
+}
+
+// ----------------------------------------------------------------------------
+bool SPIFlashDevice::open(std::string const& p_image)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t wear_size = m_size / SECTOR_SIZE * sizeof(uint32_t);
+    bool opened =
+        m_storage.open(p_image, m_size, 0xFF) &&
+        m_wear.open(p_image.empty() ? p_image : p_image + ".wear", wear_size);
+    if (!opened)
+    {
+        // Keep a working blank chip
+        m_storage.open("", m_size, 0xFF);
+        m_wear.open("", wear_size);
+    }
+    return opened;
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::sync()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_storage.sync();
+    m_wear.sync();
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::setTimings(Timings const& p_timings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_timings = p_timings;
+}
+
+// ----------------------------------------------------------------------------
+std::vector<uint32_t> SPIFlashDevice::eraseCounts() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint32_t> counts(m_wear.size() / sizeof(uint32_t), 0u);
+    if (m_wear.data() != nullptr)
+    {
+        std::memcpy(counts.data(), m_wear.data(), m_wear.size());
+    }
+    return counts;
+}
+
+// ----------------------------------------------------------------------------
+SPIFlashDevice::Stats SPIFlashDevice::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// ----------------------------------------------------------------------------
+size_t SPIFlashDevice::dump(size_t p_address,
+                            uint8_t* p_buffer,
+                            size_t p_size) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if ((m_storage.data() == nullptr) || (p_address >= m_size))
+        return 0;
+
+    p_size = std::min(p_size, m_size - p_address);
+    std::memcpy(p_buffer, m_storage.data() + p_address, p_size);
+    return p_size;
+}
+
+// ----------------------------------------------------------------------------
+uint8_t SPIFlashDevice::status() const
+{
+    bool busy = m_clock() < m_busy_until;
+    return uint8_t((busy ? 0x01u : 0x00u) | (m_write_enabled ? 0x02u : 0x00u));
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::select()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_command = -1;
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::deselect()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool addressed = m_received >= addressBytes();
+    switch (m_command)
+    {
+        case PAGE_PROGRAM:
+            if (addressed)
+            {
+                m_busy_until = m_clock() + m_timings.page_program_us;
+                m_write_enabled = false;
+            }
+            break;
+        case SECTOR_ERASE:
+            if (addressed)
+                erase(m_address, SECTOR_SIZE, m_timings.sector_erase_us);
+            break;
+        case BLOCK_ERASE_32K:
+            if (addressed)
+                erase(m_address, 32u * 1024u, m_timings.block_erase_us);
+            break;
+        case BLOCK_ERASE_64K:
+            if (addressed)
+                erase(m_address, 64u * 1024u, m_timings.block_erase_us);
+            break;
+        case CHIP_ERASE:
+        case CHIP_ERASE_ALT:
+            erase(0u, m_size, m_timings.chip_erase_us);
+            break;
+        default:
+            break;
+    }
+    m_command = -1;
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::erase(size_t p_address,
+                           size_t p_size,
+                           uint64_t p_duration_us)
+{
+    p_address = (p_address & (m_size - 1u)) & ~(p_size - 1u);
+    std::memset(m_storage.data() + p_address, 0xFF, p_size);
+
+    // Counters are copied: the mapped bytes are not declared as integers
+    uint8_t* counter = m_wear.data() + p_address / SECTOR_SIZE * 4u;
+    for (size_t sector = 0; sector < p_size / SECTOR_SIZE; ++sector)
+    {
+        uint32_t count;
+        std::memcpy(&count, counter, sizeof(count));
+        count++;
+        std::memcpy(counter, &count, sizeof(count));
+        counter += sizeof(count);
+    }
+
+    m_stats.erased_sectors += p_size / SECTOR_SIZE;
+    m_busy_until = m_clock() + p_duration_us;
+    m_write_enabled = false;
+}
+
+// ----------------------------------------------------------------------------
+void SPIFlashDevice::transfer(uint8_t* p_data, size_t p_size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if ((m_storage.data() == nullptr) || (m_wear.data() == nullptr))
+    {
+        std::memset(p_data, 0xFF, p_size);
+        return;
+    }
+
+    size_t i = 0;
+    while (i < p_size)
+    {
+        if (m_command >= 0)
+        {
+            i += command(p_data + i, p_size - i);
+            continue;
+        }
+
+        // Opcode: a busy chip only answers the status register
+        m_command = p_data[i];
+        p_data[i++] = 0xFFu;
+        m_received = 0;
+        m_address = 0;
+        bool writing = (m_command == PAGE_PROGRAM) ||
+                       (m_command == SECTOR_ERASE) ||
+                       (m_command == BLOCK_ERASE_32K) ||
+                       (m_command == BLOCK_ERASE_64K) ||
+                       (m_command == CHIP_ERASE) ||
+                       (m_command == CHIP_ERASE_ALT);
+        if (((m_command != READ_STATUS) && (m_clock() < m_busy_until)) ||
+            (writing && !m_write_enabled))
+        {
+            m_command = IGNORED;
+        }
+        else if (m_command == WRITE_ENABLE)
+        {
+            m_write_enabled = true;
+        }
+        else if (m_command == WRITE_DISABLE)
+        {
+            m_write_enabled = false;
+        }
+        else if (m_command == ENTER_4_BYTE)
+        {
+            m_four_byte = true;
+        }
+        else if (m_command == EXIT_4_BYTE)
+        {
+            m_four_byte = false;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+size_t SPIFlashDevice::command(uint8_t* p_data, size_t p_size)
+{
+    if (m_command == READ_STATUS)
+    {
+        std::memset(p_data, status(), p_size);
+        return p_size;
+    }
+
+    if (m_command == JEDEC_ID)
+    {
+        for (size_t i = 0; i < p_size; ++i, ++m_received)
+        {
+            p_data[i] = (m_received < 3u)
+                            ? uint8_t(m_jedec_id >> (16u - 8u * m_received))
+                            : 0xFFu;
+        }
+        return p_size;
+    }
+
+    bool reading = (m_command == READ_DATA) || (m_command == FAST_READ);
+    bool programming = (m_command == PAGE_PROGRAM);
+    if (!reading && !programming && (m_command != SECTOR_ERASE) &&
+        (m_command != BLOCK_ERASE_32K) && (m_command != BLOCK_ERASE_64K))
+    {
+        std::memset(p_data, 0xFF, p_size);
+        return p_size;
+    }
+
+    // Address bytes (MSB first), then the dummy byte of the fast read
+    size_t header = addressBytes() + ((m_command == FAST_READ) ? 1u : 0u);
+    size_t i = 0;
+    for (; (i < p_size) && (m_received < header); ++i, ++m_received)
+    {
+        if (m_received < addressBytes())
+        {
+            m_address = (m_address << 8) | p_data[i];
+        }
+        p_data[i] = 0xFFu;
+    }
+    if (m_received < header)
+        return p_size;
+    m_address &= m_size - 1u;
+
+    // Data phase, straight from or to the mapped image
+    uint8_t* data = p_data + i;
+    size_t count = p_size - i;
+    if (reading)
+    {
+        m_stats.read_bytes += count;
+        while (count > 0)
+        {
+            // The read goes on at the start of the chip after its end
+            size_t chunk = std::min(count, m_size - m_address);
+            std::memcpy(data, m_storage.data() + m_address, chunk);
+            m_address = (m_address + chunk) & (m_size - 1u);
+            data += chunk;
+            count -= chunk;
+        }
+    }
+    else if (programming)
+    {
+        m_stats.programmed_bytes += count;
+        while (count > 0)
+        {
+            // The program wraps at the start of the page after its end, and
+            // only clears bits
+            size_t offset = m_address & (PAGE_SIZE - 1u);
+            size_t chunk = std::min(count, PAGE_SIZE - offset);
+            uint8_t* content = m_storage.data() + m_address;
+            for (size_t k = 0; k < chunk; ++k)
+            {
+                content[k] &= data[k];
+                data[k] = 0xFFu;
+            }
+            m_address = (m_address - offset) + ((offset + chunk) % PAGE_SIZE);
+            data += chunk;
+            count -= chunk;
+        }
+    }
+    else
+    {
+        std::memset(data, 0xFF, count);
+    }
+    return p_size;
+}
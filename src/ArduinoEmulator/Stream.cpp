@@ -0,0 +1,147 @@
+// ============================================================================
+//! \file Stream.cpp
+//! \brief Reading and parsing functions of the Arduino streams
+//! \author Lecrapouille
+//! \copyright MIT License
+// ============================================================================
+
+#include "ArduinoEmulator/Arduino.hpp"
+
+// ----------------------------------------------------------------------------
+//! \brief Check if a character is a decimal digit.
+// ----------------------------------------------------------------------------
+static bool isDecimal(int p_c)
+{
+    return (p_c >= '0') && (p_c <= '9');
+}
+
+// ----------------------------------------------------------------------------
+bool Stream::waitAvailable()
+{
+    // delay() rather than spinning on millis(): the virtual clock only
+    // advances through delays, and the data comes from another thread.
+    unsigned long timeout = getTimeout();
+    unsigned long start = static_cast<unsigned long>(millis());
+    while (available() <= 0)
+    {
+        if (static_cast<unsigned long>(millis()) - start >= timeout)
+            return false;
+        delay(1);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+int Stream::timedRead()
+{
+    return waitAvailable() ? read() : -1;
+}
+
+// ----------------------------------------------------------------------------
+int Stream::timedPeek()
+{
+    return waitAvailable() ? peek() : -1;
+}
+
+// ----------------------------------------------------------------------------
+size_t Stream::readBytes(char* p_buffer, size_t p_length)
+{
+    size_t count = 0;
+    while (count < p_length)
+    {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        p_buffer[count++] = static_cast<char>(c);
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+size_t Stream::readBytesUntil(char p_terminator,
+                              char* p_buffer,
+                              size_t p_length)
+{
+    size_t count = 0;
+    while (count < p_length)
+    {
+        int c = timedRead();
+        if ((c < 0) || (c == static_cast<unsigned char>(p_terminator)))
+            break;
+        p_buffer[count++] = static_cast<char>(c);
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+int Stream::peekNextDigit(bool p_decimal)
+{
+    for (;;)
+    {
+        int c = timedPeek();
+        if ((c < 0) || (c == '-') || isDecimal(c) || (p_decimal && (c == '.')))
+            return c;
+        read();
+    }
+}
+
+// ----------------------------------------------------------------------------
+long Stream::parseInt()
+{
+    int c = peekNextDigit(false);
+    if (c < 0)
+        return 0;
+
+    bool negative = false;
+    long value = 0;
+    do
+    {
+        if (c == '-')
+        {
+            negative = true;
+        }
+        else
+        {
+            value = value * 10 + (c - '0');
+        }
+        read();
+        c = timedPeek();
+    } while (isDecimal(c));
+
+    return negative ? -value : value;
+}
+
+// ----------------------------------------------------------------------------
+float Stream::parseFloat()
+{
+    int c = peekNextDigit(true);
+    if (c < 0)
+        return 0.0f;
+
+    bool negative = false;
+    bool fraction = false;
+    long value = 0;
+    float scale = 1.0f;
+    do
+    {
+        if (c == '-')
+        {
+            negative = true;
+        }
+        else if (c == '.')
+        {
+            fraction = true;
+        }
+        else
+        {
+            value = value * 10 + (c - '0');
+            if (fraction)
+                scale *= 0.1f;
+        }
+        read();
+        c = timedPeek();
+    } while (isDecimal(c) || ((c == '.') && !fraction));
+
+    float result = static_cast<float>(value) * scale;
+    return negative ? -result : result;
+}
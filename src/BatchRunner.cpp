@@ -0,0 +1,455 @@
+// ==========================================================================
+//! \file BatchRunner.cpp
+//! \brief Implementation of the headless execution of the Arduino sketch
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#include "BatchRunner.hpp"
+
+#include "ArduinoEmulator/ArduinoEmulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+//! \brief Time left to a cancelled sketch to reach a safe point.
+static constexpr std::chrono::seconds CANCEL_GRACE{ 5 };
+
+// ----------------------------------------------------------------------------
+extern ArduinoEmulator arduino_sim;
+
+// ----------------------------------------------------------------------------
+BatchRunner::BatchRunner(Config const& p_config, SketchLoader const& p_sketch)
+    : m_config(p_config), m_sketch(p_sketch)
+{
+    arduino_sim.configurePins(m_config.board.total_pins,
+                              m_config.board.pwm_pins,
+                              m_config.board.analog_input_pins);
+    arduino_sim.configureUarts(m_config.board.uarts);
+
+    // No audio device and no real time: run as fast as possible
+    arduino_sim.getToneGenerator().setAudioOutput(false);
+    arduino_sim.getTimer().setClockMode(ClockMode::Virtual, 0.0);
+    UartTiming uart_timing = UartTiming::Instant;
+    parseUartTiming(m_config.uart_timing, uart_timing);
+    arduino_sim.setUartTiming(uart_timing);
+    arduino_sim.getEEPROM().setWriteLatency(m_config.eeprom_latency);
+}
+
+// ----------------------------------------------------------------------------
+bool BatchRunner::loadStimuli(std::string const& p_file)
+{
+    std::ifstream file(p_file);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Cannot open stimulus file: " << p_file << "\n";
+        return false;
+    }
+
+    try
+    {
+        nlohmann::json j;
+        file >> j;
+
+        m_stimuli.clear();
+        for (auto const& entry : j)
+        {
+            Stimulus stimulus;
+            stimulus.time_us = entry.at("time").get<uint64_t>() * 1000u;
+            stimulus.pin = -1;
+            stimulus.value = entry.value("value", 0);
+            if (entry.contains("pin"))
+            {
+                stimulus.kind = Stimulus::Digital;
+                stimulus.pin = entry["pin"].get<int>();
+            }
+            else if (entry.contains("analog"))
+            {
+                stimulus.kind = Stimulus::Analog;
+                stimulus.pin = entry["analog"].get<int>();
+            }
+            else if (entry.contains("serial"))
+            {
+                stimulus.kind = Stimulus::Serial;
+                stimulus.pin = entry.value("port", 0);
+                stimulus.data = entry["serial"].get<std::string>();
+                if ((stimulus.pin < 0) ||
+                    (size_t(stimulus.pin) >= m_config.board.uarts))
+                {
+                    std::cerr << "Error: No serial port " << stimulus.pin
+                              << " on the board: " << entry.dump() << "\n";
+                    return false;
+                }
+            }
+            else if (entry.contains("i2c"))
+            {
+                stimulus.kind = Stimulus::I2C;
+                stimulus.pin = entry["i2c"].get<int>();
+                if (!I2CBus::isDeviceAddress(stimulus.pin))
+                {
+                    std::cerr << "Error: I2C address must be in 0x08 .. 0x77: "
+                              << entry.dump() << "\n";
+                    return false;
+                }
+                stimulus.value = entry.value("register", 0);
+                auto values = entry.at("values").get<std::vector<uint8_t>>();
+                stimulus.data.assign(values.begin(), values.end());
+            }
+            else
+            {
+                std::cerr << "Error: Stimulus without pin, analog, serial or "
+                             "i2c: "
+                          << entry.dump() << "\n";
+                return false;
+            }
+            m_stimuli.push_back(stimulus);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error parsing stimulus file: " << e.what() << "\n";
+        return false;
+    }
+
+    // Keep the file order for inputs given at the same time
+    std::stable_sort(m_stimuli.begin(),
+                     m_stimuli.end(),
+                     [](Stimulus const& a, Stimulus const& b)
+                     { return a.time_us < b.time_us; });
+    m_next_stimulus = 0;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void BatchRunner::applyStimuli(uint64_t p_now_us)
+{
+    while ((m_next_stimulus < m_stimuli.size()) &&
+           (m_stimuli[m_next_stimulus].time_us <= p_now_us))
+    {
+        Stimulus const& stimulus = m_stimuli[m_next_stimulus++];
+        switch (stimulus.kind)
+        {
+            case Stimulus::Digital:
+                arduino_sim.forcePinValue(stimulus.pin, stimulus.value);
+                break;
+            case Stimulus::Analog:
+            {
+                int pin = arduino_sim.getAnalogPin(stimulus.pin);
+                if (pin >= 0)
+                {
+                    arduino_sim.setAnalogValue(pin, stimulus.value);
+                }
+                break;
+            }
+            case Stimulus::Serial:
+                arduino_sim.getSerial(size_t(stimulus.pin))
+                    .addInput(stimulus.data);
+                break;
+            case Stimulus::I2C:
+            {
+                I2CBus& bus = arduino_sim.getI2C();
+                auto device = std::dynamic_pointer_cast<I2CRegisterDevice>(
+                    bus.device(uint8_t(stimulus.pin)));
+                if (!device)
+                {
+                    device = std::make_shared<I2CRegisterDevice>();
+                    bus.attach(uint8_t(stimulus.pin), device);
+                }
+                device->setRegisters(
+                    uint8_t(stimulus.value),
+                    std::vector<uint8_t>(stimulus.data.begin(),
+                                         stimulus.data.end()));
+                break;
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+bool BatchRunner::finished() const
+{
+    if ((m_config.loops > 0) && (m_loops >= m_config.loops))
+        return true;
+
+    uint64_t now_us = uint64_t(arduino_sim.getTimer().micros());
+    return (m_config.duration_ms > 0) &&
+           (now_us >= m_config.duration_ms * 1000u);
+}
+
+// ----------------------------------------------------------------------------
+void BatchRunner::collectSerialOutput()
+{
+    for (size_t port = 0; port < m_serial_outputs.size(); ++port)
+    {
+        m_serial_outputs[port] += arduino_sim.getSerial(port).getOutput();
+    }
+}
+
+// ----------------------------------------------------------------------------
+void BatchRunner::watchdog()
+{
+    std::unique_lock<std::mutex> lock(m_watchdog_mutex);
+    auto done = [this]() { return m_run_done; };
+    if (m_watchdog_cond.wait_for(
+            lock, std::chrono::seconds(m_config.timeout_s), done))
+    {
+        return;
+    }
+
+    // Unwind the sketch at its next cancellation point (delay, millis ...)
+    m_timed_out.store(true);
+    arduino_sim.getInterruptController().cancel();
+
+    // A loop without cancellation point cannot be unwound: the results are
+    // lost
+    if (!m_watchdog_cond.wait_for(lock, CANCEL_GRACE, done))
+    {
+        std::cerr << "Error: Headless run stopped after "
+                  << m_config.timeout_s
+                  << " s of host time, in a loop without cancellation "
+                     "point\n";
+        std::_Exit(EXIT_FAILURE);
+    }
+}
+
+// ----------------------------------------------------------------------------
+bool BatchRunner::run()
+{
+    TimerEmulator& timer = arduino_sim.getTimer();
+
+    m_loops = 0;
+    m_next_stimulus = 0;
+    m_timed_out.store(false);
+    m_error.clear();
+    m_serial_outputs.assign(arduino_sim.getUartCount(), std::string());
+
+    // Non-volatile memories, kept across runs in their files
+    if (!arduino_sim.getEEPROM().open(m_config.eeprom_file,
+                                      m_config.board.eeprom))
+    {
+        return false;
+    }
+    if (!m_config.spi_flash.empty())
+    {
+        m_spi_flash = arduino_sim.makeSPIFlash(m_config.spi_flash_size);
+        if (!m_spi_flash->open(m_config.spi_flash))
+        {
+            return false;
+        }
+        arduino_sim.getSPI().attach(m_config.spi_flash_cs, m_spi_flash);
+    }
+
+    arduino_sim.setRunning(true);
+    arduino_sim.getAvrTimers().reset();
+    timer.start();
+
+    if (!m_config.vcd_file.empty() &&
+        !arduino_sim.startRecording(m_config.vcd_file))
+    {
+        arduino_sim.setRunning(false);
+        timer.stop();
+        return false;
+    }
+
+    // ISRs are executed by this thread, between two Arduino API calls
+    arduino_sim.getInterruptController().reset();
+    arduino_sim.getInterruptController().bindThread();
+
+    m_run_done = false;
+    std::thread watchdog_thread;
+    if (m_config.timeout_s > 0)
+    {
+        watchdog_thread = std::thread(&BatchRunner::watchdog, this);
+    }
+
+    try
+    {
+        applyStimuli(0);
+        m_sketch.setup();
+        collectSerialOutput();
+
+        // Loops are spaced by the loop period in simulated time. In
+        // free-running mode, the simulated time advances by the host time
+        // spent in loop(), accumulated in nanoseconds so that loops shorter
+        // than a microsecond still move the time forward.
+        const uint64_t period_us =
+            (m_config.frequency == 0) ? 0u : 1000000u / m_config.frequency;
+        uint64_t next_loop_us = uint64_t(timer.micros());
+        uint64_t elapsed_ns = 0;
+
+        while (!finished())
+        {
+            applyStimuli(uint64_t(timer.micros()));
+
+            auto start = std::chrono::steady_clock::now();
+            m_sketch.loop();
+            arduino_sim.cancellationPoint();
+            m_loops++;
+            collectSerialOutput();
+
+            uint64_t now_us = uint64_t(timer.micros());
+            if (period_us == 0)
+            {
+                elapsed_ns += uint64_t(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+                timer.advance(elapsed_ns / 1000u, false);
+                elapsed_ns %= 1000u;
+            }
+            else if ((next_loop_us += period_us) > now_us)
+            {
+                timer.advance(next_loop_us - now_us);
+            }
+            else
+            {
+                next_loop_us = now_us;
+            }
+        }
+    }
+    catch (SketchCancelled const&)
+    {
+        // Unwound at a safe point by the watchdog: keep what the sketch
+        // wrote until then
+        collectSerialOutput();
+    }
+    catch (std::exception const& e)
+    {
+        // Uncaught exception of the sketch: a board would have crashed
+        collectSerialOutput();
+        m_error = e.what();
+    }
+    catch (...)
+    {
+        collectSerialOutput();
+        m_error = "unknown exception";
+    }
+
+    if (watchdog_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_watchdog_mutex);
+            m_run_done = true;
+        }
+        m_watchdog_cond.notify_all();
+        watchdog_thread.join();
+    }
+
+    m_elapsed_us = uint64_t(timer.micros());
+    arduino_sim.stopRecording();
+    arduino_sim.setRunning(false);
+    for (size_t port = 0; port < m_serial_outputs.size(); ++port)
+    {
+        arduino_sim.getSerial(port).end();
+    }
+    timer.stop();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+nlohmann::json BatchRunner::results() const
+{
+    nlohmann::json response;
+    response["status"] =
+        !m_error.empty() ? "error" : (timedOut() ? "timeout" : "ok");
+    if (!m_error.empty())
+    {
+        response["error"] = m_error;
+    }
+    response["board"] = m_config.board.name;
+    response["loops"] = m_loops;
+    response["simulated_ms"] = m_elapsed_us / 1000u;
+
+    nlohmann::json ports = nlohmann::json::array();
+    for (size_t port = 0; port < m_serial_outputs.size(); ++port)
+    {
+        SerialEmulator::Stats stats = arduino_sim.getSerial(port).getStats();
+        nlohmann::json data;
+        data["output"] = m_serial_outputs[port];
+        data["dropped"] = stats.dropped;
+        data["tx_bytes"] = stats.tx_bytes;
+        data["rx_bytes"] = stats.rx_bytes;
+        ports.push_back(data);
+    }
+
+    // Serial at the top level, as before the support of several UARTs
+    nlohmann::json serial = ports.empty() ? nlohmann::json::object()
+                                          : ports[0];
+    serial["ports"] = ports;
+    response["serial"] = serial;
+
+    nlohmann::json pins = nlohmann::json::object();
+    for (size_t i = 0; i < arduino_sim.getPinCount(); i++)
+    {
+        Pin const* pin = arduino_sim.getPin(int(i));
+        nlohmann::json pin_data;
+        pin_data["value"] = pin->value;
+        pin_data["mode"] = pin->mode;
+        pin_data["pwm_capable"] = pin->pwm_capable;
+        pin_data["pwm_value"] = pin->pwm_value;
+        pin_data["analog_value"] = pin->analog_value;
+        pin_data["configured"] = pin->configured;
+        pins[std::to_string(i)] = pin_data;
+    }
+    response["pins"] = pins;
+
+    // Counters of the interrupt lines used during the run
+    InterruptController& controller = arduino_sim.getInterruptController();
+    nlohmann::json interrupts = nlohmann::json::object();
+    for (size_t line = 0; line < controller.lines(); line++)
+    {
+        InterruptController::Stats stats = controller.stats(line);
+        if (stats.raised == 0)
+            continue;
+
+        nlohmann::json line_data;
+        line_data["raised"] = stats.raised;
+        line_data["merged"] = stats.merged;
+        line_data["serviced"] = stats.serviced;
+        line_data["max_latency_us"] = stats.max_latency_us;
+        line_data["mean_latency_us"] =
+            (stats.serviced == 0)
+                ? 0.0
+                : double(stats.total_latency_us) / double(stats.serviced);
+        std::string name =
+            (line < AVR_VECTOR_COUNT)
+                ? "vector " + std::to_string(line)
+                : "pin " + std::to_string(line - AVR_VECTOR_COUNT);
+        interrupts[name] = line_data;
+    }
+    response["interrupts"] = interrupts;
+
+    // Wear of the EEPROM: cell writes during the run, and the most written
+    // cell (across the runs when the EEPROM is stored in a file)
+    EEPROMEmulator& eeprom = arduino_sim.getEEPROM();
+    std::vector<uint32_t> writes = eeprom.writeCounts();
+    auto hotspot = std::max_element(writes.begin(), writes.end());
+    nlohmann::json eeprom_data;
+    eeprom_data["writes"] = eeprom.writes();
+    eeprom_data["max_cell_writes"] = (hotspot == writes.end()) ? 0u : *hotspot;
+    eeprom_data["max_cell"] =
+        (hotspot == writes.end()) ? 0 : hotspot - writes.begin();
+    response["eeprom"] = eeprom_data;
+
+    // Traffic and wear of the SPI flash
+    if (m_spi_flash)
+    {
+        SPIFlashDevice::Stats stats = m_spi_flash->getStats();
+        std::vector<uint32_t> erases = m_spi_flash->eraseCounts();
+        nlohmann::json flash;
+        flash["read_bytes"] = stats.read_bytes;
+        flash["programmed_bytes"] = stats.programmed_bytes;
+        flash["erased_sectors"] = stats.erased_sectors;
+        flash["max_sector_erases"] =
+            erases.empty() ? 0u : *std::max_element(erases.begin(),
+                                                    erases.end());
+        response["spi_flash"] = flash;
+    }
+
+    return response;
+}
@@ -0,0 +1,183 @@
+// ==========================================================================
+//! \file BatchRunner.hpp
+//! \brief Headless execution of the Arduino sketch
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include "Config.hpp"
+#include "SketchLoader.hpp"
+
+#include "nlohmann/json.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class SPIFlashDevice;
+
+// ==========================================================================
+//! \brief Run the sketch without web server nor audio device, as fast as the
+//! host CPU allows, then report the serial output and the final pin states.
+//!
+//! The sketch runs on the virtual clock at max speed: setup() then loop() are
+//! called until the simulated duration or the number of loops given by the
+//! configuration is reached. Inputs of the stimulus file are applied between
+//! two loop() calls, once their time is reached. Stimulus file example (times
+//! in milliseconds of simulated time):
+//!
+//! \code
+//! [
+//!     { "time": 0,   "pin": 2, "value": 1 },
+//!     { "time": 100, "analog": 0, "value": 512 },
+//!     { "time": 250, "serial": "hello\n" },
+//!     { "time": 300, "serial": "$GPGGA...\r\n", "port": 1 },
+//!     { "time": 400, "i2c": 104, "register": 59, "values": [1, 2] }
+//! ]
+//! \endcode
+//!
+//! An i2c input sets registers of the I2C register device at the given
+//! address, plugging the device first if needed.
+//!
+//! The run is also bounded in host time: after the configured timeout (a
+//! sketch waiting for an input the stimuli never give), the sketch is
+//! unwound at its next cancellation point (delay, millis ...) and the
+//! results report the timeout.
+// ==========================================================================
+class BatchRunner
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_config Configuration.
+    //! \param p_sketch Sketch to run.
+    // ------------------------------------------------------------------------
+    BatchRunner(Config const& p_config, SketchLoader const& p_sketch);
+
+    // ------------------------------------------------------------------------
+    //! \brief Load the inputs to apply during the run.
+    //! \param p_file Stimulus JSON file.
+    //! \return false if the file cannot be read or is malformed.
+    // ------------------------------------------------------------------------
+    bool loadStimuli(std::string const& p_file);
+
+    // ------------------------------------------------------------------------
+    //! \brief Execute setup() and loop() until the configured limits.
+    //! \return false if the VCD, EEPROM or SPI flash file cannot be created.
+    //! A run stopped by the timeout or by an exception of the sketch returns
+    //! true: see timedOut() and error().
+    // ------------------------------------------------------------------------
+    bool run();
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if the last run was stopped by the host timeout.
+    // ------------------------------------------------------------------------
+    bool timedOut() const
+    {
+        return m_timed_out.load();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Message of the exception which ended the last run (empty if
+    //! the sketch threw none).
+    // ------------------------------------------------------------------------
+    std::string const& error() const
+    {
+        return m_error;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Results of the last run: status ("ok", "timeout" or "error"),
+    //! number of loops, simulated time, serial output and final pin states.
+    // ------------------------------------------------------------------------
+    nlohmann::json results() const;
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Input applied to the emulator at a given simulated time.
+    // ------------------------------------------------------------------------
+    struct Stimulus
+    {
+        //! \brief Kind of input.
+        enum Kind
+        {
+            Digital,
+            Analog,
+            Serial,
+            I2C
+        };
+
+        //! \brief Simulated time in microseconds.
+        uint64_t time_us;
+        //! \brief Kind of input.
+        Kind kind;
+        //! \brief Pin number (Digital), analog channel (Analog), UART number
+        //! (Serial) or device address (I2C).
+        int pin;
+        //! \brief Pin value or first register (I2C).
+        int value;
+        //! \brief Bytes received on the serial port or register values.
+        std::string data;
+    };
+
+    // ------------------------------------------------------------------------
+    //! \brief Apply the stimuli whose time is reached.
+    //! \param p_now_us Current simulated time in microseconds.
+    // ------------------------------------------------------------------------
+    void applyStimuli(uint64_t p_now_us);
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if the configured duration or loop count is reached.
+    // ------------------------------------------------------------------------
+    bool finished() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Append the pending output of all the serial ports.
+    // ------------------------------------------------------------------------
+    void collectSerialOutput();
+
+    // ------------------------------------------------------------------------
+    //! \brief Body of the watchdog thread: cancel the sketch when the host
+    //! timeout expires before the end of the run, and exit the process if
+    //! the sketch never reaches a safe point.
+    // ------------------------------------------------------------------------
+    void watchdog();
+
+private:
+
+    //! \brief Configuration
+    Config const& m_config;
+    //! \brief setup() and loop() of the sketch
+    SketchLoader const& m_sketch;
+    //! \brief Inputs sorted by time
+    std::vector<Stimulus> m_stimuli;
+    //! \brief Next input to apply
+    size_t m_next_stimulus = 0;
+    //! \brief Number of loop() calls done
+    uint64_t m_loops = 0;
+    //! \brief Simulated time at the end of the run
+    uint64_t m_elapsed_us = 0;
+    //! \brief SPI flash of the configuration
+    std::shared_ptr<SPIFlashDevice> m_spi_flash;
+    //! \brief Everything the sketch wrote on each serial port
+    std::vector<std::string> m_serial_outputs;
+    //! \brief The last run was stopped by the host timeout
+    std::atomic<bool> m_timed_out{ false };
+    //! \brief Exception which ended the last run
+    std::string m_error;
+    //! \brief The run is over (guarded by m_watchdog_mutex)
+    bool m_run_done = false;
+    //! \brief Wakes the watchdog up at the end of the run
+    std::condition_variable m_watchdog_cond;
+    //! \brief Guards m_run_done
+    std::mutex m_watchdog_mutex;
+};
@@ -58,14 +58,20 @@ struct BoardConfig
             if (j.contains("analog_only_pins"))
                 this->analog_only_pins =
                     j["analog_only_pins"].get<std::vector<int>>();
+            if (j.contains("uarts"))
+                this->uarts = j["uarts"].get<size_t>();
+            if (j.contains("eeprom"))
+                this->eeprom = j["eeprom"].get<size_t>();
 
             // Compute derived values (analog_pins, digital_pins,
             // total_pins, analog_input_pins)
             this->initialize();
 
-            std::cout << "Loaded board configuration: " << this->name << "\n";
-            std::cout << "  Digital pins: " << this->digital_pins
-                      << ", Analog pins: " << this->analog_pins << "\n";
+            std::clog << "Loaded board configuration: " << this->name << "\n";
+            std::clog << "  Digital pins: " << this->digital_pins
+                      << ", Analog pins: " << this->analog_pins
+                      << ", UARTs: " << this->uarts
+                      << ", EEPROM: " << this->eeprom << " bytes\n";
         }
         catch (const std::exception& e)
         {
@@ -132,4 +138,8 @@ struct BoardConfig
     size_t digital_pins = 0;
     //! \brief Total number of pins
     size_t total_pins = 0;
+    //! \brief Number of hardware serial ports (Serial, Serial1 ...)
+    size_t uarts = 1;
+    //! \brief Size of the EEPROM in bytes
+    size_t eeprom = 1024;
 };
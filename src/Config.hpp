@@ -0,0 +1,74 @@
+// ==========================================================================
+//! \file Config.hpp
+//! \brief Command line configuration of the Arduino emulator
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include "BoardConfig.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ==========================================================================
+//! \brief Configuration structure for the Arduino Emulator.
+// ==========================================================================
+struct Config
+{
+    //! \brief Maximum refresh rate of the web interface in Hz.
+    static constexpr size_t MAX_REFRESH_RATE = 200;
+
+    //! \brief Server address.
+    std::string address;
+    //! \brief Server port.
+    uint16_t port;
+    //! \brief Arduino loop rate in Hz (0 = back-to-back loop() calls).
+    size_t frequency;
+    //! \brief Web interface refresh rate in Hz.
+    size_t refresh_rate;
+    //! \brief Use the virtual clock instead of the host real time.
+    bool virtual_clock = false;
+    //! \brief Virtual clock speed factor (1 = real time pace, 0 = max).
+    double speed = 1.0;
+    //! \brief Serial transmission model: empty (instant), "block" or "short"
+    //! (baud rate accurate TX FIFO, see UartTiming).
+    std::string uart_timing;
+    //! \brief Board configuration file.
+    std::string board_file;
+    //! \brief Board configuration.
+    BoardConfig board;
+    //! \brief Sketch shared library (empty = sketch linked in the emulator).
+    std::string sketch_file;
+    //! \brief Bridge Serial to a host pseudo-terminal.
+    bool pty = false;
+    //! \brief File storing the EEPROM (empty = in memory).
+    std::string eeprom_file;
+    //! \brief EEPROM cell writes last 3.3 ms (virtual clock).
+    bool eeprom_latency = false;
+    //! \brief Image file of the SPI NOR flash (empty = no flash).
+    std::string spi_flash;
+    //! \brief Chip-select pin of the SPI NOR flash.
+    int spi_flash_cs = 10;
+    //! \brief Capacity of the SPI NOR flash in bytes.
+    size_t spi_flash_size = 16u * 1024u * 1024u;
+    //! \brief Directory of the flash images plugged from the REST API
+    //! (empty = images refused, flashes in memory only).
+    std::string spi_flash_dir;
+    //! \brief Record the pin changes into this VCD file (empty = disabled).
+    std::string vcd_file;
+    //! \brief Run the sketch without web server nor audio (batch mode).
+    bool headless = false;
+    //! \brief Headless: simulated duration in milliseconds (0 = no limit).
+    uint64_t duration_ms = 0;
+    //! \brief Headless: number of loop() calls (0 = no limit).
+    uint64_t loops = 0;
+    //! \brief Headless: host time limit of the run in seconds (0 = none).
+    uint64_t timeout_s = 300;
+    //! \brief Headless: file of inputs applied at given times.
+    std::string stimulus_file;
+    //! \brief Headless: result file (empty = standard output).
+    std::string output_file;
+};
@@ -0,0 +1,176 @@
+// ==========================================================================
+//! \file EventBroker.hpp
+//! \brief Wake up the Server-Sent Events streams on emulator changes
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+
+// ==========================================================================
+//! \brief Change notifier between the emulator (publisher) and the SSE
+//! streams of the web server (subscribers).
+//!
+//! Events are not queued: each topic only has a generation counter bumped on
+//! each change. A subscriber remembers the generations it has already sent
+//! and, once woken up, sends a fresh snapshot of the changed topics. Bursts
+//! of changes (i.e. a pin toggled at high rate) are therefore coalesced and
+//! a slow browser can never make the emulator accumulate memory. Publishing
+//! is an atomic increment, plus a notification when somebody is waiting.
+// ==========================================================================
+class EventBroker
+{
+public:
+
+    //! \brief Kind of state change.
+    enum Topic : size_t
+    {
+        Pins,
+        Serial,
+        Audio,
+        Status,
+        Debug,
+        Count
+    };
+
+    //! \brief Generation counter of each topic.
+    using Generations = std::array<uint64_t, Topic::Count>;
+
+    // ------------------------------------------------------------------------
+    //! \brief Generations making wait() report all topics as changed, to send
+    //! an initial snapshot to a new subscriber.
+    // ------------------------------------------------------------------------
+    static Generations unseen()
+    {
+        Generations generations;
+        generations.fill(std::numeric_limits<uint64_t>::max());
+        return generations;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Publish a change (callable from any thread).
+    //! \param p_topic Kind of change.
+    // ------------------------------------------------------------------------
+    void publish(Topic p_topic)
+    {
+        // Sequentially consistent with the waiter registration in wait():
+        // either the waiter sees the new generation, or we see the waiter.
+        m_generations[p_topic].fetch_add(1u);
+
+        // Nobody sleeping: keep the emulator hot path lock-free
+        if (m_waiters.load() == 0u)
+            return;
+
+        // Taking the mutex avoids a lost wake-up between the predicate check
+        // of a subscriber and its sleep.
+        {
+            std::scoped_lock lock(m_mutex);
+        }
+        m_cond.notify_all();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait for changes not already seen by a subscriber.
+    //! \param p_seen [in/out] Generations already sent by the subscriber.
+    //! Updated with the current generations on return.
+    //! \param p_changed [out] Topics which changed.
+    //! \param p_timeout Maximum time to wait.
+    //! \return false if the broker is shut down.
+    // ------------------------------------------------------------------------
+    bool wait(Generations& p_seen,
+              std::array<bool, Topic::Count>& p_changed,
+              std::chrono::milliseconds p_timeout)
+    {
+        std::unique_lock lock(m_mutex);
+        m_waiters.fetch_add(1u);
+        m_cond.wait_for(lock,
+                        p_timeout,
+                        [this, &p_seen]()
+                        { return m_shutdown || hasChanged(p_seen); });
+        m_waiters.fetch_sub(1u);
+
+        for (size_t i = 0; i < Topic::Count; ++i)
+        {
+            uint64_t generation =
+                m_generations[i].load(std::memory_order_acquire);
+            p_changed[i] = (generation != p_seen[i]);
+            p_seen[i] = generation;
+        }
+
+        return !m_shutdown;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Register a new subscriber.
+    // ------------------------------------------------------------------------
+    void subscribe()
+    {
+        m_subscribers.fetch_add(1u, std::memory_order_acq_rel);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Unregister a subscriber.
+    // ------------------------------------------------------------------------
+    void unsubscribe()
+    {
+        m_subscribers.fetch_sub(1u, std::memory_order_acq_rel);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Number of registered subscribers.
+    // ------------------------------------------------------------------------
+    size_t subscribers() const
+    {
+        return m_subscribers.load(std::memory_order_acquire);
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wake up and terminate all subscribers.
+    // ------------------------------------------------------------------------
+    void shutdown()
+    {
+        {
+            std::scoped_lock lock(m_mutex);
+            m_shutdown = true;
+        }
+        m_cond.notify_all();
+    }
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Check if a topic changed since the given generations.
+    // ------------------------------------------------------------------------
+    bool hasChanged(Generations const& p_seen) const
+    {
+        for (size_t i = 0; i < Topic::Count; ++i)
+        {
+            if (m_generations[i].load() != p_seen[i])
+                return true;
+        }
+        return false;
+    }
+
+private:
+
+    //! \brief Generation counter of each topic
+    std::array<std::atomic<uint64_t>, Topic::Count> m_generations{};
+    //! \brief Number of connected SSE streams
+    std::atomic<size_t> m_subscribers{ 0 };
+    //! \brief Number of subscribers sleeping in wait()
+    std::atomic<size_t> m_waiters{ 0 };
+    //! \brief Protects the sleep of the subscribers
+    std::mutex m_mutex;
+    //! \brief Wakes up the subscribers
+    std::condition_variable m_cond;
+    //! \brief Server stopping
+    bool m_shutdown = false;
+};
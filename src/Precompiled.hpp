@@ -0,0 +1,12 @@
+// ==========================================================================
+//! \file Precompiled.hpp
+//! \brief Headers parsed by every emulator source, precompiled by `make pch`
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include "ArduinoEmulator/ArduinoEmulator.hpp"
+
+#include "nlohmann/json.hpp"
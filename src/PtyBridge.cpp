@@ -0,0 +1,156 @@
+// ==========================================================================
+//! \file PtyBridge.cpp
+//! \brief Implementation of the pseudo-terminal bridge of the emulated Serial
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#include "PtyBridge.hpp"
+
+#include "ArduinoEmulator/ArduinoEmulator.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// ----------------------------------------------------------------------------
+PtyBridge::PtyBridge(SerialEmulator& p_serial) : m_serial(p_serial) {}
+
+// ----------------------------------------------------------------------------
+PtyBridge::~PtyBridge()
+{
+    close();
+}
+
+// ----------------------------------------------------------------------------
+bool PtyBridge::open()
+{
+    close();
+
+    m_master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if ((m_master < 0) || (grantpt(m_master) != 0) ||
+        (unlockpt(m_master) != 0) || (ptsname(m_master) == nullptr))
+    {
+        std::cerr << "Error: Cannot create the serial pseudo-terminal: "
+                  << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+    m_path = ptsname(m_master);
+
+    // Raw bytes as on a UART: no echo, no line buffering, no CR/LF mapping.
+    // Terminal programs opening the slave apply their own settings.
+    m_slave = ::open(m_path.c_str(), O_RDWR | O_NOCTTY);
+    m_wakeup = eventfd(0, EFD_NONBLOCK);
+    struct termios settings;
+    if ((m_slave < 0) || (m_wakeup < 0) ||
+        (tcgetattr(m_slave, &settings) != 0))
+    {
+        std::cerr << "Error: Cannot open the serial pseudo-terminal "
+                  << m_path << ": " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+    cfmakeraw(&settings);
+    tcsetattr(m_slave, TCSANOW, &settings);
+
+    m_stop = false;
+    m_thread = std::thread(&PtyBridge::ioLoop, this);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+void PtyBridge::close()
+{
+    if (m_thread.joinable())
+    {
+        m_stop = true;
+        m_sleeping = true;
+        notify();
+        m_thread.join();
+    }
+
+    for (int* fd : { &m_master, &m_slave, &m_wakeup })
+    {
+        if (*fd >= 0)
+        {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    m_path.clear();
+}
+
+// ----------------------------------------------------------------------------
+void PtyBridge::notify()
+{
+    // Pairs with the fence of ioLoop(): either the I/O thread sees the new
+    // output before sleeping, or we see it sleeping and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed))
+    {
+        uint64_t one = 1u;
+        [[maybe_unused]] ssize_t res = ::write(m_wakeup, &one, sizeof(one));
+    }
+}
+
+// ----------------------------------------------------------------------------
+void PtyBridge::ioLoop()
+{
+    while (!m_stop)
+    {
+        // Terminal to sketch, read straight into the input ring
+        m_serial.fillInput(
+            [this](uint8_t* p_data, size_t p_size)
+            {
+                ssize_t res = ::read(m_master, p_data, p_size);
+                return (res > 0) ? size_t(res) : size_t(0);
+            });
+
+        // Sketch to terminal, written straight from the output ring
+        m_serial.drainOutput(
+            [this](uint8_t const* p_data, size_t p_size)
+            {
+                ssize_t res = ::write(m_master, p_data, p_size);
+                return (res > 0) ? size_t(res) : size_t(0);
+            });
+
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // Wait for the terminal to accept more output, for incoming bytes
+        // (unless the sketch has not yet read the previous ones) or for the
+        // sketch to write. The timeout polls the room made by the sketch in
+        // its input buffer.
+        bool output = m_serial.pendingOutput() > 0;
+        bool input_full =
+            size_t(m_serial.available()) >= SerialEmulator::RX_CAPACITY;
+        struct pollfd fds[2];
+        fds[0].fd = m_master;
+        fds[0].events = short((input_full ? 0 : POLLIN) |
+                              (output ? POLLOUT : 0));
+        fds[0].revents = 0;
+        fds[1].fd = m_wakeup;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if (!m_stop)
+        {
+            poll(fds, 2, input_full ? 10 : 100);
+        }
+
+        m_sleeping.store(false, std::memory_order_relaxed);
+        if ((fds[1].revents & POLLIN) != 0)
+        {
+            uint64_t count;
+            [[maybe_unused]] ssize_t res =
+                ::read(m_wakeup, &count, sizeof(count));
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// ==========================================================================
+//! \file PtyBridge.hpp
+//! \brief Bridge the emulated Serial to a host pseudo-terminal
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+class SerialEmulator;
+
+// ==========================================================================
+//! \brief Expose the emulated Serial as a /dev/pts/N terminal, so that host
+//! tools (minicom, screen, pyserial ...) talk to the sketch as to a board.
+//!
+//! A dedicated I/O thread waits on the nonblocking PTY master with poll():
+//! bytes typed in the terminal are read straight into the serial input ring
+//! and the serial output is written straight from the output ring, without
+//! intermediate copy. The sketch wakes the thread up through notify() when
+//! it writes. While the bridge is open, it is the consumer of the serial
+//! output: the web Serial monitor only shows what the terminal sends.
+// ==========================================================================
+class PtyBridge
+{
+public:
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor.
+    //! \param p_serial Serial port to bridge.
+    // ------------------------------------------------------------------------
+    explicit PtyBridge(SerialEmulator& p_serial);
+
+    // ------------------------------------------------------------------------
+    //! \brief Destructor: stop the I/O thread and remove the terminal.
+    // ------------------------------------------------------------------------
+    ~PtyBridge();
+
+    PtyBridge(PtyBridge const&) = delete;
+    PtyBridge& operator=(PtyBridge const&) = delete;
+
+    // ------------------------------------------------------------------------
+    //! \brief Create the pseudo-terminal and start the I/O thread.
+    //! \return false if the terminal cannot be created.
+    // ------------------------------------------------------------------------
+    bool open();
+
+    // ------------------------------------------------------------------------
+    //! \brief Stop the I/O thread and remove the terminal.
+    // ------------------------------------------------------------------------
+    void close();
+
+    // ------------------------------------------------------------------------
+    //! \brief Path of the terminal to open (e.g. /dev/pts/3).
+    // ------------------------------------------------------------------------
+    std::string const& path() const
+    {
+        return m_path;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Wake up the I/O thread because serial output is pending.
+    //! Callable from the sketch thread: only does a syscall when the I/O
+    //! thread is sleeping.
+    // ------------------------------------------------------------------------
+    void notify();
+
+private:
+
+    // ------------------------------------------------------------------------
+    //! \brief Body of the I/O thread.
+    // ------------------------------------------------------------------------
+    void ioLoop();
+
+private:
+
+    //! \brief Bridged serial port
+    SerialEmulator& m_serial;
+    //! \brief Master side of the pseudo-terminal
+    int m_master = -1;
+    //! \brief Slave side, kept open so that the master does not hang up when
+    //! the last terminal client exits
+    int m_slave = -1;
+    //! \brief eventfd waking up the I/O thread
+    int m_wakeup = -1;
+    //! \brief Path of the slave side
+    std::string m_path;
+    //! \brief I/O thread
+    std::thread m_thread;
+    //! \brief Request the I/O thread to finish
+    std::atomic<bool> m_stop{ false };
+    //! \brief The I/O thread waits in poll()
+    std::atomic<bool> m_sleeping{ false };
+};
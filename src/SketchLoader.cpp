@@ -0,0 +1,124 @@
+// ==========================================================================
+//! \file SketchLoader.cpp
+//! \brief Implementation of the loading of the Arduino sketch
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#include "SketchLoader.hpp"
+
+#include "ArduinoEmulator/ArduinoEmulator.hpp"
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+extern ArduinoEmulator arduino_sim;
+extern void setup();
+extern void loop();
+
+// Symbol names of void setup() and void loop() (Itanium C++ ABI)
+static constexpr const char* SETUP_SYMBOL = "_Z5setupv";
+static constexpr const char* LOOP_SYMBOL = "_Z4loopv";
+
+// ----------------------------------------------------------------------------
+SketchLoader::SketchLoader() : m_setup(&::setup), m_loop(&::loop) {}
+
+// ----------------------------------------------------------------------------
+SketchLoader::~SketchLoader()
+{
+    if (m_handle != nullptr)
+    {
+        dlclose(m_handle);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// The library is loaded from a private copy: the dynamic loader would return
+// the already loaded library for an identical path (the previous sketch is
+// only unloaded once the new one is ready), and the compiler can rewrite the
+// file while it is mapped.
+static std::string copyLibrary(std::string const& p_path)
+{
+    std::string pattern =
+        (std::filesystem::temp_directory_path() / "arduino-sketch-XXXXXX")
+            .string();
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+
+    int fd = mkstemp(name.data());
+    if (fd < 0)
+        return {};
+    close(fd);
+
+    std::error_code error;
+    std::filesystem::copy_file(p_path,
+                               name.data(),
+                               std::filesystem::copy_options::overwrite_existing,
+                               error);
+    if (error)
+    {
+        std::filesystem::remove(name.data(), error);
+        return {};
+    }
+    return name.data();
+}
+
+// ----------------------------------------------------------------------------
+bool SketchLoader::load(std::string const& p_path)
+{
+    std::string copy = copyLibrary(p_path);
+    if (copy.empty())
+    {
+        std::cerr << "Error: Cannot read sketch library: " << p_path << "\n";
+        return false;
+    }
+
+    // The ISR() of the new sketch register themselves while it is loaded:
+    // keep the current ones to restore them on failure.
+    auto previous_vectors = isr_vectors;
+    isr_vectors.fill(nullptr);
+
+    void* handle = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    // The mapping stays valid once the file is removed
+    std::error_code error;
+    std::filesystem::remove(copy, error);
+
+    if (handle == nullptr)
+    {
+        std::cerr << "Error: Cannot load sketch library: " << dlerror()
+                  << "\n";
+        isr_vectors = previous_vectors;
+        return false;
+    }
+
+    auto setup_entry = reinterpret_cast<Entry>(dlsym(handle, SETUP_SYMBOL));
+    auto loop_entry = reinterpret_cast<Entry>(dlsym(handle, LOOP_SYMBOL));
+    if ((setup_entry == nullptr) || (loop_entry == nullptr))
+    {
+        std::cerr << "Error: Sketch library without setup() and loop(): "
+                  << p_path << "\n";
+        dlclose(handle);
+        isr_vectors = previous_vectors;
+        return false;
+    }
+
+    // Forget the code of the previous sketch before unloading it
+    arduino_sim.getInterruptController().clearHandlers();
+    arduino_sim.getTimer().clearCallbacks();
+    if (m_handle != nullptr)
+    {
+        dlclose(m_handle);
+    }
+
+    m_handle = handle;
+    m_path = p_path;
+    m_setup = setup_entry;
+    m_loop = loop_entry;
+    return true;
+}
@@ -0,0 +1,92 @@
+// ==========================================================================
+//! \file SketchLoader.hpp
+//! \brief Load the Arduino sketch from a shared library
+//! \author Lecrapouille
+//! \copyright MIT License
+// ==========================================================================
+
+#pragma once
+
+#include <string>
+
+// ==========================================================================
+//! \brief Entry points of the Arduino sketch: setup() and loop() of the
+//! sketch linked into the emulator (src/arduino_user.cpp), or of a sketch
+//! compiled as a shared library and loaded at runtime.
+//!
+//! The sketch library is not linked against the emulator: its calls to the
+//! Arduino API are resolved to the emulator executable (linked with
+//! -rdynamic), so that it drives the same board. A library can be loaded
+//! again after being rebuilt, without restarting the emulator. Build it
+//! with:
+//!
+//! \code
+//! g++ --std=c++17 -shared -fPIC -fvisibility=hidden -Iinclude
+//!     -include ArduinoEmulator/Arduino.hpp -x c++ sketch.ino
+//!     -o sketch.so
+//! \endcode
+// ==========================================================================
+class SketchLoader
+{
+public:
+
+    //! \brief Sketch function.
+    using Entry = void (*)();
+
+    // ------------------------------------------------------------------------
+    //! \brief Constructor: use the sketch linked into the emulator.
+    // ------------------------------------------------------------------------
+    SketchLoader();
+
+    // ------------------------------------------------------------------------
+    //! \brief Destructor: unload the sketch library.
+    // ------------------------------------------------------------------------
+    ~SketchLoader();
+
+    SketchLoader(SketchLoader const&) = delete;
+    SketchLoader& operator=(SketchLoader const&) = delete;
+
+    // ------------------------------------------------------------------------
+    //! \brief Load a sketch library, replacing the current sketch. Must not
+    //! be called while setup() or loop() is running.
+    //! \param p_path Path of the shared library.
+    //! \return false if the library cannot be loaded or does not define
+    //! setup() and loop() (the current sketch is kept).
+    // ------------------------------------------------------------------------
+    bool load(std::string const& p_path);
+
+    // ------------------------------------------------------------------------
+    //! \brief Path of the loaded sketch library (empty for the linked one).
+    // ------------------------------------------------------------------------
+    std::string const& path() const
+    {
+        return m_path;
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Call the setup() function of the sketch.
+    // ------------------------------------------------------------------------
+    void setup() const
+    {
+        m_setup();
+    }
+
+    // ------------------------------------------------------------------------
+    //! \brief Call the loop() function of the sketch.
+    // ------------------------------------------------------------------------
+    void loop() const
+    {
+        m_loop();
+    }
+
+private:
+
+    //! \brief Handle of the sketch library (nullptr for the linked sketch)
+    void* m_handle = nullptr;
+    //! \brief Path of the sketch library
+    std::string m_path;
+    //! \brief setup() of the sketch
+    Entry m_setup;
+    //! \brief loop() of the sketch
+    Entry m_loop;
+};
@@ -806,6 +806,12 @@ inline std::string loadHTMLContent()
         let autoRefreshInterval = null;
         let lastTick = 0;
         let isRefreshing = false;
+        // Server-Sent Events stream (null when falling back to polling)
+        let eventSource = null;
+        // Last known state of each pin and the change sequence number it
+        // corresponds to: the server only sends pins changed after it.
+        let pinStates = {};
+        let pinsSeq = 0;
 
         // Board configuration (loaded dynamically)
         let boardConfig = {
@@ -857,25 +863,62 @@ inline std::string loadHTMLContent()
 
             isRefreshing = true;
 
-            // Fast lightweight check for state changes
-            fetch('/api/tick')
+            // Single consistent snapshot of the whole emulator state
+            fetch(`/api/state?since=${pinsSeq}`)
                 .then(res => res.json())
                 .then(data => {
-                        refreshAudio();
-                        refreshPins();
-                        refreshStatus();
-                        refreshSerial();
-                        refreshDebugLog();
+                    lastTick = data.tick;
+                    updateAudio(data.audio);
+                    mergePins(data.pins_seq, data.pins);
+                    updateStatusIndicator(data.running);
+                    updateSerial(data.serial);
+                    updateDebugLog(data.debug);
                 })
                 .catch(err => {
-                    console.error('Error checking tick:', err);
+                    console.error('Error fetching state:', err);
                 })
                 .finally(() => {
                     isRefreshing = false;
                 });
         }
 
+        function startEventStream() {
+            if (!window.EventSource) {
+                return;
+            }
+
+            // The server pushes a snapshot of each part of the state as soon
+            // as it changes: no polling needed while the stream is open.
+            eventSource = new EventSource('/api/events');
+            eventSource.addEventListener('status', e => {
+                const data = JSON.parse(e.data);
+                lastTick = data.tick;
+                updateStatusIndicator(data.running);
+            });
+            eventSource.addEventListener('pins', e => {
+                const data = JSON.parse(e.data);
+                mergePins(data.seq, data.pins);
+            });
+            eventSource.addEventListener('audio', e => updateAudio(JSON.parse(e.data)));
+            eventSource.addEventListener('serial', e => updateSerial(JSON.parse(e.data)));
+            eventSource.addEventListener('debug', e => updateDebugLog(JSON.parse(e.data)));
+            eventSource.onerror = () => {
+                // Stream lost: fall back to polling /api/state
+                console.error('Event stream lost, falling back to polling');
+                eventSource.close();
+                eventSource = null;
+                const indicator = document.getElementById('status-indicator');
+                if (indicator.classList.contains('running')) {
+                    startAutoRefresh();
+                }
+            };
+        }
+
         function startAutoRefresh() {
+            // Updates are pushed by the server
+            if (eventSource !== null) {
+                return;
+            }
             if (autoRefreshInterval === null) {
                 autoRefreshInterval = setInterval(checkForUpdates, REFRESH_INTERVAL_MS);
                 // Immediate first check
@@ -967,16 +1010,30 @@ inline std::string loadHTMLContent()
         }
 
         function refreshPins() {
-            fetch('/api/pins')
+            fetch(`/api/pins?since=${pinsSeq}`)
                 .then(res => res.json())
                 .then(data => {
-                    updateVisualBoard(data.pins);
-                    updateGPIOToggles(data.pins);
-                    updatePWMSliders(data.pins);
-                    updateAnalogInputs(data.pins);
+                    mergePins(data.seq, data.pins);
                 });
         }
 
+        function mergePins(seq, changedPins) {
+            // A sequence going backward means the server restarted
+            if (seq < pinsSeq) {
+                pinStates = {};
+            }
+            Object.assign(pinStates, changedPins);
+            pinsSeq = seq;
+            updatePins(pinStates);
+        }
+
+        function updatePins(pins) {
+            updateVisualBoard(pins);
+            updateGPIOToggles(pins);
+            updatePWMSliders(pins);
+            updateAnalogInputs(pins);
+        }
+
         function updateVisualBoard(pins) {
             let digitalHtml = '';
             let analogHtml = '';
@@ -1139,65 +1196,47 @@ inline std::string loadHTMLContent()
             });
         }
 
-        function refreshSerial() {
-            fetch('/api/serial/output')
-                .then(res => res.json())
-                .then(data => {
-                    if (data.output) {
-                        const lines = data.output.split('\n');
-                        lines.forEach(line => {
-                            if (line.trim()) {
-                                addUARTMessage(line);
-                            }
-                        });
+        function updateSerial(serial) {
+            if (serial.output) {
+                const lines = serial.output.split('\n');
+                lines.forEach(line => {
+                    if (line.trim()) {
+                        addUARTMessage(line);
                     }
                 });
+            }
         }
 
-        function refreshDebugLog() {
-            fetch('/api/debug')
-                .then(res => res.json())
-                .then(data => {
-                    if (data.messages && data.messages.length > 0) {
-                        data.messages.forEach(message => {
-                            addDebugMessage(message);
-                        });
-                    }
-                })
-                .catch(err => {
-                    console.error('Error fetching debug log:', err);
+        function updateDebugLog(messages) {
+            if (messages && messages.length > 0) {
+                messages.forEach(message => {
+                    addDebugMessage(message);
                 });
+            }
         }
 
-        function refreshAudio() {
-            fetch('/api/audio')
-                .then(res => res.json())
-                .then(data => {
-                    const indicator = document.getElementById('sound-indicator');
-                    const statusText = document.getElementById('sound-status-text');
-                    const pinDisplay = document.getElementById('sound-pin');
-                    const frequencyDisplay = document.getElementById('sound-frequency');
-                    const noteDisplay = document.getElementById('sound-note');
-
-                    if (data.playing) {
-                        indicator.classList.add('playing');
-                        statusText.textContent = 'Playing';
-                        statusText.style.color = '#4CAF50';
-                        pinDisplay.textContent = data.pin >= 0 ? 'D' + data.pin : '-';
-                        frequencyDisplay.textContent = data.frequency + ' Hz';
-                        noteDisplay.textContent = data.note;
-                    } else {
-                        indicator.classList.remove('playing');
-                        statusText.textContent = 'Silent';
-                        statusText.style.color = '#999';
-                        pinDisplay.textContent = '-';
-                        frequencyDisplay.textContent = '0 Hz';
-                        noteDisplay.textContent = '-';
-                    }
-                })
-                .catch(err => {
-                    console.error('Error fetching audio status:', err);
-                });
+        function updateAudio(audio) {
+            const indicator = document.getElementById('sound-indicator');
+            const statusText = document.getElementById('sound-status-text');
+            const pinDisplay = document.getElementById('sound-pin');
+            const frequencyDisplay = document.getElementById('sound-frequency');
+            const noteDisplay = document.getElementById('sound-note');
+
+            if (audio.playing) {
+                indicator.classList.add('playing');
+                statusText.textContent = 'Playing';
+                statusText.style.color = '#4CAF50';
+                pinDisplay.textContent = audio.pin >= 0 ? 'D' + audio.pin : '-';
+                frequencyDisplay.textContent = audio.frequency + ' Hz';
+                noteDisplay.textContent = audio.note;
+            } else {
+                indicator.classList.remove('playing');
+                statusText.textContent = 'Silent';
+                statusText.style.color = '#999';
+                pinDisplay.textContent = '-';
+                frequencyDisplay.textContent = '0 Hz';
+                noteDisplay.textContent = '-';
+            }
         }
 
         function addUARTMessage(message) {
@@ -1438,10 +1477,12 @@ inline std::string loadHTMLContent()
             // Load board config first (generates all panels and initializes GPIO toggles)
             loadBoardConfig();
 
-            // Refresh pins and status to get initial state
+            // Refresh pins and status to get initial state, then listen to
+            // the changes pushed by the server
             setTimeout(() => {
                 refreshPins();
                 refreshStatus(); // Ensure status indicator is red on start
+                startEventStream();
             }, 100);
 
             addDebugMessage('[SYSTEM] Arduino Emulator ready');
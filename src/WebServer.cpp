@@ -12,23 +12,58 @@
 
 #include "nlohmann/json.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 
 // ----------------------------------------------------------------------------
 extern ArduinoEmulator arduino_sim;
-extern ToneGenerator tone_generator;
-extern void setup();
-extern void loop();
 
 // ----------------------------------------------------------------------------
-WebServer::WebServer(Config const& p_config) : m_config(p_config) {}
+WebServer::WebServer(Config const& p_config, SketchLoader& p_sketch)
+    : m_config(p_config), m_sketch(p_sketch)
+{
+    arduino_sim.configurePins(m_config.board.total_pins,
+                              m_config.board.pwm_pins,
+                              m_config.board.analog_input_pins);
+    arduino_sim.configureUarts(m_config.board.uarts);
+    arduino_sim.getTimer().setClockMode(
+        m_config.virtual_clock ? ClockMode::Virtual : ClockMode::RealTime,
+        m_config.speed);
+    UartTiming uart_timing = UartTiming::Instant;
+    parseUartTiming(m_config.uart_timing, uart_timing);
+    arduino_sim.setUartTiming(uart_timing);
+    arduino_sim.getEEPROM().setWriteLatency(m_config.eeprom_latency);
+
+    // Forward the emulator changes to the Server-Sent Events streams
+    arduino_sim.setEventHandler(
+        [this](EmulatorEvent p_event, int p_pin)
+        {
+            switch (p_event)
+            {
+                case EmulatorEvent::PinChanged:
+                    m_events.publish(EventBroker::Pins);
+                    break;
+                case EmulatorEvent::SerialOutput:
+                    if (size_t(p_pin) < m_ptys.size())
+                        m_ptys[size_t(p_pin)]->notify();
+                    m_events.publish(EventBroker::Serial);
+                    break;
+                case EmulatorEvent::ToneChanged:
+                    m_events.publish(EventBroker::Audio);
+                    break;
+            }
+        });
+}
 
 // ----------------------------------------------------------------------------
 WebServer::~WebServer()
 {
     stop();
+    arduino_sim.setEventHandler(nullptr);
 }
 
 // ----------------------------------------------------------------------------
@@ -54,6 +89,9 @@ void WebServer::setupRoutes()
     m_server.Post("/api/reset",
                   [this](httplib::Request const& req, httplib::Response& res)
                   { handleResetSimulation(req, res); });
+    m_server.Post("/api/sketch/reload",
+                  [this](httplib::Request const& req, httplib::Response& res)
+                  { handleSketchReload(req, res); });
     m_server.Get("/api/tick",
                  [this](httplib::Request const& req, httplib::Response& res)
                  { handleGetTick(req, res); });
@@ -64,6 +102,12 @@ void WebServer::setupRoutes()
                  [this](httplib::Request const& req, httplib::Response& res)
                  { handleGetDebugLog(req, res); });
 
+    // Snapshot of pins, audio, status, serial output and debug messages in a
+    // single request (one UI refresh)
+    m_server.Get("/api/state",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleGetState(req, res); });
+
     // Digital pins
     m_server.Get("/api/pins",
                  [this](httplib::Request const& req, httplib::Response& res)
@@ -90,33 +134,184 @@ void WebServer::setupRoutes()
                   [this](httplib::Request const& req, httplib::Response& res)
                   { handleSerialInput(req, res); });
 
+    // I2C devices
+    m_server.Get("/api/i2c",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleGetI2C(req, res); });
+    m_server.Post("/api/i2c/device",
+                  [this](httplib::Request const& req, httplib::Response& res)
+                  { handleI2CDevice(req, res); });
+    m_server.Post("/api/i2c/registers",
+                  [this](httplib::Request const& req, httplib::Response& res)
+                  { handleI2CRegisters(req, res); });
+
+    // SPI devices
+    m_server.Get("/api/spi",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleGetSPI(req, res); });
+    m_server.Post("/api/spi/device",
+                  [this](httplib::Request const& req, httplib::Response& res)
+                  { handleSPIDevice(req, res); });
+    m_server.Post("/api/spi/registers",
+                  [this](httplib::Request const& req, httplib::Response& res)
+                  { handleSPIRegisters(req, res); });
+    m_server.Get("/api/spi/wear",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleSPIWear(req, res); });
+
+    // EEPROM content and wear
+    m_server.Get("/api/eeprom",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleGetEEPROM(req, res); });
+
     // Audio status
     m_server.Get("/api/audio",
                  [this](httplib::Request const& req, httplib::Response& res)
                  { handleGetAudio(req, res); });
+
+    // Server-Sent Events: push pins, serial, audio, status and debug changes
+    m_server.Get("/api/events",
+                 [this](httplib::Request const& req, httplib::Response& res)
+                 { handleEvents(req, res); });
+}
+
+// ----------------------------------------------------------------------------
+// Hybrid sleep: the OS sleep is only precise to tens of microseconds, so sleep
+// until shortly before the deadline and spin for the remaining time. This
+// allows loop rates of tens of kHz without burning a core at low rates.
+// Interrupts raised meanwhile are serviced.
+static void sleepUntil(std::chrono::steady_clock::time_point deadline)
+{
+    const auto spin_threshold = std::chrono::microseconds(100);
+
+    auto now = std::chrono::steady_clock::now();
+    if (deadline - now > spin_threshold)
+    {
+        arduino_sim.sleepUntil(deadline - spin_threshold);
+    }
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        arduino_sim.serviceInterrupts();
+        std::this_thread::yield();
+    }
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::sketchThread()
+{
+    // Flag the end of the thread, even when unwound by a cancellation
+    struct ExitFlag
+    {
+        std::atomic<bool>& exited;
+        ~ExitFlag()
+        {
+            exited = true;
+        }
+    } exit_flag{ m_sketch_exited };
+
+    try
+    {
+        runArduinoSimulation();
+    }
+    catch (SketchCancelled const&)
+    {
+        // Unwound at a safe point by cancelSketchThread()
+    }
 }
 
 // ----------------------------------------------------------------------------
 void WebServer::runArduinoSimulation()
 {
-    // Start the timer (but not the internal thread)
-    arduino_sim.getTimer().start();
+    TimerEmulator& timer = arduino_sim.getTimer();
 
-    // Call Arduino setup
-    setup();
+    // ISRs are executed by this thread, between two Arduino API calls
+    arduino_sim.getInterruptController().bindThread();
 
-    // Calculate target loop period based on refresh frequency
+    // Report the time taken by the watchdog to replace the frozen sketch
+    if (m_restarting.exchange(false))
+    {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_freeze_time);
+        m_restart_latency_us = uint64_t(latency.count());
+        m_watchdog_restarts++;
+        addDebugLog("[WATCHDOG] Sketch restarted in " +
+                    std::to_string(latency.count() / 1000) + " ms");
+    }
+
+    // Call Arduino setup. The safe point parks the thread if it has been
+    // abandoned meanwhile, instead of going on with loop().
+    m_sketch.setup();
+    arduino_sim.serviceInterrupts();
+
+    // Free-running mode: call loop() back-to-back. With the virtual clock,
+    // the simulated time advances by the host time spent in loop(). It is
+    // accumulated in nanoseconds, so that loops shorter than a microsecond
+    // still move the time forward.
+    if (m_config.frequency == 0)
+    {
+        uint64_t elapsed_ns = 0;
+        while (arduino_sim.isRunning())
+        {
+            auto start = std::chrono::steady_clock::now();
+            m_sketch.loop();
+            arduino_sim.serviceInterrupts();
+            m_tick_counter++;
+
+            if (timer.clockMode() == ClockMode::Virtual)
+            {
+                elapsed_ns += uint64_t(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count());
+                timer.advance(elapsed_ns / 1000u, false);
+                elapsed_ns %= 1000u;
+            }
+        }
+        return;
+    }
+
+    // Calculate target loop period based on the loop frequency
     // For example: 10 Hz -> 100ms per loop
-    const auto loop_period =
-        std::chrono::microseconds(1000000 / m_config.frequency);
+    const auto loop_period = std::chrono::nanoseconds(
+        std::chrono::nanoseconds::rep(1000000000 / m_config.frequency));
+
+    if (timer.clockMode() == ClockMode::Virtual)
+    {
+        // Same fixed-interval scheduling than below but in simulated time:
+        // the virtual clock jumps to the next loop time (sleeping only
+        // according to the speed factor).
+        const auto period_ns = uint64_t(loop_period.count());
+        uint64_t next_loop_ns = uint64_t(timer.micros()) * 1000u;
+
+        while (arduino_sim.isRunning())
+        {
+            m_sketch.loop();
+            arduino_sim.serviceInterrupts();
+            m_tick_counter++;
+
+            next_loop_ns += period_ns;
+            uint64_t now_ns = uint64_t(timer.micros()) * 1000u;
+            if (now_ns + 1000u <= next_loop_ns)
+            {
+                arduino_sim.delayMicroseconds(
+                    long((next_loop_ns - now_ns) / 1000u));
+            }
+            else if (now_ns > next_loop_ns)
+            {
+                next_loop_ns = now_ns;
+            }
+        }
+        return;
+    }
 
     auto next_loop_time = std::chrono::steady_clock::now();
 
     // Use arduino_sim's running flag to control the loop
     while (arduino_sim.isRunning())
     {
-        // Call Arduino loop
-        loop();
+        // Call Arduino loop, then service the interrupts it masked
+        m_sketch.loop();
+        arduino_sim.serviceInterrupts();
 
         // Increment tick counter to notify clients of potential changes.
         // Watchdog thread monitors this to detect infinite loops.
@@ -130,7 +325,7 @@ void WebServer::runArduinoSimulation()
         auto now = std::chrono::steady_clock::now();
         if (now < next_loop_time)
         {
-            std::this_thread::sleep_until(next_loop_time);
+            sleepUntil(next_loop_time);
         }
         else
         {
@@ -149,22 +344,86 @@ void WebServer::stopArduinoSimulation()
     }
 
     // Signal threads to stop
-    arduino_sim.setRunning(false);
     m_watchdog_should_stop = true;
-
-    // Wait for threads to finish
     if (m_watchdog_thread.joinable())
     {
         m_watchdog_thread.join();
     }
 
-    if (m_arduino_thread.joinable())
+    // Terminate the sketch, even if it is stuck in an infinite loop
+    cancelSketchThread();
+
+    // Stop the callback dispatcher and reset timer
+    arduino_sim.stop();
+    arduino_sim.getTimer().stop();
+
+    m_events.publish(EventBroker::Status);
+}
+
+// ----------------------------------------------------------------------------
+bool WebServer::waitSketchExit(std::chrono::milliseconds p_timeout) const
+{
+    auto deadline = std::chrono::steady_clock::now() + p_timeout;
+    while (!m_sketch_exited)
     {
-        m_arduino_thread.join();
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
+    return true;
+}
 
-    // Reset timer
-    arduino_sim.getTimer().stop();
+// ----------------------------------------------------------------------------
+bool WebServer::cancelSketchThread()
+{
+    const auto grace_period = std::chrono::milliseconds(500);
+
+    if (!m_arduino_thread.joinable())
+        return true;
+
+    // Ask the sketch to unwind at its next Arduino API call or delay
+    arduino_sim.setRunning(false);
+    arduino_sim.getInterruptController().cancel();
+
+    // Release the sketch if it is blocked on a full serial output buffer,
+    // of any UART of the board
+    for (size_t port = 0; port < arduino_sim.getUartCount(); ++port)
+    {
+        arduino_sim.getSerial(port).end();
+    }
+
+    if (!waitSketchExit(grace_period))
+    {
+        // Spinning without reaching a cancellation point: a thread cannot be
+        // killed safely, so give up without blocking the caller. The thread
+        // parks at its next Arduino API call; until then, it keeps a core
+        // busy and the sketch library cannot be unloaded.
+        m_arduino_thread.detach();
+        {
+            std::scoped_lock lock(m_abandoned_mutex);
+            m_abandoned_sketches.push_back(
+                arduino_sim.getInterruptController().abandon());
+        }
+        addDebugLog("[ERROR] The sketch is stuck without Arduino API call: "
+                    "its thread is abandoned");
+        return false;
+    }
+
+    m_arduino_thread.join();
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+bool WebServer::abandonedSketchRunning()
+{
+    std::scoped_lock lock(m_abandoned_mutex);
+    m_abandoned_sketches.erase(
+        std::remove_if(m_abandoned_sketches.begin(),
+                       m_abandoned_sketches.end(),
+                       [](auto const& state)
+                       { return state->load() == SketchState::Parked; }),
+        m_abandoned_sketches.end());
+    return !m_abandoned_sketches.empty();
 }
 
 // ----------------------------------------------------------------------------
@@ -189,26 +448,19 @@ void WebServer::watchdogThread()
             {
                 // Infinite loop detected!
                 std::cerr << "ERROR: Infinite loop detected in loop() "
-                             "function! Stopping simulation..."
+                             "function! Restarting simulation..."
                           << std::endl;
+                m_freeze_time = std::chrono::steady_clock::now();
 
-                // Add debug message for the web interface
+                // Kill the frozen sketch thread to reclaim its CPU (or abandon
+                // it if it does not unwind), then restart the sketch as a
+                // hardware watchdog reset would do
+                cancelSketchThread();
                 addDebugLog(
                     "[ERROR] Infinite loop detected in loop() function! "
-                    "Simulation stopped.");
-
-                // Stop the simulation
-                arduino_sim.setRunning(false);
-                m_watchdog_should_stop = true;
-
-                // Detach the frozen Arduino thread (it won't terminate by
-                // itself)
-                if (m_arduino_thread.joinable())
-                {
-                    m_arduino_thread.detach();
-                }
-
-                // Exit watchdog
+                    "Simulation restarted.");
+                m_restarting = true;
+                restartArduinoSimulation();
                 return;
             }
         }
@@ -229,6 +481,45 @@ bool WebServer::start()
         return true;
     }
 
+    // Non-volatile memories, kept across runs in their files
+    if (!arduino_sim.getEEPROM().open(m_config.eeprom_file,
+                                      m_config.board.eeprom))
+    {
+        return false;
+    }
+    if (!m_config.spi_flash.empty())
+    {
+        auto flash = arduino_sim.makeSPIFlash(m_config.spi_flash_size);
+        if (!flash->open(m_config.spi_flash))
+        {
+            return false;
+        }
+        arduino_sim.getSPI().attach(m_config.spi_flash_cs, flash);
+    }
+
+    // Record the pin changes from now on
+    if (!m_config.vcd_file.empty() &&
+        !arduino_sim.startRecording(m_config.vcd_file))
+    {
+        return false;
+    }
+
+    // One terminal per UART of the board
+    if (m_config.pty)
+    {
+        for (size_t port = 0; port < arduino_sim.getUartCount(); ++port)
+        {
+            m_ptys.push_back(
+                std::make_unique<PtyBridge>(arduino_sim.getSerial(port)));
+            if (!m_ptys.back()->open())
+            {
+                m_ptys.clear();
+                arduino_sim.stopRecording();
+                return false;
+            }
+        }
+    }
+
     // Setup API Rest routes
     setupRoutes();
 
@@ -254,6 +545,7 @@ void WebServer::stop()
         return;
 
     stopArduinoSimulation();
+    m_events.shutdown();
     m_server.stop();
 
     if (m_server_thread.joinable())
@@ -261,6 +553,8 @@ void WebServer::stop()
         m_server_thread.join();
     }
 
+    arduino_sim.stopRecording();
+    m_ptys.clear();
     m_server_running = false;
 }
 
@@ -271,10 +565,10 @@ void WebServer::handleHomePage(httplib::Request const&,
     // Load HTML content stored in the hpp file
     std::string html = webinterface::loadHTMLContent();
 
-    // Inject refresh rate into HTML (convert Hz to milliseconds)
-    // Client should poll at least 2x faster than Arduino loop (Nyquist theorem)
-    // to avoid missing state changes
-    size_t refresh_ms = 1000 / (2 * m_config.frequency);
+    // Inject refresh rate into HTML (convert Hz to milliseconds). By default
+    // the client polls 2x faster than Arduino loop (Nyquist theorem) to avoid
+    // missing state changes, but never faster than the browser can display.
+    size_t refresh_ms = 1000 / m_config.refresh_rate;
     std::string refresh_placeholder = "##REFRESH_INTERVAL##";
     size_t pos = html.find(refresh_placeholder);
     if (pos != std::string::npos)
@@ -301,6 +595,16 @@ void WebServer::handleStartSimulation(httplib::Request const&,
         return;
     }
 
+    startArduinoSimulation();
+
+    response["status"] = "success";
+    response["message"] = "Simulation started";
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::startArduinoSimulation()
+{
     // Clean up any existing threads
     if (m_arduino_thread.joinable())
     {
@@ -312,17 +616,16 @@ void WebServer::handleStartSimulation(httplib::Request const&,
         m_watchdog_thread.join();
     }
 
-    // Start Arduino simulation and watchdog thread
-    arduino_sim.setRunning(true);
+    // Start the timers and their callback dispatcher, then the Arduino
+    // simulation and watchdog thread
+    arduino_sim.start();
     m_watchdog_should_stop = false;
     m_tick_counter = 0;
 
-    m_arduino_thread = std::thread([this]() { runArduinoSimulation(); });
+    m_sketch_exited = false;
+    m_arduino_thread = std::thread([this]() { sketchThread(); });
     m_watchdog_thread = std::thread([this]() { watchdogThread(); });
-
-    response["status"] = "success";
-    response["message"] = "Simulation started";
-    res.set_content(response.dump(), "application/json");
+    m_events.publish(EventBroker::Status);
 }
 
 // ----------------------------------------------------------------------------
@@ -361,17 +664,77 @@ void WebServer::handleResetSimulation(httplib::Request const&,
 }
 
 // ----------------------------------------------------------------------------
-void WebServer::handleGetPins(httplib::Request const&,
-                              httplib::Response& res) const
+void WebServer::handleSketchReload(httplib::Request const&,
+                                   httplib::Response& res)
 {
     nlohmann::json response;
-    nlohmann::json pins_data;
+    auto start = std::chrono::steady_clock::now();
+
+    // Only the library given on the command line is reloaded: loading a
+    // path received from the network would execute any code on the host
+    std::string path =
+        m_sketch.path().empty() ? m_config.sketch_file : m_sketch.path();
+    if (path.empty())
+    {
+        response["status"] = "error";
+        response["message"] = "No sketch library to reload";
+        res.set_content(response.dump(), "application/json");
+        return;
+    }
+
+    // The code of the current sketch cannot be unloaded while it runs: a
+    // sketch thread which could not be joined and has not parked yet still
+    // executes it. The new sketch starts from a board reset, as after an
+    // upload.
+    if (abandonedSketchRunning())
+    {
+        response["status"] = "error";
+        response["message"] = "An abandoned sketch thread still executes the "
+                              "library: restart the emulator to reload it";
+        res.set_content(response.dump(), "application/json");
+        return;
+    }
+    bool was_running = arduino_sim.isRunning();
+    stopArduinoSimulation();
+    arduino_sim.reset();
 
-    // Retrieve state of all pins (0-19)
-    for (size_t i = 0; i < m_config.board.total_pins; i++)
+    if (m_sketch.load(path))
+    {
+        addDebugLog("[INFO] Sketch loaded: " + path);
+        response["status"] = "success";
+        response["message"] = "Sketch reloaded";
+    }
+    else
+    {
+        response["status"] = "error";
+        response["message"] = "Cannot load sketch library: " + path;
+    }
+
+    if (was_running)
+    {
+        startArduinoSimulation();
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    response["path"] = m_sketch.path();
+    response["reload_ms"] = double(elapsed.count()) / 1000.0;
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+// Helper function returning the state of the pins of the board modified after
+// the change sequence number 'since' (0 for all pins).
+static nlohmann::json pinsToJson(size_t total_pins, uint64_t since = 0)
+{
+    nlohmann::json pins_data = nlohmann::json::object();
+
+    for (size_t i = 0; i < total_pins; i++)
     {
         Pin const* pin = arduino_sim.getPin(int(i));
-        if (pin)
+        if (pin &&
+            ((since == 0) ||
+             (pin->change_seq.load(std::memory_order_acquire) > since)))
         {
             nlohmann::json pin_data;
             pin_data["value"] = pin->value;
@@ -383,7 +746,42 @@ void WebServer::handleGetPins(httplib::Request const&,
         }
     }
 
-    response["pins"] = pins_data;
+    return pins_data;
+}
+
+// ----------------------------------------------------------------------------
+// Helper function parsing the change sequence number already known by the
+// client. Returns 0 (full state) when absent, invalid, or newer than the
+// emulator sequence (i.e. the client knew a previous run of the server).
+static uint64_t parseSince(httplib::Request const& req, uint64_t current_seq)
+{
+    if (!req.has_param("since"))
+        return 0;
+
+    try
+    {
+        uint64_t since = std::stoull(req.get_param_value("since"));
+        return (since <= current_seq) ? since : 0;
+    }
+    catch (const std::exception&)
+    {
+        return 0;
+    }
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleGetPins(httplib::Request const& req,
+                              httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    // Read the sequence before the pins: a change made during the dump will
+    // be sent again on next request rather than lost.
+    uint64_t seq = arduino_sim.getPinChangeSeq();
+    response["seq"] = seq;
+    response["pins"] =
+        pinsToJson(m_config.board.total_pins, parseSince(req, seq));
+
     res.set_content(response.dump(), "application/json");
 }
 
@@ -437,14 +835,46 @@ void WebServer::handleSetPin(httplib::Request const& req,
     res.set_content(response.dump(), "application/json");
 }
 
+// ----------------------------------------------------------------------------
+std::vector<std::string> WebServer::serialPorts() const
+{
+    std::vector<std::string> paths;
+    for (auto const& pty : m_ptys)
+    {
+        paths.push_back(pty->path());
+    }
+    return paths;
+}
+
+// ----------------------------------------------------------------------------
+nlohmann::json WebServer::serialToJson() const
+{
+    // The output of all the UARTs is drained at once, except when terminals
+    // consume it
+    nlohmann::json ports = nlohmann::json::array();
+    for (size_t port = 0; port < arduino_sim.getUartCount(); ++port)
+    {
+        SerialEmulator& uart = arduino_sim.getSerial(port);
+        SerialEmulator::Stats stats = uart.getStats();
+        nlohmann::json data;
+        data["output"] = m_ptys.empty() ? uart.getOutput() : std::string();
+        data["dropped"] = stats.dropped;
+        data["tx_bytes"] = stats.tx_bytes;
+        data["rx_bytes"] = stats.rx_bytes;
+        ports.push_back(data);
+    }
+
+    // Serial at the top level, as before the support of several UARTs
+    nlohmann::json serial = ports[0];
+    serial["ports"] = ports;
+    return serial;
+}
+
 // ----------------------------------------------------------------------------
 void WebServer::handleSerialOutput(httplib::Request const&,
                                    httplib::Response& res) const
 {
-    nlohmann::json response;
-    std::string output = arduino_sim.getSerial().getOutput();
-    response["output"] = output;
-    res.set_content(response.dump(), "application/json");
+    res.set_content(serialToJson().dump(), "application/json");
 }
 
 // ----------------------------------------------------------------------------
@@ -457,8 +887,13 @@ void WebServer::handleSerialInput(httplib::Request const& req,
     {
         auto json_data = nlohmann::json::parse(req.body);
         std::string data = json_data["data"];
+        size_t port = json_data.value("port", size_t(0));
+        if (port >= arduino_sim.getUartCount())
+        {
+            throw std::out_of_range("No serial port " + std::to_string(port));
+        }
 
-        arduino_sim.getSerial().addInput(data + "\n");
+        arduino_sim.getSerial(port).addInput(data + "\n");
 
         response["status"] = "success";
         response["message"] = "Data sent to Serial";
@@ -489,6 +924,7 @@ void WebServer::handlePWMSet(httplib::Request const& req,
         if (p && p->pwm_capable)
         {
             p->pwm_value = value;
+            arduino_sim.markPinChanged(pin);
             response["status"] = "success";
             response["message"] = "PWM on pin " + std::to_string(pin) +
                                   " set to " + std::to_string(value);
@@ -521,9 +957,9 @@ void WebServer::handleAnalogSet(httplib::Request const& req,
         int pin = json_data["pin"];
         int value = json_data["value"];
 
-        // Set analog value (A0-A5 = pins 14-19)
-        int actual_pin = pin + 14;
-        if (actual_pin >= 14 && actual_pin <= 19)
+        // Set analog value (i.e. A0-A5 = pins 14-19 on Arduino Uno)
+        int actual_pin = arduino_sim.getAnalogPin(pin);
+        if (actual_pin >= 0)
         {
             // Use the new setAnalogValue method which properly stores
             // the analog value for analogRead()
@@ -547,6 +983,375 @@ void WebServer::handleAnalogSet(httplib::Request const& req,
     res.set_content(response.dump(), "application/json");
 }
 
+// ----------------------------------------------------------------------------
+void WebServer::handleGetI2C(httplib::Request const&,
+                             httplib::Response& res) const
+{
+    I2CBus& bus = arduino_sim.getI2C();
+    nlohmann::json devices = nlohmann::json::array();
+    for (uint8_t address : bus.addresses())
+    {
+        nlohmann::json device;
+        device["address"] = address;
+        auto registers =
+            std::dynamic_pointer_cast<I2CRegisterDevice>(bus.device(address));
+        if (registers)
+        {
+            device["registers"] = registers->registers();
+        }
+        devices.push_back(device);
+    }
+
+    nlohmann::json response;
+    response["clock"] = bus.clock();
+    response["devices"] = devices;
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleI2CDevice(httplib::Request const& req,
+                                httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    try
+    {
+        auto json_data = nlohmann::json::parse(req.body);
+        int address = json_data.at("address").get<int>();
+        if (!I2CBus::isDeviceAddress(address))
+        {
+            response["status"] = "error";
+            response["message"] = "I2C address must be in 0x08 .. 0x77";
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+
+        if (json_data.value("remove", false))
+        {
+            arduino_sim.getI2C().attach(uint8_t(address), nullptr);
+            response["message"] = "I2C device removed";
+        }
+        else
+        {
+            auto device = std::make_shared<I2CRegisterDevice>(
+                json_data.value("size", size_t(256)));
+            device->setRegisters(
+                0u,
+                json_data.value("registers", std::vector<uint8_t>()));
+            arduino_sim.getI2C().attach(uint8_t(address), device);
+            response["message"] = "I2C device plugged";
+        }
+        response["status"] = "success";
+    }
+    catch (const std::exception& e)
+    {
+        response["status"] = "error";
+        response["message"] = std::string("Error: ") + e.what();
+    }
+
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleI2CRegisters(httplib::Request const& req,
+                                   httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    try
+    {
+        auto json_data = nlohmann::json::parse(req.body);
+        int address = json_data.at("address").get<int>();
+        if (!I2CBus::isDeviceAddress(address))
+        {
+            response["status"] = "error";
+            response["message"] = "I2C address must be in 0x08 .. 0x77";
+            res.set_content(response.dump(), "application/json");
+            return;
+        }
+        auto device = std::dynamic_pointer_cast<I2CRegisterDevice>(
+            arduino_sim.getI2C().device(uint8_t(address)));
+        if (device)
+        {
+            device->setRegisters(
+                json_data.value("register", uint8_t(0)),
+                json_data["values"].get<std::vector<uint8_t>>());
+            response["status"] = "success";
+            response["message"] = "I2C registers set";
+        }
+        else
+        {
+            response["status"] = "error";
+            response["message"] = "No I2C register device at address " +
+                                  std::to_string(address);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        response["status"] = "error";
+        response["message"] = std::string("Error: ") + e.what();
+    }
+
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleGetSPI(httplib::Request const&,
+                             httplib::Response& res) const
+{
+    SPIBus& bus = arduino_sim.getSPI();
+    nlohmann::json devices = nlohmann::json::array();
+    for (int cs_pin : bus.chipSelects())
+    {
+        nlohmann::json device;
+        device["cs"] = cs_pin;
+        auto spi_device = bus.device(cs_pin);
+        if (auto registers =
+                std::dynamic_pointer_cast<SPIRegisterDevice>(spi_device))
+        {
+            device["type"] = "registers";
+            device["registers"] = registers->registers();
+        }
+        else if (auto framebuffer =
+                     std::dynamic_pointer_cast<SPIFramebufferDevice>(
+                         spi_device))
+        {
+            device["type"] = "framebuffer";
+            device["frames"] = framebuffer->frames();
+            device["frame"] = framebuffer->frame();
+        }
+        else if (auto flash =
+                     std::dynamic_pointer_cast<SPIFlashDevice>(spi_device))
+        {
+            SPIFlashDevice::Stats stats = flash->getStats();
+            device["type"] = "flash";
+            device["size"] = flash->size();
+            device["jedec_id"] = flash->jedecId();
+            device["read_bytes"] = stats.read_bytes;
+            device["programmed_bytes"] = stats.programmed_bytes;
+            device["erased_sectors"] = stats.erased_sectors;
+        }
+        devices.push_back(device);
+    }
+
+    // Last transfers with their first bytes
+    nlohmann::json trace = nlohmann::json::array();
+    for (SPIBus::Transfer const& transfer : bus.trace())
+    {
+        size_t count = std::min(transfer.size, SPIBus::TRACE_BYTES);
+        nlohmann::json entry;
+        entry["time"] = transfer.time_us;
+        entry["cs"] = transfer.cs_pin;
+        entry["size"] = transfer.size;
+        entry["mosi"] = std::vector<uint8_t>(transfer.mosi.begin(),
+                                             transfer.mosi.begin() + count);
+        entry["miso"] = std::vector<uint8_t>(transfer.miso.begin(),
+                                             transfer.miso.begin() + count);
+        trace.push_back(entry);
+    }
+
+    nlohmann::json response;
+    response["clock"] = bus.clock();
+    response["transfers"] = bus.transfers();
+    response["devices"] = devices;
+    response["trace"] = trace;
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+// Path of a flash image received from the network: a relative path inside
+// the --spi-flash-dir directory, without "..", whose real location (after
+// the symbolic links) stays inside the directory. Empty if refused.
+static std::string flashImagePath(std::string const& p_dir,
+                                  std::string const& p_image)
+{
+    namespace fs = std::filesystem;
+
+    fs::path image(p_image);
+    if (p_dir.empty() || image.empty() || image.is_absolute())
+        return {};
+    for (auto const& part : image)
+    {
+        if (part == "..")
+            return {};
+    }
+
+    std::error_code error;
+    fs::path dir = fs::weakly_canonical(p_dir, error);
+    fs::path path = fs::weakly_canonical(dir / image, error);
+    if (error)
+        return {};
+    auto mismatch = std::mismatch(dir.begin(), dir.end(), path.begin());
+    return (mismatch.first == dir.end()) ? path.string() : std::string();
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleSPIDevice(httplib::Request const& req,
+                                httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    try
+    {
+        auto json_data = nlohmann::json::parse(req.body);
+        int cs_pin = json_data["cs"];
+        std::string type = json_data.value("type", "registers");
+
+        if (json_data.value("remove", false))
+        {
+            arduino_sim.getSPI().attach(cs_pin, nullptr);
+            response["status"] = "success";
+            response["message"] = "SPI device removed";
+        }
+        else if (type == "registers")
+        {
+            auto device = std::make_shared<SPIRegisterDevice>(
+                json_data.value("size", size_t(128)));
+            device->setRegisters(
+                0u,
+                json_data.value("registers", std::vector<uint8_t>()));
+            arduino_sim.getSPI().attach(cs_pin, device);
+            response["status"] = "success";
+            response["message"] = "SPI device plugged";
+        }
+        else if (type == "framebuffer")
+        {
+            arduino_sim.getSPI().attach(
+                cs_pin,
+                std::make_shared<SPIFramebufferDevice>(
+                    json_data.value("size", size_t(1024))));
+            response["status"] = "success";
+            response["message"] = "SPI device plugged";
+        }
+        else if (type == "flash")
+        {
+            size_t size = json_data.value("size", size_t(16u * 1024u * 1024u));
+            std::string image = json_data.value("image", std::string());
+            std::string path = flashImagePath(m_config.spi_flash_dir, image);
+            auto flash = arduino_sim.makeSPIFlash(size);
+            if (size > SPIFlashDevice::MAX_SIZE)
+            {
+                response["status"] = "error";
+                response["message"] = "SPI flash size must be at most " +
+                                      std::to_string(SPIFlashDevice::MAX_SIZE);
+            }
+            else if (!image.empty() && path.empty())
+            {
+                response["status"] = "error";
+                response["message"] = "Flash image must be a relative path "
+                                      "inside --spi-flash-dir";
+            }
+            else if (flash->open(path))
+            {
+                arduino_sim.getSPI().attach(cs_pin, flash);
+                response["status"] = "success";
+                response["message"] = "SPI device plugged";
+            }
+            else
+            {
+                response["status"] = "error";
+                response["message"] = "Cannot map the flash image";
+            }
+        }
+        else
+        {
+            response["status"] = "error";
+            response["message"] = "Unknown SPI device type: " + type;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        response["status"] = "error";
+        response["message"] = std::string("Error: ") + e.what();
+    }
+
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleSPIRegisters(httplib::Request const& req,
+                                   httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    try
+    {
+        auto json_data = nlohmann::json::parse(req.body);
+        int cs_pin = json_data["cs"];
+        auto device = std::dynamic_pointer_cast<SPIRegisterDevice>(
+            arduino_sim.getSPI().device(cs_pin));
+        if (device)
+        {
+            device->setRegisters(
+                json_data.value("register", uint8_t(0)),
+                json_data["values"].get<std::vector<uint8_t>>());
+            response["status"] = "success";
+            response["message"] = "SPI registers set";
+        }
+        else
+        {
+            response["status"] = "error";
+            response["message"] = "No SPI register device on CS pin " +
+                                  std::to_string(cs_pin);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        response["status"] = "error";
+        response["message"] = std::string("Error: ") + e.what();
+    }
+
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleSPIWear(httplib::Request const& req,
+                              httplib::Response& res) const
+{
+    nlohmann::json response;
+
+    try
+    {
+        int cs_pin = std::stoi(req.get_param_value("cs"));
+        auto flash = std::dynamic_pointer_cast<SPIFlashDevice>(
+            arduino_sim.getSPI().device(cs_pin));
+        if (flash)
+        {
+            response["status"] = "success";
+            response["sector_size"] = SPIFlashDevice::SECTOR_SIZE;
+            response["erase_counts"] = flash->eraseCounts();
+        }
+        else
+        {
+            response["status"] = "error";
+            response["message"] = "No SPI flash on CS pin " +
+                                  std::to_string(cs_pin);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        response["status"] = "error";
+        response["message"] = std::string("Error: ") + e.what();
+    }
+
+    res.set_content(response.dump(), "application/json");
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleGetEEPROM(httplib::Request const&,
+                                httplib::Response& res) const
+{
+    EEPROMEmulator& eeprom = arduino_sim.getEEPROM();
+
+    nlohmann::json response;
+    response["size"] = eeprom.size();
+    response["file"] = eeprom.path();
+    response["writes"] = eeprom.writes();
+    response["content"] = eeprom.content();
+    response["write_counts"] = eeprom.writeCounts();
+    res.set_content(response.dump(), "application/json");
+}
+
 // ----------------------------------------------------------------------------
 void WebServer::handleGetTick(httplib::Request const&,
                               httplib::Response& res) const
@@ -570,6 +1375,7 @@ void WebServer::handleGetBoard(httplib::Request const&,
     response["analog_input_pins"] = m_config.board.analog_input_pins;
     response["pin_mapping"] = m_config.board.pin_mapping;
     response["analog_only_pins"] = m_config.board.analog_only_pins;
+    response["uarts"] = m_config.board.uarts;
 
     res.set_content(response.dump(), "application/json");
 }
@@ -599,28 +1405,36 @@ static std::string frequencyToNote(int frequency)
 }
 
 // ----------------------------------------------------------------------------
-void WebServer::handleGetAudio(httplib::Request const&,
-                               httplib::Response& res) const
+// Helper function returning the state of the tone generator
+static nlohmann::json audioToJson()
 {
-    nlohmann::json response;
+    nlohmann::json audio;
+    ToneGenerator const& tone_generator = arduino_sim.getToneGenerator();
 
     // Get audio information from tone generator
-    response["playing"] = tone_generator.isPlaying();
-    response["frequency"] = tone_generator.getFrequency();
-    response["pin"] = tone_generator.getCurrentPin();
+    audio["playing"] = tone_generator.isPlaying();
+    audio["frequency"] = tone_generator.getFrequency();
+    audio["pin"] = tone_generator.getCurrentPin();
 
     // Calculate note name if playing
     if (tone_generator.isPlaying())
     {
         int freq = tone_generator.getFrequency();
-        response["note"] = frequencyToNote(freq);
+        audio["note"] = frequencyToNote(freq);
     }
     else
     {
-        response["note"] = "Silent";
+        audio["note"] = "Silent";
     }
 
-    res.set_content(response.dump(), "application/json");
+    return audio;
+}
+
+// ----------------------------------------------------------------------------
+void WebServer::handleGetAudio(httplib::Request const&,
+                               httplib::Response& res) const
+{
+    res.set_content(audioToJson().dump(), "application/json");
 }
 
 // ----------------------------------------------------------------------------
@@ -629,6 +1443,9 @@ void WebServer::handleGetStatus(httplib::Request const&,
 {
     nlohmann::json response;
     response["running"] = arduino_sim.isRunning();
+    response["watchdog_restarts"] = m_watchdog_restarts.load();
+    response["restart_latency_ms"] =
+        double(m_restart_latency_us.load()) / 1000.0;
     res.set_content(response.dump(), "application/json");
 }
 
@@ -637,38 +1454,153 @@ void WebServer::handleGetDebugLog(httplib::Request const&,
                                   httplib::Response& res)
 {
     nlohmann::json response;
-    std::vector<std::string> messages;
+    response["messages"] = popDebugLog();
+    res.set_content(response.dump(), "application/json");
+}
 
-    {
-        std::scoped_lock lock(m_debug_log_mutex);
-        while (!m_debug_log.empty())
-        {
-            messages.push_back(m_debug_log.front());
-            m_debug_log.pop();
-        }
-    }
+// ----------------------------------------------------------------------------
+void WebServer::handleGetState(httplib::Request const& req,
+                               httplib::Response& res)
+{
+    nlohmann::json response;
+
+    uint64_t seq = arduino_sim.getPinChangeSeq();
+    response["tick"] = m_tick_counter.load();
+    response["running"] = arduino_sim.isRunning();
+    response["pins_seq"] = seq;
+    response["pins"] =
+        pinsToJson(m_config.board.total_pins, parseSince(req, seq));
+    response["audio"] = audioToJson();
+    response["serial"] = serialToJson();
+    response["debug"] = popDebugLog();
 
-    response["messages"] = messages;
     res.set_content(response.dump(), "application/json");
 }
 
 // ----------------------------------------------------------------------------
-void WebServer::addDebugLog(const std::string& message)
+void WebServer::handleEvents(httplib::Request const&, httplib::Response& res)
+{
+    // Send the changed topics as soon as they are published, but not more
+    // often than the refresh rate: changes happening meanwhile are coalesced
+    // so a fast loop() cannot flood the browser. A comment line is sent on
+    // idle periods to detect disconnected browsers.
+    const auto keepalive_period = std::chrono::seconds(15);
+    const auto min_period =
+        std::chrono::microseconds(1000000 / m_config.refresh_rate);
+
+    auto seen = std::make_shared<EventBroker::Generations>(
+        EventBroker::unseen());
+    auto pins_seq = std::make_shared<uint64_t>(0);
+    auto last_sent = std::make_shared<std::chrono::steady_clock::time_point>();
+
+    m_events.subscribe();
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider(
+        "text/event-stream",
+        [this, seen, pins_seq, last_sent, keepalive_period, min_period](
+            size_t, httplib::DataSink& sink)
+        {
+            std::this_thread::sleep_until(*last_sent + min_period);
+
+            std::array<bool, EventBroker::Count> changed{};
+            if (!m_events.wait(*seen, changed, keepalive_period))
+            {
+                sink.done();
+                return true;
+            }
+
+            std::string message;
+            auto append = [&message](const char* p_event,
+                                     nlohmann::json const& p_data)
+            {
+                message += "event: ";
+                message += p_event;
+                message += "\ndata: ";
+                message += p_data.dump();
+                message += "\n\n";
+            };
+
+            if (changed[EventBroker::Status])
+            {
+                nlohmann::json status;
+                status["running"] = arduino_sim.isRunning();
+                status["tick"] = m_tick_counter.load();
+                append("status", status);
+            }
+            if (changed[EventBroker::Pins])
+            {
+                // Only the pins changed since the previous event
+                nlohmann::json pins;
+                uint64_t seq = arduino_sim.getPinChangeSeq();
+                pins["seq"] = seq;
+                pins["pins"] =
+                    pinsToJson(m_config.board.total_pins, *pins_seq);
+                *pins_seq = seq;
+                if (!pins["pins"].empty())
+                    append("pins", pins);
+            }
+            if (changed[EventBroker::Audio])
+            {
+                append("audio", audioToJson());
+            }
+            if (changed[EventBroker::Serial])
+            {
+                nlohmann::json serial = serialToJson();
+                for (auto const& port : serial["ports"])
+                {
+                    if (!port["output"].get_ref<std::string const&>().empty())
+                    {
+                        append("serial", serial);
+                        break;
+                    }
+                }
+            }
+            if (changed[EventBroker::Debug])
+            {
+                std::vector<std::string> messages = popDebugLog();
+                if (!messages.empty())
+                    append("debug", messages);
+            }
+
+            if (message.empty())
+            {
+                message = ": keepalive\n\n";
+            }
+            *last_sent = std::chrono::steady_clock::now();
+            return sink.write(message.data(), message.size());
+        },
+        [this](bool) { m_events.unsubscribe(); });
+}
+
+// ----------------------------------------------------------------------------
+std::vector<std::string> WebServer::popDebugLog()
 {
+    std::vector<std::string> messages;
+
     std::scoped_lock lock(m_debug_log_mutex);
-    m_debug_log.push(message);
+    while (!m_debug_log.empty())
+    {
+        messages.push_back(m_debug_log.front());
+        m_debug_log.pop();
+    }
+
+    return messages;
 }
 
 // ----------------------------------------------------------------------------
-void WebServer::restartArduinoSimulation()
+void WebServer::addDebugLog(const std::string& message)
 {
-    // The Arduino thread is stuck in an infinite loop in user's loop() function
-    // We can't join it because it won't terminate, so we detach it
-    if (m_arduino_thread.joinable())
     {
-        m_arduino_thread.detach();
+        std::scoped_lock lock(m_debug_log_mutex);
+        m_debug_log.push(message);
     }
+    m_events.publish(EventBroker::Debug);
+}
 
+// ----------------------------------------------------------------------------
+void WebServer::restartArduinoSimulation()
+{
+    // The frozen Arduino thread has been terminated by cancelSketchThread()
     // The watchdog thread (this thread) is also joinable and needs to be
     // detached before we can assign a new thread to m_watchdog_thread
     if (m_watchdog_thread.joinable())
@@ -680,18 +1612,20 @@ void WebServer::restartArduinoSimulation()
     arduino_sim.getSerial().begin(9600);
 
     // Stop any audio
-    tone_generator.stopTone();
+    arduino_sim.getToneGenerator().stopTone();
 
     // Reset tick counter
     m_tick_counter = 0;
 
     // Create new simulation threads
     // Note: we don't reset pins - setup() will reconfigure them
-    arduino_sim.setRunning(true);
+    arduino_sim.start();
     m_watchdog_should_stop = false;
 
-    m_arduino_thread = std::thread([this]() { runArduinoSimulation(); });
+    m_sketch_exited = false;
+    m_arduino_thread = std::thread([this]() { sketchThread(); });
     m_watchdog_thread = std::thread([this]() { watchdogThread(); });
+    m_events.publish(EventBroker::Status);
 
     // Important: this function returns and the OLD watchdog thread will exit
     // The NEW watchdog thread is now running independently
@@ -7,31 +7,24 @@
 
 #pragma once
 
-#include "BoardConfig.hpp"
+#include "Config.hpp"
+#include "EventBroker.hpp"
+#include "PtyBridge.hpp"
+#include "SketchLoader.hpp"
 #include "cpp-httplib/httplib.h"
+#include "nlohmann/json.hpp"
 
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <thread>
+#include <vector>
 
-// ==========================================================================
-//! \brief Configuration structure for the Arduino Emulator server.
-// ==========================================================================
-struct Config
-{
-    //! \brief Server address.
-    std::string address;
-    //! \brief Server port.
-    uint16_t port;
-    //! \brief Arduino loop rate in Hz.
-    size_t frequency;
-    //! \brief Board configuration file.
-    std::string board_file;
-    //! \brief Board configuration.
-    BoardConfig board;
-};
+//! \brief Cancellation state of a sketch thread (ArduinoEmulator.hpp).
+enum class SketchState : int;
 
 // ==========================================================================
 //! \brief Web server for Arduino emulator interface.
@@ -43,8 +36,9 @@ public:
     // ------------------------------------------------------------------------
     //! \brief Constructor.
     //! \param p_config Configuration.
+    //! \param p_sketch Sketch to run (reloadable from the web interface).
     // ------------------------------------------------------------------------
-    explicit WebServer(Config const& p_config);
+    WebServer(Config const& p_config, SketchLoader& p_sketch);
 
     // ------------------------------------------------------------------------
     //! \brief Destructor - ensures proper cleanup.
@@ -70,6 +64,12 @@ public:
         return m_server_running;
     }
 
+    // ------------------------------------------------------------------------
+    //! \brief Pseudo-terminals bridged to Serial, Serial1 ... (empty if
+    //! none).
+    // ------------------------------------------------------------------------
+    std::vector<std::string> serialPorts() const;
+
 private:
 
     // ------------------------------------------------------------------------
@@ -86,6 +86,8 @@ private:
                               httplib::Response& res);
     void handleResetSimulation(httplib::Request const& req,
                                httplib::Response& res);
+    void handleSketchReload(httplib::Request const& req,
+                            httplib::Response& res);
     void handleGetPins(httplib::Request const& req,
                        httplib::Response& res) const;
     void handleSetPin(httplib::Request const& req,
@@ -98,6 +100,22 @@ private:
                       httplib::Response& res) const;
     void handleAnalogSet(httplib::Request const& req,
                          httplib::Response& res) const;
+    void handleGetI2C(httplib::Request const& req,
+                      httplib::Response& res) const;
+    void handleI2CDevice(httplib::Request const& req,
+                         httplib::Response& res) const;
+    void handleI2CRegisters(httplib::Request const& req,
+                            httplib::Response& res) const;
+    void handleGetSPI(httplib::Request const& req,
+                      httplib::Response& res) const;
+    void handleSPIDevice(httplib::Request const& req,
+                         httplib::Response& res) const;
+    void handleSPIRegisters(httplib::Request const& req,
+                            httplib::Response& res) const;
+    void handleSPIWear(httplib::Request const& req,
+                       httplib::Response& res) const;
+    void handleGetEEPROM(httplib::Request const& req,
+                         httplib::Response& res) const;
     void handleGetTick(httplib::Request const& req,
                        httplib::Response& res) const;
     void handleGetBoard(httplib::Request const& req,
@@ -107,17 +125,56 @@ private:
     void handleGetStatus(httplib::Request const& req,
                          httplib::Response& res) const;
     void handleGetDebugLog(httplib::Request const& req, httplib::Response& res);
+    void handleGetState(httplib::Request const& req,
+                        httplib::Response& res);
+    void handleEvents(httplib::Request const& req, httplib::Response& res);
+
+    // ------------------------------------------------------------------------
+    //! \brief Drain the output of the serial ports and get their counters.
+    // ------------------------------------------------------------------------
+    nlohmann::json serialToJson() const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Body of the sketch thread: run the simulation until stopped or
+    //! cancelled.
+    // ------------------------------------------------------------------------
+    void sketchThread();
 
     // ------------------------------------------------------------------------
     //! \brief Run Arduino simulation loop.
     // ------------------------------------------------------------------------
     void runArduinoSimulation();
 
+    // ------------------------------------------------------------------------
+    //! \brief Terminate the sketch thread at its next cancellation point.
+    //! \return false if the thread could not be terminated: it is detached
+    //! and abandoned (it parks at its next Arduino API call).
+    // ------------------------------------------------------------------------
+    bool cancelSketchThread();
+
+    // ------------------------------------------------------------------------
+    //! \brief Wait for the end of the sketch thread.
+    //! \param p_timeout Maximum time to wait.
+    //! \return true if the sketch thread has exited.
+    // ------------------------------------------------------------------------
+    bool waitSketchExit(std::chrono::milliseconds p_timeout) const;
+
+    // ------------------------------------------------------------------------
+    //! \brief Start Arduino simulation and its watchdog.
+    // ------------------------------------------------------------------------
+    void startArduinoSimulation();
+
     // ------------------------------------------------------------------------
     //! \brief Stop Arduino simulation.
     // ------------------------------------------------------------------------
     void stopArduinoSimulation();
 
+    // ------------------------------------------------------------------------
+    //! \brief Check if an abandoned sketch thread has not parked yet: it
+    //! may still execute the code of the sketch library.
+    // ------------------------------------------------------------------------
+    bool abandonedSketchRunning();
+
     // ------------------------------------------------------------------------
     //! \brief Restart Arduino simulation after infinite loop detection.
     // ------------------------------------------------------------------------
@@ -133,10 +190,17 @@ private:
     // ------------------------------------------------------------------------
     void addDebugLog(const std::string& message);
 
+    // ------------------------------------------------------------------------
+    //! \brief Extract all pending messages from the debug log.
+    // ------------------------------------------------------------------------
+    std::vector<std::string> popDebugLog();
+
 private:
 
     //! \brief Configuration
     Config const& m_config;
+    //! \brief setup() and loop() of the sketch
+    SketchLoader& m_sketch;
     //! \brief HTTP server
     httplib::Server m_server;
     //! \brief Server running state
@@ -145,6 +209,22 @@ private:
     std::thread m_server_thread;
     //! \brief Arduino simulation thread
     std::thread m_arduino_thread;
+    //! \brief Set when the Arduino simulation thread exits
+    std::atomic<bool> m_sketch_exited{ true };
+    //! \brief State of the sketch threads which could not be cancelled
+    //! (see abandonedSketchRunning())
+    std::vector<std::shared_ptr<std::atomic<SketchState>>>
+        m_abandoned_sketches;
+    //! \brief Protects m_abandoned_sketches
+    std::mutex m_abandoned_mutex;
+    //! \brief Time the watchdog detected the frozen sketch being restarted
+    std::chrono::steady_clock::time_point m_freeze_time;
+    //! \brief The sketch thread is a restart after a watchdog trip
+    std::atomic<bool> m_restarting{ false };
+    //! \brief Number of sketch restarts by the watchdog
+    std::atomic<uint64_t> m_watchdog_restarts{ 0 };
+    //! \brief Delay from the last freeze detection to the sketch restart
+    std::atomic<uint64_t> m_restart_latency_us{ 0 };
     //! \brief Tick counter (incremented after each Arduino loop)
     mutable std::atomic<uint64_t> m_tick_counter{ 0 };
     //! \brief Watchdog thread
@@ -155,4 +235,8 @@ private:
     std::queue<std::string> m_debug_log;
     //! \brief Mutex for debug log
     mutable std::mutex m_debug_log_mutex;
+    //! \brief Wakes up the Server-Sent Events streams on changes
+    EventBroker m_events;
+    //! \brief Serial ports bridged to host terminals (--pty)
+    std::vector<std::unique_ptr<PtyBridge>> m_ptys;
 };
\ No newline at end of file
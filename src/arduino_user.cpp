@@ -1,4 +1,4 @@
-#include <ArduinoEmulator/ArduinoEmulator.hpp>
+#include <ArduinoEmulator/Arduino.hpp>
 
 // This file includes the user's Arduino code (.ino)
 // Modify the path below to point to your .ino file
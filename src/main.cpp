@@ -5,14 +5,21 @@
 //! \copyright MIT License
  */
 
+#include "BatchRunner.hpp"
 #include "BoardConfig.hpp"
 #include "WebServer.hpp"
 
+#include "ArduinoEmulator/Arduino.hpp"
+#include "ArduinoEmulator/SPIFlash.hpp"
+
 #include "cxxopts.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 //! \brief Parse command-line arguments.
@@ -37,11 +44,73 @@ static bool parseCommandLine(Config& config, int argc, char* argv[])
             "Server port",
             cxxopts::value<uint16_t>()->default_value("8080"))(
             "f,frequency",
-            "Arduino loop rate in Hz (1-100, default: 100)",
-            cxxopts::value<size_t>()->default_value("100"))(
+            "Arduino loop rate in Hz or max for back-to-back loop() calls "
+            "(default: 100)",
+            cxxopts::value<std::string>()->default_value("100"))(
+            "r,refresh",
+            "Web interface refresh rate in Hz (default: 2x the loop rate, "
+            "at most 200)",
+            cxxopts::value<size_t>()->default_value("0"))(
             "b,board",
             "Board configuration JSON file",
             cxxopts::value<std::string>()->default_value(""))(
+            "sketch",
+            "Sketch shared library to run instead of the linked sketch "
+            "(reloadable with POST /api/sketch/reload)",
+            cxxopts::value<std::string>()->default_value(""))(
+            "virtual-clock",
+            "Use a simulated clock instead of the host real time")(
+            "s,speed",
+            "Virtual clock speed factor (e.g. 1, 10 or max, default: 1)",
+            cxxopts::value<std::string>()->default_value("1"))(
+            "uart-timing",
+            "Send Serial bytes at the baud rate through a 64-byte TX FIFO: "
+            "block (write waits for room) or short (write returns a short "
+            "count)",
+            cxxopts::value<std::string>()->default_value(""))(
+            "headless",
+            "Run the sketch without web server nor audio, as fast as possible, "
+            "then print the results as JSON")(
+            "d,duration",
+            "Headless: simulated duration in milliseconds",
+            cxxopts::value<uint64_t>()->default_value("0"))(
+            "n,loops",
+            "Headless: number of loop() calls",
+            cxxopts::value<uint64_t>()->default_value("0"))(
+            "timeout",
+            "Headless: host time limit of the run in seconds, 0 for none "
+            "(default: 300)",
+            cxxopts::value<uint64_t>()->default_value("300"))(
+            "stimulus",
+            "Headless: JSON file of inputs to apply at given times",
+            cxxopts::value<std::string>()->default_value(""))(
+            "pty",
+            "Bridge Serial to a pseudo-terminal (/dev/pts/N) for minicom, "
+            "screen or pyserial")(
+            "eeprom",
+            "Store the EEPROM in this file, kept across runs",
+            cxxopts::value<std::string>()->default_value(""))(
+            "eeprom-latency",
+            "EEPROM writes last 3.3 ms per byte as on AVR (virtual clock)")(
+            "spi-flash",
+            "Plug an SPI NOR flash (W25Q) stored in this image file",
+            cxxopts::value<std::string>()->default_value(""))(
+            "spi-flash-cs",
+            "Chip-select pin of the SPI flash (default: 10)",
+            cxxopts::value<int>()->default_value("10"))(
+            "spi-flash-size",
+            "Capacity of the SPI flash in MB, at most 32 (default: 16)",
+            cxxopts::value<size_t>()->default_value("16"))(
+            "spi-flash-dir",
+            "Directory of the flash images the REST API can plug (none by "
+            "default)",
+            cxxopts::value<std::string>()->default_value(""))(
+            "vcd",
+            "Record the pin changes into a VCD file (GTKWave)",
+            cxxopts::value<std::string>()->default_value(""))(
+            "o,output",
+            "Headless: JSON result file (default: standard output)",
+            cxxopts::value<std::string>()->default_value(""))(
             "h,help", "Show this help message");
 
         options.positional_help("[OPTIONS]");
@@ -60,22 +129,129 @@ static bool parseCommandLine(Config& config, int argc, char* argv[])
             std::cout << "  " << argv[0]
                       << " --address localhost --port 9090\n";
             std::cout << "  " << argv[0]
-                      << " -f 20  # Refresh web interface at 20 Hz\n";
+                      << " -f 20  # Call loop() at 20 Hz\n";
+            std::cout << "  " << argv[0]
+                      << " -f max -r 30  # Unthrottled loop(), UI at 30 Hz\n";
             std::cout << "  " << argv[0]
-                      << " -b board.json  # Use custom board configuration\n\n";
+                      << " -b board.json  # Use custom board configuration\n";
+            std::cout << "  " << argv[0]
+                      << " --sketch blink.so  # Run a sketch library\n";
+            std::cout << "  " << argv[0]
+                      << " --virtual-clock -s max  # Fast-forward time\n";
+            std::cout << "  " << argv[0]
+                      << " --headless -d 60000 --stimulus inputs.json"
+                         "  # Run 1 minute of simulated time\n\n";
             return false;
         }
 
         // Get parsed values
         config.address = result["address"].as<std::string>();
         config.port = result["port"].as<uint16_t>();
-        config.frequency = result["frequency"].as<size_t>();
+        config.refresh_rate = result["refresh"].as<size_t>();
         config.board_file = result["board"].as<std::string>();
+        config.sketch_file = result["sketch"].as<std::string>();
+        config.virtual_clock = result.count("virtual-clock") > 0;
+        config.uart_timing = result["uart-timing"].as<std::string>();
+        config.pty = result.count("pty") > 0;
+        config.eeprom_file = result["eeprom"].as<std::string>();
+        config.eeprom_latency = result.count("eeprom-latency") > 0;
+        config.spi_flash = result["spi-flash"].as<std::string>();
+        config.spi_flash_cs = result["spi-flash-cs"].as<int>();
+        config.spi_flash_size =
+            result["spi-flash-size"].as<size_t>() * 1024u * 1024u;
+        config.spi_flash_dir = result["spi-flash-dir"].as<std::string>();
+        config.vcd_file = result["vcd"].as<std::string>();
+        config.headless = result.count("headless") > 0;
+        config.duration_ms = result["duration"].as<uint64_t>();
+        config.loops = result["loops"].as<uint64_t>();
+        config.timeout_s = result["timeout"].as<uint64_t>();
+        config.stimulus_file = result["stimulus"].as<std::string>();
+        config.output_file = result["output"].as<std::string>();
+
+        // A headless run shall end by itself
+        if (config.headless && (config.duration_ms == 0) &&
+            (config.loops == 0))
+        {
+            std::cerr << "Error: Headless mode needs --duration or --loops\n";
+            return false;
+        }
 
-        // Validate frequency range
-        if (config.frequency < 1 || config.frequency > 100)
+        if (!config.uart_timing.empty() && (config.uart_timing != "block") &&
+            (config.uart_timing != "short"))
         {
-            std::cerr << "Error: Frequency must be between 1 and 100 Hz\n";
+            std::cerr << "Error: UART timing must be 'block' or 'short'\n";
+            return false;
+        }
+
+        if (!config.spi_flash.empty() &&
+            ((config.spi_flash_size == 0) ||
+             (config.spi_flash_size > SPIFlashDevice::MAX_SIZE)))
+        {
+            std::cerr << "Error: SPI flash size must be 1 to "
+                      << (SPIFlashDevice::MAX_SIZE >> 20) << " MB\n";
+            return false;
+        }
+
+        // Parse the virtual clock speed factor ("max" means no sleep at all)
+        std::string speed = result["speed"].as<std::string>();
+        if (speed == "max")
+        {
+            config.speed = 0.0;
+        }
+        else
+        {
+            try
+            {
+                config.speed = std::stod(speed);
+            }
+            catch (const std::exception&)
+            {
+                config.speed = -1.0;
+            }
+            if (config.speed <= 0.0)
+            {
+                std::cerr << "Error: Speed must be a positive number or 'max'\n";
+                return false;
+            }
+        }
+
+        // Parse the loop rate ("max" means no pause between loop() calls)
+        std::string frequency = result["frequency"].as<std::string>();
+        if (frequency == "max")
+        {
+            config.frequency = 0;
+        }
+        else
+        {
+            try
+            {
+                config.frequency = std::stoul(frequency);
+            }
+            catch (const std::exception&)
+            {
+                config.frequency = 0;
+            }
+            if (config.frequency < 1)
+            {
+                std::cerr << "Error: Frequency must be at least 1 Hz or "
+                             "'max'\n";
+                return false;
+            }
+        }
+
+        // The web refresh rate does not follow the loop rate beyond what a
+        // browser can display
+        if (config.refresh_rate == 0)
+        {
+            config.refresh_rate = (config.frequency == 0)
+                                      ? Config::MAX_REFRESH_RATE
+                                      : std::min(2 * config.frequency,
+                                                 Config::MAX_REFRESH_RATE);
+        }
+        else if (config.refresh_rate > Config::MAX_REFRESH_RATE)
+        {
+            std::cerr << "Error: Refresh rate must be at most "
+                      << Config::MAX_REFRESH_RATE << " Hz\n";
             return false;
         }
 
@@ -86,6 +262,18 @@ static bool parseCommandLine(Config& config, int argc, char* argv[])
             return false;
         }
 
+        // The linked sketch reads the analog pins it was compiled with
+        auto analog = config.board.pin_mapping.find("A0");
+        if (config.sketch_file.empty() &&
+            (analog != config.board.pin_mapping.end()) &&
+            (analog->second != A0))
+        {
+            std::cerr << "Error: The board maps A0 to pin " << analog->second
+                      << " but the sketch is compiled with A0 = " << A0
+                      << " (build the Mega with make BOARD=mega)\n";
+            return false;
+        }
+
         return true;
     }
     catch (const cxxopts::exceptions::exception& e)
@@ -95,6 +283,59 @@ static bool parseCommandLine(Config& config, int argc, char* argv[])
     }
 }
 
+// ----------------------------------------------------------------------------
+//! \brief Run the sketch without web server and write the results.
+//! \param config Configuration.
+//! \param sketch Sketch to run.
+//! \return Process exit code.
+// ----------------------------------------------------------------------------
+static int runHeadless(Config const& config, SketchLoader const& sketch)
+{
+    BatchRunner runner(config, sketch);
+    if (!config.stimulus_file.empty() &&
+        !runner.loadStimuli(config.stimulus_file))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (!runner.run())
+    {
+        return EXIT_FAILURE;
+    }
+
+    // The results of a run stopped by the timeout or an exception are
+    // written too, to see where the sketch was stuck
+    int status = (runner.timedOut() || !runner.error().empty())
+                     ? EXIT_FAILURE
+                     : EXIT_SUCCESS;
+    if (runner.timedOut())
+    {
+        std::cerr << "Error: Headless run stopped after " << config.timeout_s
+                  << " s of host time\n";
+    }
+    if (!runner.error().empty())
+    {
+        std::cerr << "Error: The sketch threw an exception: "
+                  << runner.error() << "\n";
+    }
+
+    std::string results = runner.results().dump(2);
+    if (config.output_file.empty())
+    {
+        std::cout << results << "\n";
+        return status;
+    }
+
+    std::ofstream file(config.output_file);
+    if (!(file << results << "\n"))
+    {
+        std::cerr << "Error: Cannot write result file: " << config.output_file
+                  << "\n";
+        return EXIT_FAILURE;
+    }
+    return status;
+}
+
 // ----------------------------------------------------------------------------
 int main(int argc, char* argv[])
 {
@@ -105,20 +346,44 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    // Sketch linked in the emulator, or loaded from a shared library
+    SketchLoader sketch;
+    if (!config.sketch_file.empty() && !sketch.load(config.sketch_file))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (config.headless)
+    {
+        return runHeadless(config, sketch);
+    }
+
     std::cout << "========================================\n";
     std::cout << "Arduino Emulator Web Interface\n";
     std::cout << "Board: " << config.board.name << "\n";
+    if (!config.sketch_file.empty())
+        std::cout << "Sketch: " << config.sketch_file << "\n";
     std::cout << "Server address: " << config.address << "\n";
     std::cout << "Server port: " << config.port << "\n";
-    std::cout << "Arduino loop rate: " << config.frequency << " Hz ("
-              << (1000 / config.frequency) << " ms)\n";
-    std::cout << "Web client poll rate: " << (2 * config.frequency) << " Hz ("
-              << (1000 / (2 * config.frequency)) << " ms)\n";
+    if (config.frequency == 0)
+        std::cout << "Arduino loop rate: max (unthrottled)\n";
+    else
+        std::cout << "Arduino loop rate: " << config.frequency << " Hz ("
+                  << (1000000.0 / double(config.frequency)) << " us)\n";
+    std::cout << "Clock: ";
+    if (!config.virtual_clock)
+        std::cout << "real time\n";
+    else if (config.speed == 0.0)
+        std::cout << "virtual (max speed)\n";
+    else
+        std::cout << "virtual (" << config.speed << "x)\n";
+    std::cout << "Web client refresh rate: " << config.refresh_rate
+              << " Hz (" << (1000 / config.refresh_rate) << " ms)\n";
     std::cout << "========================================\n";
     std::cout << "Starting server...\n";
 
     // Create and start web server
-    WebServer server(config);
+    WebServer server(config, sketch);
     if (!server.start())
     {
         std::cerr << "Failed to start server\n";
@@ -132,6 +397,12 @@ int main(int argc, char* argv[])
     else
         std::cout << config.address;
     std::cout << ":" << config.port << "\n";
+    std::vector<std::string> ports = server.serialPorts();
+    for (size_t port = 0; port < ports.size(); ++port)
+    {
+        std::cout << "Serial" << (port == 0 ? "" : std::to_string(port))
+                  << " port: " << ports[port] << "\n";
+    }
     std::cout << "Press Ctrl+C to stop the server\n";
     std::cout << "========================================\n";
 